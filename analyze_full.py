@@ -59,7 +59,7 @@ except ImportError:
 CONVERGENCE_THRESHOLD = 0.95   # 95 % of nodes must receive the message
 GOSSIP_TYPE           = "GOSSIP"
 CONTROL_TYPES         = {"HELLO", "GET_PEERS", "PEERS_LIST", "PING", "PONG",
-                         "IHAVE", "IWANT"}
+                         "IHAVE", "IWANT", "DIGEST"}
 
 COLORS = {
     "push":   "#4C72B0",
@@ -0,0 +1,563 @@
+/*
+ * gossip_bench – microbenchmarks for the per-message data paths.
+ *
+ *   make bench                        build and run everything
+ *   bench/gossip_bench [-c] [-t ms] [filter]
+ *
+ *   -c       CSV output (name,param,ns_per_op,allocs_per_op,bytes_per_op)
+ *            so runs from two commits can be diffed
+ *   -t ms    minimum measuring time per benchmark (default 200)
+ *   filter   only run benchmarks whose name contains this string
+ *
+ * Each benchmark is calibrated by doubling its iteration count until one
+ * run takes at least the minimum time.  Allocations are counted by
+ * interposing malloc/calloc/realloc (glibc only).  bytes/op is the data
+ * the operation has to read or write at minimum: the wire text for
+ * (de)serialization, the ID for seen/store/watermark lookups, the peer entries
+ * scanned for membership, the input for SHA-256.
+ */
+#include "message.h"
+#include "serialization.h"
+#include "seen.h"
+#include "watermark.h"
+#include "store.h"
+#include "member.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+/* =========================================================
+ * Allocation counting
+ * ========================================================= */
+
+static uint64_t alloc_count;
+static uint64_t alloc_bytes;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t n);
+
+void *malloc(size_t n) {
+    alloc_count++;
+    alloc_bytes += n;
+    return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+    alloc_count++;
+    alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n) {
+    alloc_count++;
+    alloc_bytes += n;
+    return __libc_realloc(p, n);
+}
+#define ALLOCS_COUNTED 1
+#else
+#define ALLOCS_COUNTED 0
+#endif
+
+/* =========================================================
+ * Harness
+ * ========================================================= */
+
+typedef void (*bench_fn)(void *ctx, uint64_t iters);
+
+static int         csv_output;
+static uint64_t    min_ns = 200 * 1000000ull;
+static const char *filter;
+
+/* Keeps results alive so the compiler cannot drop the work */
+static volatile uint64_t sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void run(const char *name, const char *param, bench_fn fn, void *ctx,
+                double bytes_per_op) {
+    if (filter && !strstr(name, filter)) return;
+
+    fn(ctx, 100);   /* warm caches and lazy state */
+
+    uint64_t iters = 1000, elapsed, allocs;
+    for (;;) {
+        uint64_t a0 = alloc_count;
+        uint64_t t0 = now_ns();
+        fn(ctx, iters);
+        elapsed = now_ns() - t0;
+        allocs  = alloc_count - a0;
+        if (elapsed >= min_ns || iters >= (1ull << 34)) break;
+        iters *= 2;
+    }
+
+    double ns  = (double)elapsed / (double)iters;
+    double apo = (double)allocs / (double)iters;
+    if (csv_output) {
+        printf("%s,%s,%.2f,%.3f,%.0f\n", name, param, ns, apo, bytes_per_op);
+    } else {
+        char allocs_s[32];
+        if (ALLOCS_COUNTED) snprintf(allocs_s, sizeof(allocs_s), "%.3f", apo);
+        else                snprintf(allocs_s, sizeof(allocs_s), "-");
+        printf("%-22s %-16s %12.1f %10s %10.0f %10.1f\n", name, param, ns,
+               allocs_s, bytes_per_op,
+               ns > 0 ? bytes_per_op / ns * 1000.0 : 0.0);
+    }
+    fflush(stdout);
+}
+
+/* =========================================================
+ * Fixtures
+ * ========================================================= */
+
+/* IDs shaped like the real ones: "<uuid>_<ms>" */
+static void make_id(char *out, uint64_t n) {
+    snprintf(out, ID_LEN, "6f1c2a9e-3b4d-4e5f-8a7b-%012llx_%llu",
+             (unsigned long long)(n * 2654435761u & 0xffffffffffffull),
+             (unsigned long long)(n + 1));
+}
+
+static void make_msg(gossip_msg_t *msg, int payload_len) {
+    memset(msg, 0, sizeof(*msg));
+    msg->version = 1;
+    make_id(msg->msg_id, 42);
+    strcpy(msg->msg_type,    "GOSSIP");
+    strcpy(msg->sender_id,   "6f1c2a9e-3b4d-4e5f-8a7b-0123456789ab");
+    strcpy(msg->sender_addr, "127.0.0.1:8000");
+    strcpy(msg->topic,       "weather");
+    msg->timestamp_ms = 1700000000000ull;
+    msg->ttl = 8;
+
+    /* Printable text, no characters that need escaping */
+    for (int i = 0; i < payload_len; i++)
+        msg->payload[i] = (char)('a' + i % 26);
+    msg->payload[payload_len] = '\0';
+}
+
+static const int payload_sizes[] = { 64, 1024, 8000 };
+#define NUM_PAYLOAD_SIZES (int)(sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+/* =========================================================
+ * serialize_message / deserialize_message
+ * ========================================================= */
+
+typedef struct {
+    gossip_msg_t msg;
+    char         wire[MAX_SERIALIZED_LEN];
+    int          wire_len;
+} serial_ctx_t;
+
+static void bench_serialize(void *arg, uint64_t iters) {
+    serial_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)serialize_message(&c->msg, c->wire, sizeof(c->wire));
+}
+
+static void bench_deserialize(void *arg, uint64_t iters) {
+    serial_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++) {
+        sink += (uint64_t)deserialize_message(c->wire, &c->msg);
+        sink += (uint64_t)c->msg.ttl;
+    }
+}
+
+static void bench_peek_header(void *arg, uint64_t iters) {
+    serial_ctx_t *c = arg;
+    char id[ID_LEN], type[MSG_TYPE_LEN];
+    for (uint64_t i = 0; i < iters; i++) {
+        sink += (uint64_t)wire_peek_header(c->wire, id, sizeof(id),
+                                           type, sizeof(type));
+        sink += (uint64_t)id[0];
+    }
+}
+
+static void run_serialization(void) {
+    serial_ctx_t *c = malloc(sizeof(*c));
+    if (!c) return;
+    for (int s = 0; s < NUM_PAYLOAD_SIZES; s++) {
+        char param[32];
+        snprintf(param, sizeof(param), "payload=%d", payload_sizes[s]);
+        make_msg(&c->msg, payload_sizes[s]);
+        serialize_message(&c->msg, c->wire, sizeof(c->wire));
+        c->wire_len = (int)strlen(c->wire);
+
+        run("serialize_message", param, bench_serialize, c, c->wire_len);
+        run("deserialize_message", param, bench_deserialize, c, c->wire_len);
+        /* Header peek only reads up to msg_type, whatever the payload */
+        const char *end = strstr(c->wire, "\"msg_type\"");
+        run("wire_peek_header", param, bench_peek_header, c,
+            end ? (double)(end - c->wire) : 0);
+    }
+    free(c);
+}
+
+/* =========================================================
+ * mark_seen (seen_insert) and seen_contains
+ * ========================================================= */
+
+typedef struct {
+    seen_set_t set;
+    char     (*ids)[ID_LEN];   /* pre-generated so ID formatting isn't timed */
+    int        nids;
+    uint64_t   next;
+} seen_ctx_t;
+
+/* Steady state: every insert is new and evicts the oldest ID */
+static void bench_seen_insert_new(void *arg, uint64_t iters) {
+    seen_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)seen_insert(&c->set, c->ids[c->next++ % (uint64_t)c->nids]);
+}
+
+/* Duplicate delivery: the ID is already held */
+static void bench_seen_insert_dup(void *arg, uint64_t iters) {
+    seen_ctx_t *c = arg;
+    int held = seen_size(&c->set);
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)seen_insert(&c->set, seen_recent(&c->set,
+                                                            (int)(i % (uint64_t)held)));
+}
+
+static void bench_seen_contains_miss(void *arg, uint64_t iters) {
+    seen_ctx_t *c = arg;
+    char id[ID_LEN];
+    make_id(id, 0xdeadbeefull);
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)seen_contains(&c->set, id);
+}
+
+static void run_seen(void) {
+    static const int capacities[] = { 2000, 100000 };
+    for (int k = 0; k < 2; k++) {
+        seen_ctx_t c;
+        memset(&c, 0, sizeof(c));
+        /* More IDs than slots so the ring keeps wrapping */
+        c.nids = capacities[k] * 4;
+        c.ids  = malloc((size_t)c.nids * ID_LEN);
+        if (!c.ids || seen_init(&c.set, capacities[k]) != 0) {
+            free(c.ids);
+            continue;
+        }
+        for (int i = 0; i < c.nids; i++) make_id(c.ids[i], (uint64_t)i);
+        for (int i = 0; i < capacities[k]; i++)
+            seen_insert(&c.set, c.ids[c.next++ % (uint64_t)c.nids]);
+
+        char param[32];
+        snprintf(param, sizeof(param), "capacity=%d", capacities[k]);
+        double id_len = (double)strlen(c.ids[0]) + 1;
+        run("mark_seen/new", param, bench_seen_insert_new, &c, id_len);
+        run("mark_seen/duplicate", param, bench_seen_insert_dup, &c, id_len);
+        run("seen_contains/miss", param, bench_seen_contains_miss, &c, id_len);
+
+        seen_free(&c.set);
+        free(c.ids);
+    }
+}
+
+/* =========================================================
+ * Watermark dedup (wm_insert), the seen-set's replacement for
+ * originated ids
+ * ========================================================= */
+
+typedef struct {
+    watermark_table_t wm;
+    char     (*origins)[NODE_ID_LEN];
+    int        norigins;
+    uint64_t   next;
+} wm_ctx_t;
+
+/* Origins publish round-robin, every seq is new and in order */
+static void bench_wm_insert_new(void *arg, uint64_t iters) {
+    wm_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++, c->next++)
+        sink += (uint64_t)wm_insert(&c->wm,
+                                    c->origins[c->next % (uint64_t)c->norigins],
+                                    c->next / (uint64_t)c->norigins + 1,
+                                    NULL, 0);
+}
+
+/* Duplicate delivery of something already under the watermark */
+static void bench_wm_insert_dup(void *arg, uint64_t iters) {
+    wm_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)wm_insert(&c->wm,
+                                    c->origins[i % (uint64_t)c->norigins],
+                                    1, NULL, 0);
+}
+
+/* Includes wm_parse_id, as the receive path does */
+static void bench_wm_contains_id(void *arg, uint64_t iters) {
+    wm_ctx_t *c = arg;
+    char id[ID_LEN], origin[NODE_ID_LEN];
+    snprintf(id, sizeof(id), "%s_%llu", c->origins[0],
+             (unsigned long long)(c->next / (uint64_t)c->norigins + 1000));
+    for (uint64_t i = 0; i < iters; i++) {
+        uint64_t seq;
+        if (wm_parse_id(id, origin, sizeof(origin), &seq) == 0)
+            sink += (uint64_t)wm_contains(&c->wm, origin, seq);
+    }
+}
+
+static void run_watermark(void) {
+    static const int origin_counts[] = { 10, 1000 };
+    for (int k = 0; k < 2; k++) {
+        wm_ctx_t c;
+        memset(&c, 0, sizeof(c));
+        c.norigins = origin_counts[k];
+        c.origins  = malloc((size_t)c.norigins * NODE_ID_LEN);
+        if (!c.origins || wm_init(&c.wm) != 0) {
+            free(c.origins);
+            continue;
+        }
+        for (int i = 0; i < c.norigins; i++) {
+            char id[ID_LEN];
+            make_id(id, (uint64_t)i);
+            *strrchr(id, '_') = '\0';
+            snprintf(c.origins[i], NODE_ID_LEN, "%.*s", NODE_ID_LEN - 1, id);
+        }
+        bench_wm_insert_new(&c, (uint64_t)c.norigins * 4);
+
+        char param[32];
+        snprintf(param, sizeof(param), "origins=%d", c.norigins);
+        double id_len = (double)strlen(c.origins[0]) + 8;
+        run("wm_insert/new", param, bench_wm_insert_new, &c, id_len);
+        run("wm_insert/duplicate", param, bench_wm_insert_dup, &c, id_len);
+        run("wm_contains/miss", param, bench_wm_contains_id, &c, id_len);
+
+        wm_free(&c.wm);
+        free(c.origins);
+    }
+}
+
+/* =========================================================
+ * find_stored (store_find) and store_put
+ * ========================================================= */
+
+typedef struct {
+    gossip_store_t store;
+    gossip_msg_t   msg;
+    char         (*ids)[ID_LEN];
+    uint64_t       next;
+} store_ctx_t;
+
+static void bench_store_find_hit(void *arg, uint64_t iters) {
+    store_ctx_t *c = arg;
+    int held = store_size(&c->store);
+    for (uint64_t i = 0; i < iters; i++) {
+        /* Spread lookups over the whole store, newest to oldest */
+        const char *id = c->ids[(i * 7919) % (uint64_t)held];
+        sink += (uint64_t)(store_find(&c->store, id) != NULL);
+    }
+}
+
+static void bench_store_find_miss(void *arg, uint64_t iters) {
+    store_ctx_t *c = arg;
+    char id[ID_LEN];
+    make_id(id, 0xdeadbeefull);
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)(store_find(&c->store, id) != NULL);
+}
+
+static void bench_store_put(void *arg, uint64_t iters) {
+    store_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++) {
+        c->msg.ttl = (int)(i & 7);
+        store_put(&c->store, &c->msg);
+    }
+}
+
+static void run_store(void) {
+    store_ctx_t *c = calloc(1, sizeof(*c));
+    if (!c) return;
+    c->ids = malloc((size_t)MAX_STORED_GOSSIP * ID_LEN);
+    if (!c->ids || store_init(&c->store, MAX_STORED_GOSSIP) != 0) {
+        free(c->ids);
+        free(c);
+        return;
+    }
+
+    make_msg(&c->msg, 1024);
+    for (int i = 0; i < MAX_STORED_GOSSIP; i++) {
+        make_id(c->ids[i], (uint64_t)i);
+        strcpy(c->msg.msg_id, c->ids[i]);
+        store_put(&c->store, &c->msg);
+    }
+
+    char param[32];
+    snprintf(param, sizeof(param), "stored=%d", MAX_STORED_GOSSIP);
+    /* A linear scan compares, on average, half (hit) or all (miss) of
+     * the stored IDs; each slot visited touches at least a cache line */
+    run("find_stored/hit", param, bench_store_find_hit, c,
+        MAX_STORED_GOSSIP / 2.0 * 64);
+    run("find_stored/miss", param, bench_store_find_miss, c,
+        MAX_STORED_GOSSIP * 64.0);
+
+    char wire[MAX_SERIALIZED_LEN];
+    serialize_message(&c->msg, wire, sizeof(wire));
+    run("store_put", "payload=1024", bench_store_put, c, (double)strlen(wire));
+
+    store_free(&c->store);
+    free(c->ids);
+    free(c);
+}
+
+/* =========================================================
+ * membership_add / membership_get_random
+ * ========================================================= */
+
+typedef struct {
+    membership_t       m;
+    struct sockaddr_in addrs[MAX_PEERS * 2];
+    int                peers;
+    int                fanout;
+} member_ctx_t;
+
+static void fill_membership(member_ctx_t *c, int peers) {
+    membership_init(&c->m, MAX_PEERS);
+    for (int i = 0; i < MAX_PEERS * 2; i++) {
+        memset(&c->addrs[i], 0, sizeof(c->addrs[i]));
+        c->addrs[i].sin_family      = AF_INET;
+        c->addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        c->addrs[i].sin_port        = htons((uint16_t)(9000 + i));
+    }
+    for (int i = 0; i < peers; i++) membership_add(&c->m, c->addrs[i]);
+    c->peers = peers;
+}
+
+/* Refresh of a known peer: what every PING/PONG does */
+static void bench_member_add_known(void *arg, uint64_t iters) {
+    member_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)membership_add(&c->m, c->addrs[i % (uint64_t)c->peers]);
+}
+
+/* New peer into a full table: evicts the least recently seen */
+static void bench_member_add_evict(void *arg, uint64_t iters) {
+    member_ctx_t *c = arg;
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)membership_add(&c->m, c->addrs[i % (MAX_PEERS * 2)]);
+}
+
+static void bench_member_get_random(void *arg, uint64_t iters) {
+    member_ctx_t *c = arg;
+    struct sockaddr_in targets[MAX_PEERS];
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)membership_get_random(&c->m, targets, c->fanout,
+                                                &c->addrs[0]);
+}
+
+static void run_membership(void) {
+    static const int sizes[] = { 8, 32, MAX_PEERS };
+    member_ctx_t *c = malloc(sizeof(*c));
+    if (!c) return;
+    for (int k = 0; k < 3; k++) {
+        char param[32];
+        snprintf(param, sizeof(param), "peers=%d", sizes[k]);
+        fill_membership(c, sizes[k]);
+        double scan = (double)sizes[k] * sizeof(peer_info_t);
+
+        /* On average half the table is scanned before the match */
+        run("membership_add/known", param, bench_member_add_known, c, scan / 2);
+
+        c->fanout = 3;
+        snprintf(param, sizeof(param), "peers=%d,k=3", sizes[k]);
+        run("membership_get_random", param, bench_member_get_random, c, scan);
+        pthread_mutex_destroy(&c->m.lock);
+    }
+
+    fill_membership(c, MAX_PEERS);
+    char param[32];
+    snprintf(param, sizeof(param), "peers=%d", MAX_PEERS);
+    run("membership_add/evict", param, bench_member_add_evict, c,
+        (double)MAX_PEERS * sizeof(peer_info_t));
+    pthread_mutex_destroy(&c->m.lock);
+    free(c);
+}
+
+/* =========================================================
+ * SHA-256
+ * ========================================================= */
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+} sha_ctx_t;
+
+static void bench_sha256(void *arg, uint64_t iters) {
+    sha_ctx_t *c = arg;
+    uint8_t digest[32];
+    for (uint64_t i = 0; i < iters; i++) {
+        c->data[0] = (uint8_t)i;
+        sha256(c->data, c->len, digest);
+        sink += digest[0];
+    }
+}
+
+/* One proof-of-work attempt, as done per nonce when mining or per
+ * HELLO when verifying */
+static void bench_pow_check(void *arg, uint64_t iters) {
+    (void)arg;
+    char hex[65];
+    for (uint64_t i = 0; i < iters; i++)
+        sink += (uint64_t)pow_check("6f1c2a9e-3b4d-4e5f-8a7b-0123456789ab",
+                                    (unsigned long)i, 4, hex);
+}
+
+static void run_sha256(void) {
+    static const size_t sizes[] = { 64, 1024, 8192 };
+    for (int k = 0; k < 3; k++) {
+        sha_ctx_t c = { malloc(sizes[k]), sizes[k] };
+        if (!c.data) continue;
+        memset(c.data, 'x', sizes[k]);
+        char param[32];
+        snprintf(param, sizeof(param), "bytes=%zu", sizes[k]);
+        run("sha256", param, bench_sha256, &c, (double)sizes[k]);
+        free(c.data);
+    }
+    run("pow_check", "difficulty=4", bench_pow_check, NULL, 46);
+}
+
+/* =========================================================
+ * Main
+ * ========================================================= */
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c] [-t min_ms] [filter]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "ct:h")) != -1) {
+        switch (opt) {
+        case 'c': csv_output = 1; break;
+        case 't': min_ns = strtoull(optarg, NULL, 10) * 1000000ull; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) filter = argv[optind];
+    srand(1);
+
+    if (csv_output)
+        printf("name,param,ns_per_op,allocs_per_op,bytes_per_op\n");
+    else
+        printf("%-22s %-16s %12s %10s %10s %10s\n", "benchmark", "param",
+               "ns/op", "allocs/op", "bytes/op", "MB/s");
+
+    run_serialization();
+    run_seen();
+    run_watermark();
+    run_store();
+    run_membership();
+    run_sha256();
+    return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Gossip aggregation: push-sum carried on PINGs.
+ *
+ * Every node holds a little "mass" per aggregate: s (value) and w
+ * (participants), starting at (x, 1) if it contributes x, else (0, 0).
+ * On each exchange it keeps a fraction of its mass and hands the rest
+ * to peers, who add it to theirs.  Mass is never created, so totals stay
+ * the cluster-wide sums while every node's ratios converge to the same
+ * values: s / w is the average over contributors.  Max rides along and
+ * converges exactly.
+ *
+ * Sums and counts need one more quantity: the leader mass c, 1 at a
+ * single node and 0 elsewhere, beside a node weight W that every node
+ * starts at 1.  Then W / c tends to the cluster size, s / c to the sum
+ * and w / c to the number of contributors.
+ *
+ * Lost datagrams and departed nodes take mass with them, so the
+ * computation restarts every epoch_rounds rounds from fresh values
+ * (Jelasity et al.'s epochs).  The first node whose timer fires starts
+ * epoch e + 1 as its leader with a random token; peers join the highest
+ * (epoch, token) they hear of, dropping mass from any other instance.
+ * Results are those of the last completed epoch.
+ *
+ * State is O(1) per aggregate.  Not thread-safe: callers serialize
+ * access (node->lock). */
+
+#define AGG_MAX          8
+#define AGG_NAME_LEN     32
+#define AGG_SHARE_SIZE   (64 + AGG_MAX * (AGG_NAME_LEN + 80))
+
+typedef struct {
+    char   name[AGG_NAME_LEN];   /* "" = unused */
+    int    has_local;
+    double local;                /* our contribution */
+    double s, w;                 /* push-sum mass */
+    double max;                  /* -HUGE_VAL = nothing seen */
+} agg_value_t;
+
+/* One aggregate as of the end of an epoch */
+typedef struct {
+    double n;       /* contributing nodes */
+    double sum;
+    double avg;     /* NaN if nobody contributed */
+    double max;     /* -HUGE_VAL if nobody contributed */
+} agg_result_t;
+
+typedef struct {
+    uint64_t    epoch;
+    uint64_t    token;           /* instance; the highest in an epoch wins */
+    int         rounds;          /* exchange rounds in this epoch */
+    int         epoch_rounds;
+    uint64_t    rng;
+    double      weight;          /* W */
+    double      leader;          /* c */
+    agg_value_t vals[AGG_MAX];
+    int         count;
+
+    /* Last completed epoch (results[i] belongs to vals[i]) */
+    int          have_result;
+    uint64_t     result_epoch;
+    double       result_size;
+    agg_result_t results[AGG_MAX];
+} agg_state_t;
+
+/* epoch_rounds > 0; self_id seeds the token generator */
+void agg_init(agg_state_t *a, int epoch_rounds, const char *self_id);
+
+/* Set our contribution to name (added to the running epoch too).
+ * Returns -1 for a bad name (empty, too long, or containing ':', '"',
+ * '\\' or control characters) or a full table. */
+int  agg_set(agg_state_t *a, const char *name, double value);
+
+/* Count one exchange round; returns 1 if it started a new epoch */
+int  agg_round(agg_state_t *a);
+
+/* Keep 1/parts of our mass and write one of the parts - 1 equal shares
+ * as a JSON fragment ("agg_epoch": .., "agg": [..]) for a PING.
+ * Every share written must be sent; one that is lost is mass lost. */
+int  agg_share(agg_state_t *a, int parts, char *buf, size_t size);
+
+/* Add the share in a PING payload.  Returns 1 if merged, 0 if it
+ * is from an older instance, -1 if the payload carries none. */
+int  agg_merge(agg_state_t *a, const char *payload);
+
+/* Last completed epoch's estimates.  Return -1 until there is one
+ * (or, for agg_result, if name is unknown). */
+int  agg_result(const agg_state_t *a, const char *name, agg_result_t *out);
+int  agg_cluster_size(const agg_state_t *a, double *size);
+
+#endif
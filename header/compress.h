@@ -0,0 +1,55 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Payload codecs.
+ * CODEC_LZ      – LZ4-style block format (byte-oriented, very fast).
+ * CODEC_LZ_DICT – same format, with the window primed by a built-in
+ *                 dictionary of common JSON fragments so that small
+ *                 payloads still find matches.
+ *
+ * A compressed payload travels as a JSON object so the envelope stays
+ * valid JSON:
+ *   { "codec": "lz", "len": <raw length>, "b64": "<base64 block>" }
+ */
+#define CODEC_NONE     0
+#define CODEC_LZ       1
+#define CODEC_LZ_DICT  2
+
+/* Capability bits advertised in HELLO / PING / PONG "capabilities" */
+#define CAP_LZ         (1u << CODEC_LZ)
+#define CAP_LZ_DICT    (1u << CODEC_LZ_DICT)
+#define CAP_ALL_CODECS (CAP_LZ | CAP_LZ_DICT)
+
+/* Payloads shorter than this are never worth compressing */
+#define COMPRESS_MIN_LEN 48
+
+int         codec_from_name(const char *name);   /* -1 if unknown */
+const char *codec_name(int codec);
+
+/* Raw block codec.  Return the output length, or -1 on overflow/error.
+ * Raw data is at most MSG_BUF_SIZE bytes: longer input is refused and a
+ * larger cap is clamped. */
+int lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                int use_dict);
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                  int use_dict);
+
+/* Wrap `payload` into a compressed payload object.
+ * Returns 0 on success, -1 if compression would not shrink the payload
+ * (the caller should then send it verbatim). */
+int payload_compress(int codec, const char *payload, char *out, size_t out_size);
+
+/* Codec of a payload (CODEC_NONE if it is not a compressed wrapper). */
+int payload_codec(const char *payload);
+
+/* Expand a compressed payload into `out`.
+ * Returns 1 if expanded, 0 if `payload` was not compressed, -1 on error. */
+int payload_decompress(const char *payload, char *out, size_t out_size);
+
+/* Parse a "capabilities": [...] array into CAP_* bits. */
+uint32_t caps_parse(const char *payload);
+
+#endif
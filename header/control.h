@@ -0,0 +1,95 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "message.h"
+
+/* Local control socket.
+ *
+ * A Unix-domain SOCK_SEQPACKET socket, so every datagram is one frame and
+ * no length prefix is needed at the frame level.  A frame is a one-byte
+ * opcode followed by fields; strings are a big-endian u16 length and the
+ * bytes, without a terminating NUL.
+ *
+ *   client -> node
+ *     'P' PUBLISH     str topic, str data
+ *     'B' BATCH       u16 n, n x (str topic, str data)
+ *     'S' SUBSCRIBE   str topic            ("*" = everything)
+ *     'U' UNSUBSCRIBE str topic
+ *     'M' METRICS     (no fields)
+ *     'V' SET         str key, str value    (replicated state, crdt.h)
+ *     'X' DELETE      str key
+ *     'G' GET         str key
+ *
+ *   node -> client
+ *     'K' OK          u16 n, n x str msg_id   (PUBLISH / BATCH)
+ *                     u16 0                   (SUBSCRIBE / UNSUBSCRIBE,
+ *                                              SET / DELETE)
+ *                     u16 1, str text         (METRICS, see metrics.h;
+ *                                              GET, the value)
+ *     'E' ERROR       str reason
+ *     'D' DELIVER     str msg_id, str topic, str origin, str payload
+ *
+ * A BATCH is published in order and stops at the first item that fails,
+ * so the n IDs in the reply belong to the first n items.
+ *
+ * DELIVER frames are sent without blocking; a client that does not keep
+ * up loses deliveries rather than stalling the dispatcher. */
+
+#define CTL_OP_PUBLISH     'P'
+#define CTL_OP_BATCH       'B'
+#define CTL_OP_SUBSCRIBE   'S'
+#define CTL_OP_UNSUBSCRIBE 'U'
+#define CTL_OP_METRICS     'M'
+#define CTL_OP_SET         'V'
+#define CTL_OP_DELETE      'X'
+#define CTL_OP_GET         'G'
+#define CTL_OP_OK          'K'
+#define CTL_OP_ERROR       'E'
+#define CTL_OP_DELIVER     'D'
+
+#define CTL_MAX_FRAME      65536
+#define CTL_MAX_BATCH      256
+#define CTL_MAX_CLIENTS    16
+#define CTL_CLIENT_TOPICS  8
+
+typedef struct node node_t;
+
+typedef struct {
+    int      fd;                                   /* -1 = free slot */
+    char     topics[CTL_CLIENT_TOPICS][TOPIC_LEN];
+    int      topic_count;
+    uint64_t dropped;                              /* DELIVER frames lost */
+} ctl_client_t;
+
+typedef struct control {
+    node_t          *node;
+    int              listen_fd;
+    char             path[108];                    /* sun_path */
+    ctl_client_t     clients[CTL_MAX_CLIENTS];
+    pthread_mutex_t  lock;                         /* guards clients */
+    pthread_t        thread;
+    int              started;
+    unsigned char    frame[CTL_MAX_FRAME];         /* control thread only */
+} control_t;
+
+/* Bind the socket at path (an existing socket file is replaced).
+ * Returns NULL on failure. */
+control_t *control_open(node_t *node, const char *path);
+/* Start serving clients; the thread exits once node->running drops */
+int  control_start(control_t *c);
+/* Join the thread, close all clients and remove the socket file */
+void control_close(control_t *c);
+
+/* Frame encoding helpers, shared with the client tool.  Each returns the
+ * new offset, or -1 if the field does not fit / is truncated. */
+int  ctl_put_u16(unsigned char *buf, int off, int size, uint16_t v);
+int  ctl_put_str(unsigned char *buf, int off, int size,
+                 const char *s, int len);
+int  ctl_get_u16(const unsigned char *buf, int off, int len, uint16_t *v);
+/* Points *s at the string inside buf (not NUL-terminated) */
+int  ctl_get_str(const unsigned char *buf, int off, int len,
+                 const char **s, int *slen);
+
+#endif
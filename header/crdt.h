@@ -0,0 +1,85 @@
+#ifndef CRDT_H
+#define CRDT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "message.h"
+
+/* Replicated key/value state: a delta-state LWW map.
+ *
+ * Every key holds one register stamped (ts, writer).  A write wins over
+ * another if its ts is higher, ties going to the larger writer id, so
+ * merging is commutative, associative and idempotent and replicas that
+ * saw the same writes hold the same map whatever the order.  ts is a
+ * hybrid clock: wall milliseconds, but never below anything merged, so
+ * a replica's own write always beats what it has seen.  Deletes are
+ * tombstones (a register with deleted = 1) and are never collected.
+ *
+ * Entries changed since the last crdt_take_dirty() are the delta to
+ * ship.  For anti-entropy the keyspace is split into CRDT_BUCKETS by key
+ * hash, each with an XOR of its entries' hashes; two replicas only need
+ * to exchange the buckets whose digests differ.
+ *
+ * Not thread-safe: callers serialize access (node->lock). */
+
+#define CRDT_KEY_LEN    64
+#define CRDT_VALUE_LEN  256
+#define CRDT_BUCKETS    64
+#define CRDT_MAX_KEYS   65536
+
+typedef struct {
+    char     key[CRDT_KEY_LEN];     /* "" = empty slot */
+    char     value[CRDT_VALUE_LEN];
+    uint64_t ts;
+    char     writer[NODE_ID_LEN];
+    int      deleted;
+    int      dirty;                 /* listed in crdt_map_t.dirty */
+} crdt_entry_t;
+
+typedef struct {
+    crdt_entry_t *slots;      /* open addressing, never shrinks */
+    uint32_t      mask;
+    int           count;      /* keys, tombstones included */
+    uint32_t     *dirty;      /* slot indices changed since the last take */
+    int           ndirty;
+    uint64_t      clock;      /* highest ts seen */
+    uint64_t      buckets[CRDT_BUCKETS];
+} crdt_map_t;
+
+int  crdt_init(crdt_map_t *m);
+void crdt_free(crdt_map_t *m);
+
+/* Local write (value NULL = delete).  Returns -1 if key or value is too
+ * long, has control characters, or the map is full. */
+int  crdt_set(crdt_map_t *m, const char *writer, const char *key,
+              const char *value);
+
+/* Live value of key, or NULL if absent or deleted */
+const crdt_entry_t *crdt_get(const crdt_map_t *m, const char *key);
+
+/* Merge a remote register.  Returns 1 if it changed the map, 0 if it
+ * was not newer, -1 if it is malformed or the map is full. */
+int  crdt_merge(crdt_map_t *m, const crdt_entry_t *e);
+
+/* Move up to max changed entries' slot indices into out, oldest first */
+int  crdt_take_dirty(crdt_map_t *m, uint32_t *out, int max);
+
+/* Entry in slot i (0 .. mask), or NULL if empty */
+const crdt_entry_t *crdt_slot(const crdt_map_t *m, uint32_t i);
+
+/* Bucket of a key (see CRDT_BUCKETS) */
+int  crdt_bucket(const char *key);
+
+/* Wire form of one entry, {"k":..,"v":..,"t":..,"w":..,"d":..};
+ * returns the length written, or -1 if it does not fit */
+int  crdt_encode(const crdt_entry_t *e, char *buf, size_t size);
+
+/* Parse one encoded entry at p.  Returns the position after it, or NULL
+ * if there is none / it is malformed. */
+const char *crdt_decode(const char *p, crdt_entry_t *out);
+
+/* Digests as CRDT_BUCKETS * 16 hex digits, and back */
+void crdt_digest_hex(const crdt_map_t *m, char *out, size_t size);
+int  crdt_digest_parse(const char *hex, uint64_t *buckets);
+
+#endif
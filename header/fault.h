@@ -0,0 +1,92 @@
+#ifndef FAULT_H
+#define FAULT_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Transport fault injection, applied by the sender thread to every
+ * outgoing datagram.  Configured with a spec string of ';'-separated
+ * items:
+ *
+ *   loss=0.05,delay=20,jitter=10          global rule
+ *   6001-6009:loss=0.5,dist=exp            rule for destination ports
+ *   partition=6000-6009,at=5,heal=15       partition with scheduled heal
+ *
+ * Rule keys (times in ms):
+ *   loss     drop probability
+ *   delay    fixed one-way delay
+ *   jitter   extra random delay: uniform in [0, jitter], or exponential
+ *            with mean jitter when dist=exp
+ *   dup      probability of sending a second copy (delayed independently)
+ *   reorder  probability of holding a datagram back by `hold` ms
+ *            (default 10) so later ones overtake it
+ *
+ * A destination rule inherits whatever it does not set from the global
+ * rule.  A partition splits ports into the given range and everything
+ * else; from `at` to `heal` seconds after start (heal=0: never) datagrams
+ * crossing the split are dropped.  Both sides must run the same spec. */
+
+#define FAULT_MAX_RULES      16
+#define FAULT_MAX_PARTITIONS 4
+#define FAULT_MAX_HELD       4096   /* delayed datagrams in flight */
+
+typedef enum { FAULT_DIST_UNIFORM, FAULT_DIST_EXP } fault_dist_t;
+
+typedef struct {
+    int    port_lo, port_hi;   /* 0 = global */
+    double loss, dup, reorder; /* < 0 = unset (inherit) */
+    double delay_ms, jitter_ms, hold_ms;
+    int    dist;               /* fault_dist_t, -1 = unset */
+} fault_rule_t;
+
+typedef struct {
+    int      port_lo, port_hi;
+    uint64_t at_us, heal_us;   /* relative to start; heal 0 = never */
+} fault_partition_t;
+
+typedef struct {
+    uint64_t sent;          /* datagrams handed to the socket */
+    uint64_t lost;          /* dropped by a loss rule */
+    uint64_t partitioned;   /* dropped by an active partition */
+    uint64_t duplicated;
+    uint64_t delayed;
+    uint64_t reordered;
+    uint64_t overflow;      /* dropped because FAULT_MAX_HELD was reached */
+} fault_stats_t;
+
+typedef struct fault_held fault_held_t;
+
+typedef struct {
+    fault_rule_t      rules[FAULT_MAX_RULES];
+    int               nrules;
+    fault_partition_t parts[FAULT_MAX_PARTITIONS];
+    int               nparts;
+    int               self_port;
+    uint64_t          start_us;
+    uint64_t          rng;
+
+    fault_held_t     *held;    /* min-heap by due time */
+    int               nheld;
+    uint64_t          held_seq;
+
+    fault_stats_t     stats;
+} fault_t;
+
+/* Parse spec for the node on self_port.  Returns NULL (after printing
+ * why) if the spec is malformed. */
+fault_t *fault_open(const char *spec, int self_port, unsigned seed);
+void     fault_close(fault_t *f);
+
+/* Send one datagram through the fault rules (sender thread only) */
+void     fault_send(fault_t *f, int fd, const char *data, int len,
+                    const struct sockaddr_in *to);
+
+/* Send held datagrams that are due.  Returns microseconds until the
+ * next one is, or UINT64_MAX if none are held. */
+uint64_t fault_flush(fault_t *f, int fd);
+
+/* One-line summary of the stats */
+int      fault_format(const fault_t *f, char *buf, size_t size);
+
+#endif
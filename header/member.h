@@ -10,6 +10,9 @@
 typedef struct {
     struct sockaddr_in addr;
     uint64_t last_seen;
+    uint32_t caps;        /* CAP_* bits the peer advertised (0 = unknown) */
+    uint64_t topic_mask;  /* bloom of subscribed topics, see topic_bits() */
+    int      topics_known;/* 0 until the peer advertised a topic_mask    */
 } peer_info_t;
 
 typedef struct {
@@ -23,5 +26,20 @@ void membership_init(membership_t *m, int limit);
 int membership_add(membership_t *m, struct sockaddr_in addr);
 int membership_get_random(membership_t *m, struct sockaddr_in *targets, int count,
                           struct sockaddr_in *exclude);
+/* Topic interest.  Peers advertise a 64-bit bloom of their subscribed
+ * topics; a peer that has not advertised yet counts as interested. */
+uint64_t topic_bits(const char *topic);
+void membership_set_topics(membership_t *m, struct sockaddr_in addr,
+                           uint64_t topic_mask);
+/* 1 interested, 0 not interested, -1 not a member */
+int  membership_is_interested(membership_t *m, struct sockaddr_in *addr,
+                              uint64_t bits);
+/* Like membership_get_random, keeping only peers whose interest in
+ * `bits` equals `interested`. */
+int  membership_get_random_filtered(membership_t *m, struct sockaddr_in *targets,
+                                    int count, struct sockaddr_in *exclude,
+                                    uint64_t bits, int interested);
+void membership_set_caps(membership_t *m, struct sockaddr_in addr, uint32_t caps);
+uint32_t membership_get_caps(membership_t *m, struct sockaddr_in *addr);
 
 #endif
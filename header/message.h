@@ -8,13 +8,39 @@
 #define ADDR_STR_LEN 64
 #define MSG_TYPE_LEN 32
 #define MSG_BUF_SIZE 8192
+#define TOPIC_LEN 64
+#define DEPS_LEN 1024
 
 /* Wire buffer must be large enough for a fully serialized gossip_msg_t.
-   With MSG_BUF_SIZE=8192 and all other fixed fields, ~9 KB is safe. */
+   With MSG_BUF_SIZE=8192, DEPS_LEN=1024 and all other fixed fields,
+   ~9.5 KB is safe. */
 #define MAX_SERIALIZED_LEN 10240
 
+/* Message types.  The wire carries the type name; it is mapped to a
+ * small integer once at parse time and dispatched through a table.
+ * Built-ins have fixed IDs, further types are added at run time with
+ * msg_type_register() (before any node starts running). */
+enum {
+    MSG_HELLO = 0,
+    MSG_GET_PEERS,
+    MSG_PEERS_LIST,
+    MSG_GOSSIP,
+    MSG_PING,
+    MSG_PONG,
+    MSG_IHAVE,
+    MSG_IWANT,
+    MSG_DIGEST,
+    MSG_STATE,
+    MSG_STATE_DIGEST,
+    MSG_BUILTIN_COUNT
+};
+
+#define MAX_MSG_TYPES 32
+#define MSG_UNKNOWN   (-1)
+
 typedef struct {
     int version;
+    int type;                  /* MSG_* id of msg_type, or MSG_UNKNOWN */
 
     char msg_id[ID_LEN];
     char msg_type[MSG_TYPE_LEN];
@@ -26,7 +52,28 @@ typedef struct {
 
     int ttl;
 
+    /* Optional header fields (omitted on the wire when empty) */
+    char topic[TOPIC_LEN];     /* GOSSIP topic, parsed once for filtering */
+    int      origin_ttl;       /* ttl at the origin, 0 = not traced */
+    uint64_t origin_us;        /* origin wall clock (wall_time_us) */
+    char deps[DEPS_LEN];       /* causal deps "<origin>:<seq> ..." (order.h) */
+
     char payload[MSG_BUF_SIZE];
 } gossip_msg_t;
 
+/* Type registry.  msg_type_register() returns the existing ID if the
+ * name is already known under the same tclass, and -1 if it is known
+ * under another one or the table is full.  tclass is the traffic_class_t
+ * the type is queued under (see queue.h).  Registering is thread-safe
+ * and may race with lookups on running nodes. */
+int         msg_type_register(const char *name, int tclass);
+int         msg_type_lookup(const char *name);     /* MSG_UNKNOWN if absent */
+const char *msg_type_name(int type);
+int         msg_type_class(int type);
+int         msg_type_count(void);
+
+/* 1 if topic fits in TOPIC_LEN and has no '"', '\\' or control
+ * characters (it is written into the envelope unescaped) */
+int         msg_topic_valid(const char *topic);
+
 #endif
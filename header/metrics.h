@@ -0,0 +1,117 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "message.h"
+
+/* Metrics registry: per-type counters, log-linear histograms and gauges.
+ *
+ * Counters are sharded so threads rarely share a cache line: each thread
+ * is given a shard on first use and adds to it with relaxed atomics;
+ * readers sum the shards.  Histograms use HDR-style buckets (16 linear
+ * sub-buckets per power of two, <= 6.25% relative error) updated with
+ * relaxed atomics.  Nothing here takes a lock. */
+
+#define METRICS_SHARDS    8
+#define METRICS_TYPE_SLOTS (MAX_MSG_TYPES + 1)   /* last slot = unknown type */
+
+typedef enum {
+    M_SENT,          /* datagrams queued for sending */
+    M_RECEIVED,      /* datagrams dispatched to a handler */
+    M_DUPLICATE,     /* GOSSIP already seen (before or after parsing) */
+    M_RX_DROPPED,    /* shed by the ingress queue, or of unknown type */
+    M_TX_DROPPED,    /* egress queue full, or shed for a higher class */
+    M_SENT_BYTES,    /* bytes of the datagrams counted by M_SENT */
+    M_RECEIVED_BYTES,/* bytes read off the socket, dropped or not */
+    M_GAP_REQUESTED, /* sequence gaps asked for with IWANT */
+    M_GAP_ABANDONED, /* sequence gaps given up on after GAP_MAX_TRIES */
+    M_STATE_MERGED,  /* remote state entries that changed the local map */
+    NUM_COUNTERS
+} metric_counter_t;
+
+/* Histograms whose name ends in "_us" hold microseconds; the rest hold
+ * plain counts. */
+typedef enum {
+    H_RELAY_US,      /* GOSSIP receive (queued) -> relayed */
+    H_PING_RTT_US,   /* PING sent -> matching PONG handled */
+    H_E2E_US,        /* traced GOSSIP: origin publish -> first receipt */
+    H_HOP_US,        /* H_E2E_US divided by the hop count */
+    H_HOPS,          /* traced GOSSIP: relays from the origin */
+    NUM_HISTOGRAMS
+} metric_hist_t;
+
+typedef enum {
+    G_PEERS,         /* membership size */
+    G_SEEN_IDS,      /* seen-set occupancy */
+    G_STORED,        /* IWANT store occupancy */
+    G_ORIGINS,       /* origins with a sequence watermark */
+    G_RX_QUEUE,      /* ingress queue depth */
+    G_TX_QUEUE,      /* egress queue depth */
+    G_STATE_KEYS,    /* replicated state keys, tombstones included */
+    G_CLUSTER_SIZE,  /* aggregation's cluster-size estimate, 0 = none yet */
+    NUM_GAUGES
+} metric_gauge_t;
+
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1 << HIST_SUB_BITS)
+#define HIST_MAX_EXP   39                      /* values up to ~2^40 */
+#define HIST_BUCKETS   ((HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB)
+
+typedef struct {
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} histogram_t;
+
+typedef struct {
+    uint64_t c[NUM_COUNTERS][METRICS_TYPE_SLOTS];
+} __attribute__((aligned(64))) metrics_shard_t;
+
+typedef struct {
+    metrics_shard_t *shards;        /* METRICS_SHARDS entries */
+    histogram_t     *hist;          /* NUM_HISTOGRAMS entries */
+    int64_t          gauges[NUM_GAUGES];
+    uint64_t         start_ms;
+} metrics_t;
+
+/* Summary of one histogram, values in the histogram's unit */
+typedef struct {
+    uint64_t count, sum, max;
+    uint64_t p50, p90, p99, p999;
+} hist_summary_t;
+
+int  metrics_init(metrics_t *m);
+void metrics_free(metrics_t *m);
+
+/* type is a MSG_* id; anything out of range counts as unknown */
+void     metrics_count(metrics_t *m, metric_counter_t c, int type);
+void     metrics_add(metrics_t *m, metric_counter_t c, int type, uint64_t n);
+uint64_t metrics_counter(const metrics_t *m, metric_counter_t c, int type);
+uint64_t metrics_counter_total(const metrics_t *m, metric_counter_t c);
+
+void     metrics_observe(metrics_t *m, metric_hist_t h, uint64_t value);
+void     metrics_hist_summary(const metrics_t *m, metric_hist_t h,
+                              hist_summary_t *out);
+/* Observations <= v.  Exact when v + 1 is a power of two (bucket
+ * boundaries line up there), otherwise rounded down to a bucket edge. */
+uint64_t metrics_hist_count_le(const metrics_t *m, metric_hist_t h,
+                               uint64_t v);
+
+void     metrics_gauge_set(metrics_t *m, metric_gauge_t g, int64_t v);
+int64_t  metrics_gauge(const metrics_t *m, metric_gauge_t g);
+
+const char *metrics_counter_name(metric_counter_t c);
+const char *metrics_hist_name(metric_hist_t h);
+const char *metrics_gauge_name(metric_gauge_t g);
+/* msg_type_name(), or "UNKNOWN" for the overflow slot */
+const char *metrics_type_name(int slot);
+
+#define METRICS_TEXT_SIZE 16384   /* comfortably fits metrics_format() */
+
+/* Plain-text dump, one metric per line.  Returns bytes written
+ * (truncated to size - 1). */
+int  metrics_format(const metrics_t *m, char *buf, size_t size);
+
+#endif
@@ -8,18 +8,137 @@
 #include "member.h"
 #include "message.h"
 #include "serialization.h"
+#include "compress.h"
+#include "queue.h"
+#include "pacer.h"
+#include "seen.h"
+#include "watermark.h"
+#include "order.h"
+#include "crdt.h"
+#include "aggregate.h"
+#include "store.h"
+#include "control.h"
+#include "metrics.h"
+#include "prom.h"
+#include "fault.h"
 
 #define MAX_SEEN_MSGS 2000
 
-/* Store full gossip messages so we can respond to IWANT */
-#define MAX_STORED_GOSSIP 500
+/* Ingress load shedding: once the receive queue is this full (percent),
+ * IHAVE and DIGEST are dropped before they are queued. */
+#define RX_SHED_WATERMARK 75
+
+typedef struct node node_t;
+
+/* Handler for one message type; see node_register_handler() */
+typedef void (*msg_handler_fn)(node_t *node, gossip_msg_t *msg,
+                               struct sockaddr_in *sender);
+
+/* Application delivery callback.  `payload` is the decompressed payload;
+ * called from the dispatcher thread without node->lock held. */
+typedef void (*gossip_deliver_fn)(node_t *node, const gossip_msg_t *msg,
+                                  const char *payload, void *ctx);
+
+#define MAX_SUBSCRIPTIONS 16
+#define TOPIC_WILDCARD    "*"
+
+/* Per-topic eager-push mesh: a stable set of up to `fanout` peers that
+ * advertised interest in the topic.  Other peers get lazy IHAVEs. */
+#define MAX_MESH_TOPICS 16
+
+typedef struct {
+    char               topic[TOPIC_LEN];
+    struct sockaddr_in peers[MAX_PEERS];
+    int                count;
+    uint64_t           last_used;
+} topic_mesh_t;
+
+typedef struct {
+    char              topic[TOPIC_LEN];   /* exact topic or TOPIC_WILDCARD */
+    gossip_deliver_fn fn;
+    void             *ctx;
+} subscription_t;
+
+/* Polled delivery: subscriptions made with node_subscribe_poll() copy
+ * each message into a bounded queue that node_poll() drains, so the
+ * application never runs code on the dispatcher thread. */
+#define DELIVERY_QUEUE_DEPTH 256
 
 typedef struct {
-    char msg_id[ID_LEN];
-    char serialized[MAX_SERIALIZED_LEN];   /* full wire-format for IWANT replies */
-} stored_gossip_t;
+    char     msg_id[ID_LEN];
+    char     topic[TOPIC_LEN];
+    char     sender_addr[ADDR_STR_LEN];   /* originating node */
+    uint64_t timestamp_ms;                /* origin publish time */
+    char     payload[MSG_BUF_SIZE];       /* decompressed */
+} gossip_delivery_t;
 
 typedef struct {
+    gossip_delivery_t *items;
+    int head;
+    int count;
+    int closed;
+    uint64_t dropped;         /* deliveries lost to a full queue */
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+} delivery_queue_t;
+
+/* Notifications that used to be printed by the node itself */
+typedef enum {
+    NODE_EVENT_PEER_JOINED,    /* detail: "ip:port" of a HELLO sender   */
+    NODE_EVENT_PEER_REMOVED,   /* detail: "ip:port" that timed out      */
+    NODE_EVENT_POW_REJECTED,   /* detail: "ip:port" with a bad PoW      */
+    NODE_EVENT_RX_STATS,       /* detail: shed / duplicate summary line */
+    NODE_EVENT_AGGREGATE       /* detail: an aggregation epoch's results */
+} node_event_t;
+
+typedef void (*node_event_fn)(node_t *node, node_event_t event,
+                              const char *detail, void *ctx);
+
+/* Replicated state change made by a peer (value NULL = deleted); called
+ * from the dispatcher thread without node->lock held */
+typedef void (*node_state_fn)(node_t *node, const char *key,
+                              const char *value, void *ctx);
+
+/* Everything node_init_config() needs.  Start from node_config_defaults()
+ * and override what you need. */
+typedef struct {
+    int port;                /* UDP listen port (required) */
+    int fanout;
+    int ttl;
+    int peer_limit;
+    int ping_interval;       /* seconds */
+    int peer_timeout;        /* seconds */
+    unsigned int seed;
+    int pull_interval;       /* seconds, 0 = no pull rounds */
+    int max_ihave_ids;
+    int pull_ids;            /* pull rounds advertise recent ids (IHAVE)
+                                instead of a version vector (DIGEST) */
+    int pow_difficulty;      /* 0 = disabled */
+    int compress_codec;      /* CODEC_* for originated payloads */
+    double rate_limit;       /* global pkts/s, 0 = unpaced */
+    double peer_rate;        /* per-peer pkts/s, 0 = unpaced */
+    int rx_queue_depth;      /* ingress datagrams */
+    int tx_queue_depth;      /* egress datagrams */
+    int store_capacity;      /* messages kept for IWANT */
+    const char *log_path;    /* NULL = node_<port>.log, "" = no event log */
+    const char *control_path;   /* Unix control socket, NULL = none */
+    int metrics_interval;       /* seconds between metric dumps, 0 = off */
+    const char *metrics_path;   /* NULL = node_<port>.metrics */
+    int metrics_http_port;      /* Prometheus endpoint on 127.0.0.1, 0 = off */
+    int trace_origin;           /* stamp published GOSSIP for latency/hops */
+    const char *fault_spec;     /* outgoing fault injection (fault.h), NULL = off */
+    int gap_repair_ms;          /* wait before pulling a sequence gap, 0 = off */
+    int delivery_order;         /* order_mode_t for subscribers (order.h) */
+    int order_buffer;           /* out-of-order messages held, 0 = default */
+    int order_hold_ms;          /* longest a message waits, 0 = default */
+    int state_flush_ms;         /* replicated state: delta batching window */
+    int state_sync_ms;          /* replicated state: digest exchange period,
+                                   0 = no anti-entropy */
+    int agg_epoch_rounds;       /* PING rounds per aggregation epoch,
+                                   0 = no aggregation */
+} node_config_t;
+
+struct node {
     char node_id[NODE_ID_LEN];      /* UUID string */
     char self_addr[ADDR_STR_LEN];   /* "127.0.0.1:8000" */
 
@@ -33,46 +152,135 @@ typedef struct {
     int sockfd;
 
     /* Hybrid Push-Pull parameters */
-    int pull_interval;   /* seconds between IHAVE broadcasts (0 = disabled) */
+    int pull_interval;   /* seconds between pull rounds (0 = disabled) */
     int max_ihave_ids;   /* max IDs per IHAVE message */
+    int pull_ids;        /* see node_config_t */
+    uint32_t digest_cursor;   /* first wm slot of the next DIGEST (pull thread) */
 
     /* Proof-of-Work */
     int pow_difficulty;  /* number of leading zero hex chars required (0 = disabled) */
 
+    /* Stamp originated GOSSIP with origin_ttl/origin_us for tracing */
+    int trace_origin;
+
+    /* Payload compression (applied once at the origin) */
+    int compress_codec;  /* CODEC_* used for messages we originate */
+
     membership_t membership;
 
-    char seen_ids[MAX_SEEN_MSGS][ID_LEN];
-    int seen_count;
+    /* Dedup state.  Changes hold lock and then seen_lock, so the listener
+     * probes under seen_lock alone without waiting on the dispatcher,
+     * and everyone else reads under lock. */
+    seen_set_t seen;     /* recently seen msg_ids (hashed ring) */
+    watermark_table_t wm;   /* per-origin seqs of originated GOSSIP */
+    pthread_mutex_t seen_lock;
+    int gap_repair_ms;      /* see node_config_t */
+    uint64_t next_gap_scan_us;   /* dispatcher only */
+    order_buffer_t order;   /* ordered delivery (guarded by lock; only
+                               the dispatcher adds or releases) */
+    uint64_t next_order_scan_us; /* dispatcher only */
+
+    /* Replicated key/value state (see crdt.h, guarded by lock) */
+    crdt_map_t    state;
+    int           state_flush_ms;
+    int           state_sync_ms;
+    uint64_t      next_state_flush_us;   /* dispatcher only */
+    uint64_t      next_state_sync_us;    /* dispatcher only */
+    uint32_t      state_cursor;   /* next slot a digest reply sends
+                                     (dispatcher only) */
+    node_state_fn state_fn;
+    void         *state_ctx;
+
+    /* Push-sum aggregation on PINGs (see aggregate.h, guarded by lock) */
+    agg_state_t   agg;
+    int           agg_on;
 
-    /* Full-message store for IWANT */
-    stored_gossip_t gossip_store[MAX_STORED_GOSSIP];
-    int gossip_store_count;
+    /* Application subscriptions (guarded by lock) */
+    subscription_t subs[MAX_SUBSCRIPTIONS];
+    int sub_count;
+    int store_unsubscribed;   /* keep topics we don't deliver for IWANT */
+    uint64_t publish_seq;   /* msg_id suffix of our last publish */
+    topic_mesh_t meshes[MAX_MESH_TOPICS];
+    int mesh_count;
+
+    gossip_store_t store;   /* full messages for IWANT (guarded by lock) */
+
+    /* Per-class ingress/egress queues (see queue.h) */
+    packet_queue_t rx_queue;   /* listener -> dispatcher */
+    packet_queue_t tx_queue;   /* send_msg -> sender     */
+    uint64_t dispatch_queued_us;   /* enqueue time of the packet being
+                                      dispatched (dispatcher only) */
+
+    /* Dispatch table, indexed by MSG_* type id */
+    msg_handler_fn handlers[MAX_MSG_TYPES];
+
+    /* Outbound rate limiting (pacer.global_rate / pacer.peer_rate) */
+    pacer_t pacer;
+    fault_t *fault;   /* injected transport faults, sender thread only */
 
     pthread_mutex_t lock;
     pthread_t listener_thread;
+    pthread_t dispatch_thread;
+    pthread_t sender_thread;
     pthread_t ping_thread;
     pthread_t pull_thread;   /* Hybrid Pull thread */
 
-    FILE *log_file;
-    uint64_t sent_messages;
+    /* Application notifications and polled delivery */
+    node_event_fn     event_fn;
+    void             *event_ctx;
+    delivery_queue_t *deliveries;   /* allocated by node_subscribe_poll() */
+    control_t        *control;      /* local control socket, if enabled */
+
+    /* Counters, histograms and gauges (see metrics.h) */
+    metrics_t metrics;
+    int       metrics_interval;   /* seconds between dumps, 0 = off */
+    char      metrics_path[128];
+    pthread_t metrics_thread;
+    prom_t   *prom;               /* HTTP exporter, if enabled */
 
-} node_t;
+    FILE *log_file;      /* NULL when the event log is disabled */
+
+};
 
 /* Core Node Functions */
+void node_config_defaults(node_config_t *cfg);
+int  node_init_config(node_t *node, const node_config_t *cfg);
 int node_init(node_t *node,
               int port, int fanout,
               int ttl, int peer_limit, int ping_interval, int peer_timeout,
               unsigned int seed, int pull_interval, int max_ihave_ids,
               int pow_difficulty);
-void node_run(node_t *node);
+void node_run(node_t *node);      /* starts the node's threads and returns */
 void node_bootstrap(node_t *node, const char *boot_ip, int boot_port);
-void node_cleanup(node_t *node);
+void node_stop(node_t *node);     /* ask threads to exit; wakes node_poll() */
+void node_cleanup(node_t *node);  /* stop, join threads and free everything */
+/* Free a node that node_init_config() set up but node_run() never
+ * started (node_cleanup() would join threads that do not exist) */
+void node_destroy(node_t *node);
+
+/* Receive notifications (peer joins, timeouts, ...).  Call before node_run.
+ * fn runs on the dispatcher (PEER_JOINED, POW_REJECTED, AGGREGATE), the
+ * ping thread (PEER_REMOVED, AGGREGATE), or the caller of node_cleanup()
+ * (RX_STATS).  No node lock is held, so it may call node_publish(),
+ * node_state_set() or the membership functions; it must not call
+ * node_cleanup(), and that thread's own work waits while it runs. */
+void node_set_event_handler(node_t *node, node_event_fn fn, void *ctx);
+
+/* Register (or replace) the handler for a message type, adding the type
+ * to the registry if it is new.  Call before node_run().  A known type
+ * keeps its traffic class, so tclass must match it.  Returns the type
+ * id, or -1 if the type table is full or tclass does not match. */
+int  node_register_handler(node_t *node, const char *type_name,
+                           msg_handler_fn fn, traffic_class_t tclass);
 uint64_t current_time_ms();
 
 /* Internal Thread Logic */
 void* listener_thread_func(void* arg);
+void* dispatch_thread_func(void* arg);
+void* sender_thread_func(void* arg);
 void* ping_thread_func(void* arg);
 void* pull_thread_func(void* arg);
+void* metrics_thread_func(void* arg);
 
 /* Message Handlers */
 void handle_hello(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
@@ -83,6 +291,10 @@ void handle_ping(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
 void handle_pong(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
 void handle_ihave(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
 void handle_iwant(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
+void handle_digest(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
+void handle_state(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender);
+void handle_state_digest(node_t *node, gossip_msg_t *msg,
+                         struct sockaddr_in *sender);
 
 /* Helpers */
 void relay_gossip(node_t *node, gossip_msg_t *msg, struct sockaddr_in *exclude);
@@ -94,6 +306,64 @@ void log_event(node_t *node, const char *event, const char *msg_type,
 int  node_build_hello_payload(node_t *node, char *payload_buf, size_t buf_size);
 int  node_verify_hello_pow(node_t *node, gossip_msg_t *msg);
 
+/* Application API.  Several callbacks may subscribe to the same topic;
+ * subscribing the same (topic, fn) again only updates ctx.  Unsubscribe
+ * drops every callback on topic; node_unsubscribe_fn only the one made
+ * with (topic, fn, ctx), leaving other callers' subscriptions alone. */
+int  node_subscribe(node_t *node, const char *topic,
+                    gossip_deliver_fn fn, void *ctx);
+int  node_unsubscribe(node_t *node, const char *topic);
+int  node_unsubscribe_fn(node_t *node, const char *topic,
+                         gossip_deliver_fn fn, void *ctx);
+/* Bloom of our subscribed topics as advertised to peers (~0 for "*") */
+uint64_t node_topic_mask(node_t *node);
+/* 1 if a subscription covers topic (an empty topic always matches) */
+int  node_wants_topic(node_t *node, const char *topic);
+/* Originate a GOSSIP on `topic` carrying `data` (a string).  Fills
+ * msg_id_out (>= ID_LEN bytes) if non-NULL.  Returns 0 on success. */
+int  node_publish(node_t *node, const char *topic, const char *data,
+                  char *msg_id_out);
+/* Highest seq from origin (a node_id) below which nothing is missing */
+uint64_t node_origin_watermark(node_t *node, const char *origin);
+
+/* Replicated key/value state.  Writes are batched for state_flush_ms,
+ * then pushed to `fanout` peers, and every node forwards what changed
+ * its own map the same way; digests every state_sync_ms repair the
+ * rest.  set/delete return -1 for an over-long key or value (see
+ * crdt.h) or a full map; get returns -1 if key is absent or deleted. */
+int  node_state_set(node_t *node, const char *key, const char *value);
+int  node_state_delete(node_t *node, const char *key);
+int  node_state_get(node_t *node, const char *key, char *value, size_t size);
+/* Be told about changes made by peers.  Call before node_run. */
+void node_state_watch(node_t *node, node_state_fn fn, void *ctx);
+
+/* Cluster-wide aggregates.  node_agg_set contributes our value to name
+ * (see aggregate.h for valid names); the getters report the last
+ * completed epoch and return -1 before there is one or with
+ * aggregation off. */
+int  node_agg_set(node_t *node, const char *name, double value);
+int  node_agg_get(node_t *node, const char *name, agg_result_t *out);
+/* Copy up to max aggregate names (ours and those heard from peers)
+ * into names; returns how many */
+int  node_agg_names(node_t *node, char (*names)[AGG_NAME_LEN], int max);
+int  node_cluster_size(node_t *node, double *size);
+
+/* Subscribe to topic with polled delivery (see gossip_delivery_t) */
+int  node_subscribe_poll(node_t *node, const char *topic);
+/* Copy up to max queued deliveries into out, waiting up to timeout_ms
+ * (0 = don't wait) for the first one.  Returns the number copied, 0 on
+ * timeout, or -1 once the node is stopped and the queue is drained. */
+int  node_poll(node_t *node, gossip_delivery_t *out, int max, int timeout_ms);
+
+/* Refresh the gauges in node->metrics from current node state */
+void node_metrics_sample(node_t *node);
+/* Sample gauges and write the metrics text dump into buf */
+int  node_metrics_text(node_t *node, char *buf, size_t size);
+
+/* Compression: compress an originated GOSSIP payload in place with
+ * node->compress_codec (no-op if disabled or not worthwhile). */
+void node_compress_payload(node_t *node, gossip_msg_t *msg);
+
 /* Seen-set (lock must be held by caller) */
 void mark_seen_public(node_t *node, const char *msg_id);
 
@@ -0,0 +1,96 @@
+#ifndef ORDER_H
+#define ORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "message.h"
+#include "watermark.h"
+
+/* Ordered delivery of sequenced GOSSIP (ids "<origin>_<seq>").
+ *
+ * FIFO: a message is released once every earlier seq of its origin is
+ * accounted for in the watermark table, i.e. delivered, or given up on
+ * by gap repair, the window or a topic skip.  Arrivals that can't go
+ * yet are copied into a bounded buffer.
+ *
+ * CAUSAL: additionally, a published message lists in `deps` the latest
+ * seq per origin its publisher delivered since its previous publish;
+ * it is released only once each of those is settled here too.  FIFO on
+ * the publisher makes the older dependencies transitive.
+ *
+ * Nothing waits forever: a message held for hold_ms, or the oldest one
+ * when the buffer is full, is released anyway and earlier seqs of its
+ * origin that turn up later are not delivered ("late").
+ *
+ * Only the lowest held seq of each origin can be next, so a release
+ * checks one entry per origin, and after each message it lets go only
+ * re-checks that origin's next seq and (CAUSAL) the entries that were
+ * waiting for it.
+ *
+ * Not thread-safe: callers serialize access (node->lock). */
+
+typedef enum {
+    ORDER_ARRIVAL = 0,   /* deliver as received (default) */
+    ORDER_FIFO,
+    ORDER_CAUSAL
+} order_mode_t;
+
+#define ORDER_DEFAULT_CAPACITY 256
+#define ORDER_DEFAULT_HOLD_MS  2000
+
+/* A buffered message.  Each origin's entries form a list sorted by seq,
+ * whose first entry (the origin's "head") the watermark table points at
+ * (origin_state_t.held); all entries also form a list in arrival order. */
+typedef struct {
+    char          origin[NODE_ID_LEN];
+    uint64_t      seq;
+    uint64_t      held_us;
+    gossip_msg_t *msg;
+    int           next;           /* next seq of the origin (or free list) */
+    int           older, newer;   /* arrival order, -1 = none */
+    int           head_pos;       /* index in heads[], -1 if not a head */
+    int           queued;         /* in ready[] during order_release */
+    char          wait[NODE_ID_LEN];   /* CAUSAL: origin of the dependency */
+    uint64_t      wait_seq;            /* that held it last, "" = none */
+} order_held_t;
+
+typedef struct {
+    int           mode;       /* order_mode_t */
+    int           capacity;   /* messages buffered at most */
+    uint64_t      hold_us;
+    order_held_t *held;       /* capacity + 1 entries */
+    int           free;       /* first unused entry, -1 = none */
+    int           oldest;     /* arrival order ends, -1 = empty */
+    int           newest;
+    int          *heads;      /* entries that are their origin's lowest */
+    int           nheads;
+    int          *ready;      /* order_release() scratch */
+    int           count;
+
+    uint64_t      buffered;   /* arrivals that had to wait */
+    uint64_t      forced;     /* released on timeout / overflow */
+    uint64_t      late;       /* arrived after a later seq was forced out */
+} order_buffer_t;
+
+int  order_init(order_buffer_t *b, int mode, int capacity, int hold_ms);
+void order_free(order_buffer_t *b);
+
+/* "fifo" / "causal" / "arrival", -1 if unknown */
+int  order_mode_from_name(const char *name);
+
+/* A new GOSSIP (already recorded in wm) bound for the application.
+ * Returns 1 if it may be delivered now, 0 if it was buffered, -1 if it
+ * must be dropped (late).  Unsequenced ids always return 1. */
+int  order_offer(order_buffer_t *b, watermark_table_t *wm,
+                 const gossip_msg_t *msg, uint64_t now_us);
+
+/* Remove up to max buffered messages that are now deliverable (or due
+ * to be forced), in delivery order.  The caller frees each out[i]. */
+int  order_release(order_buffer_t *b, watermark_table_t *wm,
+                   uint64_t now_us, gossip_msg_t **out, int max);
+
+/* Fill deps for a message we originate (CAUSAL only; "" otherwise) */
+void order_deps(order_buffer_t *b, watermark_table_t *wm, const char *self,
+                char *out, size_t size);
+
+#endif
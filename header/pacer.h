@@ -0,0 +1,72 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/* Outbound pacing: a global token bucket plus one bucket per destination,
+ * both scaled by an AIMD factor driven by observed loss.
+ *
+ * Loss signals, sampled once per ping interval:
+ *   - PINGs that got no PONG back
+ *   - message IDs peers asked us to resend by id (IWANT after an IHAVE
+ *     or a gap repair; ranges a DIGEST asks for are catch-up, not loss)
+ * A loss ratio above PACER_LOSS_THRESHOLD halves the sending rate,
+ * otherwise it grows additively back towards the configured maximum. */
+
+#define PACER_MAX_PEERS       128
+#define PACER_LOSS_THRESHOLD  0.05
+#define PACER_MIN_SCALE       0.05   /* never drop below 5% of the limit */
+#define PACER_ADD_STEP        0.05   /* additive increase per interval   */
+#define PACER_BURST_SECS      0.05   /* bucket depth = 50 ms of traffic  */
+
+typedef struct {
+    double   tokens;
+    uint64_t last_us;
+} token_bucket_t;
+
+typedef struct {
+    struct sockaddr_in addr;
+    token_bucket_t     tb;
+    uint64_t           last_used_us;
+} peer_bucket_t;
+
+typedef struct {
+    double global_rate;   /* packets/s, 0 = unlimited */
+    double peer_rate;     /* packets/s per destination, 0 = unlimited */
+    double scale;         /* AIMD multiplier in [PACER_MIN_SCALE, 1] */
+
+    token_bucket_t global;
+    peer_bucket_t  peers[PACER_MAX_PEERS];
+    int            npeers;
+
+    /* Loss accounting for the current window (updated lock-free) */
+    uint64_t pings_sent;
+    uint64_t pongs_recv;
+    uint64_t resend_ids;
+    uint64_t packets_sent;
+
+    pthread_mutex_t lock;
+} pacer_t;
+
+void pacer_init(pacer_t *p, double global_rate, double peer_rate);
+void pacer_destroy(pacer_t *p);
+int  pacer_enabled(pacer_t *p);
+
+/* Microseconds to wait before a packet to dest may go out (0 = now).
+ * *peer_limited is set when only the per-destination bucket is short.
+ * Call pacer_consume() once the packet is actually sent. */
+uint64_t pacer_delay_us(pacer_t *p, const struct sockaddr_in *dest,
+                        int *peer_limited);
+void     pacer_consume(pacer_t *p, const struct sockaddr_in *dest);
+
+/* Loss signals */
+void pacer_note_ping(pacer_t *p);
+void pacer_note_pong(pacer_t *p);
+void pacer_note_resend(pacer_t *p, int ids);
+
+/* Close the current window and apply AIMD.  Returns the new scale. */
+double pacer_adjust(pacer_t *p);
+
+#endif
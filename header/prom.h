@@ -0,0 +1,39 @@
+#ifndef PROM_H
+#define PROM_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Prometheus exporter: a minimal HTTP/1.0 listener on 127.0.0.1 that
+ * answers GET /metrics with the node's metrics in the text exposition
+ * format.  It runs on its own thread and only reads the lock-free
+ * metrics registry (plus brief gauge sampling), so scrapes never wait
+ * on the gossip threads for long. */
+
+#define PROM_TEXT_SIZE   65536
+#define PROM_TIMEOUT_MS  1000   /* per-connection read/write timeout */
+
+/* Exported histogram buckets: le = 2^k - 1 microseconds */
+#define PROM_HIST_MIN_EXP 4
+#define PROM_HIST_MAX_EXP 26    /* ~67 s */
+
+typedef struct node node_t;
+
+typedef struct prom {
+    node_t   *node;
+    int       listen_fd;
+    int       port;
+    pthread_t thread;
+    int       started;
+} prom_t;
+
+/* Bind 127.0.0.1:port.  Returns NULL on failure. */
+prom_t *prom_open(node_t *node, int port);
+int     prom_start(prom_t *p);
+/* Join the thread (it exits once node->running drops) and free */
+void    prom_close(prom_t *p);
+
+/* Render the exposition text; returns bytes written */
+int     prom_format(node_t *node, char *buf, size_t size);
+
+#endif
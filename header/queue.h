@@ -0,0 +1,88 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "message.h"
+
+/* Traffic classes, in strict priority order.
+ * CONTROL – membership / failure detection (HELLO, GET_PEERS, PEERS_LIST,
+ *           PING, PONG).  Always served first so PONGs are never stuck
+ *           behind a GOSSIP burst.
+ * PULL    – lazy repair (IHAVE, IWANT, DIGEST).
+ * DATA    – GOSSIP payloads.
+ * PULL and DATA share the remaining capacity by weighted round-robin. */
+typedef enum {
+    CLASS_CONTROL = 0,
+    CLASS_PULL    = 1,
+    CLASS_DATA    = 2,
+    NUM_CLASSES
+} traffic_class_t;
+
+#define QUEUE_DEFAULT_DEPTH 128   /* packets across all classes */
+#define WRR_DATA_WEIGHT     4
+#define WRR_PULL_WEIGHT     1
+
+typedef struct {
+    struct sockaddr_in addr;   /* source (ingress) or destination (egress) */
+    int  len;
+    int  tag;                  /* caller-defined, reported on eviction */
+    uint64_t queued_us;        /* current_time_us() at enqueue */
+    char data[MAX_SERIALIZED_LEN];
+} packet_t;
+
+/* FIFO of pool slot indices for one class */
+typedef struct {
+    int *idx;                  /* limit entries, used as a ring */
+    int head;
+    int count;
+} packet_ring_t;
+
+typedef struct {
+    packet_t *pool;            /* limit packets shared by all classes */
+    int *free_slots;           /* stack of unused pool indices */
+    int nfree;
+    packet_ring_t ring[NUM_CLASSES];
+    int credit[NUM_CLASSES];   /* remaining WRR credit this round */
+    int limit;                 /* total packets across all classes */
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t  nonempty;
+} packet_queue_t;
+
+/* Class a message type (MSG_* id) is queued under */
+traffic_class_t msg_class(int type);
+
+int  pqueue_init(packet_queue_t *q, int depth);
+void pqueue_destroy(packet_queue_t *q);
+
+/* Enqueue a copy of data[0..len), tagged for a later eviction report.
+ * Returns 0, or -1 if the queue is full or closed. */
+int  pqueue_push(packet_queue_t *q, traffic_class_t cls,
+                 const char *data, int len, const struct sockaddr_in *addr,
+                 int tag);
+
+/* Like pqueue_push, but when the queue is full make room by evicting the
+ * oldest packet of a class that sheds before `cls` (PULL, then DATA;
+ * CONTROL is never evicted).  On eviction *evicted_tag receives the
+ * victim's tag, otherwise -1.  Returns -1 if the new packet itself had
+ * to be dropped. */
+int  pqueue_push_shed(packet_queue_t *q, traffic_class_t cls,
+                      const char *data, int len,
+                      const struct sockaddr_in *addr, int tag,
+                      int *evicted_tag);
+
+/* Dequeue the next packet by priority.  Waits up to timeout_ms.
+ * Returns the packet's class, or -1 on timeout / closed-and-drained. */
+int  pqueue_pop(packet_queue_t *q, packet_t *out, int timeout_ms);
+
+/* Packets currently queued across all classes */
+int  pqueue_pending(packet_queue_t *q);
+int  pqueue_limit(packet_queue_t *q);
+
+/* Wake all waiters; pops keep draining what is left, pushes fail. */
+void pqueue_close(packet_queue_t *q);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SEEN_H
+#define SEEN_H
+
+#include <stdint.h>
+#include "message.h"
+
+/* Bounded set of recently seen message IDs.
+ *
+ * IDs live in a ring in insertion order (so IHAVE can advertise the most
+ * recent ones) and are indexed by an open-addressing hash table, making
+ * lookups O(1) instead of a scan over the whole ring.  When the ring wraps
+ * the oldest ID is evicted from the index as well.
+ *
+ * Not thread-safe: callers serialize access (see node_t.seen_lock). */
+typedef struct {
+    char     (*ids)[ID_LEN];   /* ring of IDs, oldest overwritten first */
+    uint32_t *hashes;          /* hash of each ring slot */
+    int32_t  *index;           /* hash table of ring slots, -1 = empty */
+    int       capacity;        /* ring slots */
+    uint32_t  index_mask;      /* hash table size - 1 (power of two) */
+    uint64_t  count;           /* IDs ever inserted */
+} seen_set_t;
+
+int  seen_init(seen_set_t *s, int capacity);
+void seen_free(seen_set_t *s);
+
+uint32_t seen_hash(const char *id);
+
+/* 1 if present, 0 otherwise */
+int  seen_contains(const seen_set_t *s, const char *id);
+
+/* Insert id.  Returns 1 if it was already present, 0 if newly added. */
+int  seen_insert(seen_set_t *s, const char *id);
+
+/* Number of IDs currently held */
+int  seen_size(const seen_set_t *s);
+
+/* i-th most recent ID (0 = newest), or NULL if i >= seen_size() */
+const char *seen_recent(const seen_set_t *s, int i);
+
+#endif
@@ -7,4 +7,18 @@ typedef unsigned long size_t;
 int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size);
 int deserialize_message(const char *buffer, gossip_msg_t *msg);
 
+/* Cheap peek at a string field (e.g. "msg_type", "msg_id") of a raw
+ * datagram without a full parse.
+ * Returns 0 on success, -1 if the field is missing or too long. */
+int wire_peek_field(const char *buffer, const char *field,
+                    char *out, size_t out_size);
+
+/* Fast path for datagrams produced by serialize_message(): msg_id and
+ * msg_type sit at fixed positions right after "version", so read them
+ * with a single forward scan.  Returns -1 if the layout differs (use
+ * wire_peek_field() then). */
+int wire_peek_header(const char *buffer,
+                     char *id_out, size_t id_size,
+                     char *type_out, size_t type_size);
+
 #endif
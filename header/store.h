@@ -0,0 +1,45 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include "message.h"
+
+/* Full-message store for IWANT replies.
+ *
+ * The last `capacity` GOSSIP messages are kept in a ring in insertion
+ * order, already serialized so a reply is a single copy.  The ring is
+ * heap-allocated; each slot is about MAX_SERIALIZED_LEN bytes.
+ *
+ * Not thread-safe: callers serialize access (node->lock). */
+
+#define MAX_STORED_GOSSIP 500
+
+typedef struct {
+    char msg_id[ID_LEN];
+    int  codec;                            /* CODEC_* of the stored payload */
+    char topic[TOPIC_LEN];                 /* advertised next to the ID in IHAVE */
+    char serialized[MAX_SERIALIZED_LEN];   /* full wire-format for IWANT replies */
+} stored_gossip_t;
+
+typedef struct {
+    stored_gossip_t *items;
+    int              capacity;
+    uint64_t         count;     /* messages ever stored */
+} gossip_store_t;
+
+int  store_init(gossip_store_t *s, int capacity);
+void store_free(gossip_store_t *s);
+
+/* Serialize msg into the next slot, overwriting the oldest when full */
+void store_put(gossip_store_t *s, const gossip_msg_t *msg);
+
+/* Stored message with this ID, or NULL */
+stored_gossip_t *store_find(gossip_store_t *s, const char *msg_id);
+
+/* Number of messages currently held */
+int  store_size(const gossip_store_t *s);
+
+/* i-th most recent message (0 = newest), or NULL if i >= store_size() */
+stored_gossip_t *store_recent(gossip_store_t *s, int i);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Hot-path trace points, compiled in only with `make TRACE=1`
+ * (-DGOSSIP_TRACE).  Without it every macro below expands to nothing.
+ *
+ *     TRACE_BEGIN(t);
+ *     deserialize_message(...);
+ *     TRACE_END(t, TP_DESERIALIZE);
+ *
+ * Spans are timed with the TSC (rdtsc; CLOCK_MONOTONIC elsewhere) and
+ * appended to a ring owned by the calling thread, so recording takes no
+ * lock.  trace_dump() writes every thread's ring as Chrome trace JSON,
+ * loadable in chrome://tracing or ui.perfetto.dev. */
+
+typedef enum {
+    TP_PEEK,          /* listener: header peek */
+    TP_RX_DEDUP,      /* listener: seen check before queueing */
+    TP_DESERIALIZE,   /* dispatcher: deserialize_message */
+    TP_HANDLE,        /* dispatcher: whole handler */
+    TP_DEDUP,         /* handle_gossip: seen-set insert */
+    TP_STORE,         /* handle_gossip: store for IWANT */
+    TP_RELAY,         /* relay_gossip */
+    TP_SERIALIZE,     /* send_msg: serialize_message */
+    TP_SEND,          /* sender: sendto */
+    NUM_TRACE_POINTS
+} trace_point_t;
+
+#define TRACE_RING_SIZE 65536   /* spans kept per thread (power of two) */
+
+#ifdef GOSSIP_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t trace_ticks(void) { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t trace_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+void trace_record(trace_point_t tp, uint64_t start, uint64_t end);
+void trace_thread_name(const char *name);
+int  trace_dump(const char *path);
+
+#define TRACE_BEGIN(var)        uint64_t var = trace_ticks()
+#define TRACE_END(var, tp)      trace_record((tp), (var), trace_ticks())
+#define TRACE_THREAD(name)      trace_thread_name(name)
+#define TRACE_DUMP(path)        trace_dump(path)
+
+#else
+
+#define TRACE_BEGIN(var)        do { } while (0)
+#define TRACE_END(var, tp)      do { } while (0)
+#define TRACE_THREAD(name)      do { } while (0)
+#define TRACE_DUMP(path)        do { } while (0)
+
+#endif
+
+#endif
@@ -1,9 +1,16 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 uint64_t current_time_ms();
+uint64_t current_time_us(void);   /* monotonic, for pacing/latency */
+uint64_t wall_time_us(void);      /* wall clock, comparable across nodes */
+void     sleep_us(uint64_t us);
+
+/* SHA-256 of len bytes at data */
+void     sha256(const void *data, size_t len, uint8_t digest[32]);
 
 /* Proof-of-Work helpers.
  * Compute SHA-256( node_id || nonce_str ) and check that the hex digest
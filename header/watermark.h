@@ -0,0 +1,96 @@
+#ifndef WATERMARK_H
+#define WATERMARK_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "message.h"
+
+/* Per-origin delivery watermarks.
+ *
+ * Originated GOSSIP carry ids of the form "<node_id>_<seq>", seq counting
+ * up from 1 per origin.  For each origin we keep the highest seq below
+ * which nothing is missing (the watermark) and a bitmap of what arrived
+ * in the WM_WINDOW seqs above it.  That replaces one seen-set entry per
+ * message with a fixed ~100 bytes per origin, and makes a hole visible
+ * as soon as a later seq arrives.
+ *
+ * A seq more than WM_WINDOW past the watermark forces it forward; the
+ * seqs it jumps over are given up ("skipped").  An origin first heard
+ * of mid-stream starts WM_JOIN_SLACK below the seq it was heard at, so
+ * slightly reordered predecessors are still accepted, but history before
+ * that is never repaired.
+ *
+ * Not thread-safe: callers serialize access (see node_t.seen_lock). */
+
+#define WM_WINDOW      128      /* seqs tracked above the watermark */
+#define WM_JOIN_SLACK  16
+#define WM_MAX_ORIGINS 65536    /* beyond this, ids fall back to the seen-set */
+
+typedef struct {
+    char     origin[NODE_ID_LEN];   /* "" = empty slot */
+    uint64_t contiguous;   /* every seq <= this is accounted for */
+    uint64_t max_seq;      /* highest seq received */
+    uint64_t repair_from;  /* lowest seq worth asking for */
+    uint64_t above[WM_WINDOW / 64];   /* bit i: seq contiguous + 1 + i */
+    struct sockaddr_in relayer;   /* who sent the newest seq */
+    uint64_t gap_since_us;   /* hole first noticed, 0 = none */
+    uint64_t next_repair_us;
+    int      repair_tries;
+    uint64_t repair_upto;    /* max_seq when the current attempts began */
+    uint64_t delivered;      /* ordered delivery: last seq released (order.h) */
+    uint64_t dep_sent;       /* delivered as of our last causal publish */
+    int      held;           /* ordered delivery: 1 + order buffer entry
+                                of the lowest held seq, 0 = none */
+} origin_state_t;
+
+typedef struct {
+    origin_state_t *slots;     /* open addressing, never shrinks */
+    uint32_t        mask;      /* capacity - 1 (power of two) */
+    int             count;
+    int             open_gaps; /* origins with max_seq > contiguous */
+    uint64_t        skipped;   /* seqs given up on */
+} watermark_table_t;
+
+int  wm_init(watermark_table_t *t);
+void wm_free(watermark_table_t *t);
+
+/* Split "<origin>_<seq>".  Returns 0 on success. */
+int  wm_parse_id(const char *msg_id, char *origin, size_t size, uint64_t *seq);
+
+/* State of origin, or NULL if untracked */
+origin_state_t *wm_find(const watermark_table_t *t, const char *origin);
+
+/* 1 if seq from origin was received (or given up on), 0 if not,
+ * -1 if the origin is not tracked */
+int  wm_contains(const watermark_table_t *t, const char *origin, uint64_t seq);
+
+/* Record seq from origin, relayed by `from` (may be NULL).  Returns 1 if
+ * it was already accounted for, 0 if new, -1 if the table is full. */
+int  wm_insert(watermark_table_t *t, const char *origin, uint64_t seq,
+               const struct sockaddr_in *from, uint64_t now_us);
+
+/* Stop waiting for seq (known to exist but not wanted).  Starts
+ * tracking origin if needed. */
+void wm_skip(watermark_table_t *t, const char *origin, uint64_t seq,
+             uint64_t now_us);
+
+/* Watermark of origin, 0 if unknown */
+uint64_t wm_watermark(const watermark_table_t *t, const char *origin);
+
+/* Missing seqs between the watermark and max_seq, oldest first */
+int  wm_missing(const origin_state_t *o, uint64_t *out, int max);
+
+/* Seqs up to peer_max (a peer's max_seq for origin) that we lack, as
+ * inclusive [lo, hi] ranges within the window.  An untracked origin
+ * gets its last WM_JOIN_SLACK + 1 seqs.  Returns the number of ranges. */
+int  wm_missing_ranges(const watermark_table_t *t, const char *origin,
+                       uint64_t peer_max, uint64_t (*ranges)[2], int max);
+
+/* Give up on every missing seq <= upto; returns how many */
+int  wm_abandon(watermark_table_t *t, origin_state_t *o, uint64_t upto);
+
+/* Slot i (0 .. mask), or NULL if empty */
+origin_state_t *wm_slot(watermark_table_t *t, uint32_t i);
+
+#endif
@@ -0,0 +1,213 @@
+#include "aggregate.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* =========================================================
+ * Helpers
+ * ========================================================= */
+
+static uint64_t next_token(agg_state_t *a) {
+    /* xorshift64* */
+    a->rng ^= a->rng >> 12;
+    a->rng ^= a->rng << 25;
+    a->rng ^= a->rng >> 27;
+    uint64_t t = a->rng * 0x2545f4914f6cdd1dull;
+    return t ? t : 1;
+}
+
+static int valid_name(const char *name) {
+    size_t n = 0;
+    for (const char *p = name; *p; p++, n++)
+        if ((unsigned char)*p < 0x20 || *p == ':' || *p == '"' || *p == '\\')
+            return 0;
+    return n > 0 && n < AGG_NAME_LEN;
+}
+
+static agg_value_t *find(agg_state_t *a, const char *name) {
+    for (int i = 0; i < a->count; i++)
+        if (strcmp(a->vals[i].name, name) == 0) return &a->vals[i];
+    return NULL;
+}
+
+static agg_value_t *find_or_add(agg_state_t *a, const char *name) {
+    agg_value_t *v = find(a, name);
+    if (v) return v;
+    if (a->count == AGG_MAX || !valid_name(name)) return NULL;
+    agg_result_t *r = &a->results[a->count];
+    r->n = r->sum = 0;   /* nobody contributed as of the last epoch */
+    r->avg = NAN;
+    r->max = -HUGE_VAL;
+    v = &a->vals[a->count++];
+    memset(v, 0, sizeof(*v));
+    strcpy(v->name, name);
+    v->max = -HUGE_VAL;
+    return v;
+}
+
+/* =========================================================
+ * Epochs
+ * ========================================================= */
+
+/* Record the estimates of the epoch we are leaving.  A node no leader
+ * mass reached has nothing to divide by and keeps its old results. */
+static void finish_epoch(agg_state_t *a) {
+    if (a->leader <= 0) return;
+    a->have_result  = 1;
+    a->result_epoch = a->epoch;
+    a->result_size  = a->weight / a->leader;
+    for (int i = 0; i < a->count; i++) {
+        const agg_value_t *v = &a->vals[i];
+        agg_result_t *r = &a->results[i];
+        r->n   = v->w / a->leader;
+        r->sum = v->s / a->leader;
+        r->avg = (v->w > 0) ? v->s / v->w : NAN;
+        r->max = v->max;
+    }
+}
+
+/* Join instance (epoch, token) with fresh mass */
+static void start_epoch(agg_state_t *a, uint64_t epoch, uint64_t token,
+                        int leader) {
+    a->epoch  = epoch;
+    a->token  = token;
+    a->rounds = 0;
+    a->weight = 1;
+    a->leader = leader ? 1 : 0;
+    for (int i = 0; i < a->count; i++) {
+        agg_value_t *v = &a->vals[i];
+        v->s   = v->has_local ? v->local : 0;
+        v->w   = v->has_local ? 1 : 0;
+        v->max = v->has_local ? v->local : -HUGE_VAL;
+    }
+}
+
+void agg_init(agg_state_t *a, int epoch_rounds, const char *self_id) {
+    memset(a, 0, sizeof(*a));
+    a->epoch_rounds = (epoch_rounds > 0) ? epoch_rounds : 1;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const char *p = self_id; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ull;
+    }
+    a->rng = h ? h : 1;
+    start_epoch(a, 1, next_token(a), 1);
+}
+
+int agg_set(agg_state_t *a, const char *name, double value) {
+    agg_value_t *v = find_or_add(a, name);
+    if (!v) return -1;
+    /* Adjust the running epoch by the difference; its totals stay exact */
+    if (v->has_local) {
+        v->s += value - v->local;
+    } else {
+        v->s += value;
+        v->w += 1;
+    }
+    if (value > v->max) v->max = value;
+    v->has_local = 1;
+    v->local     = value;
+    return 0;
+}
+
+int agg_round(agg_state_t *a) {
+    if (++a->rounds < a->epoch_rounds) return 0;
+    finish_epoch(a);
+    start_epoch(a, a->epoch + 1, next_token(a), 1);
+    return 1;
+}
+
+/* =========================================================
+ * Shares
+ * ========================================================= */
+
+int agg_share(agg_state_t *a, int parts, char *buf, size_t size) {
+    if (parts < 2) return -1;
+    double f = 1.0 / parts;
+
+    int n = snprintf(buf, size,
+                     "\"agg_epoch\": \"%llu:%016llx:%.17g:%.17g\", \"agg\": [",
+                     (unsigned long long)a->epoch,
+                     (unsigned long long)a->token,
+                     a->weight * f, a->leader * f);
+    for (int i = 0; i < a->count && n >= 0 && (size_t)n < size; i++) {
+        const agg_value_t *v = &a->vals[i];
+        n += snprintf(buf + n, size - (size_t)n, "%s\"%s:%.17g:%.17g:%.17g\"",
+                      i ? ", " : "", v->name, v->s * f, v->w * f, v->max);
+    }
+    if (n < 0 || (size_t)n + 2 > size) return -1;   /* keep all the mass */
+    strcpy(buf + n, "]");
+
+    a->weight *= f;
+    a->leader *= f;
+    for (int i = 0; i < a->count; i++) {
+        a->vals[i].s *= f;
+        a->vals[i].w *= f;
+    }
+    return 0;
+}
+
+int agg_merge(agg_state_t *a, const char *payload) {
+    static const char ekey[] = "\"agg_epoch\": \"";
+    const char *p = strstr(payload, ekey);
+    if (!p) return -1;
+
+    unsigned long long epoch, token;
+    double weight, leader;
+    if (sscanf(p + sizeof(ekey) - 1, "%llu:%llx:%lf:%lf",
+               &epoch, &token, &weight, &leader) != 4)
+        return -1;
+
+    if (epoch < a->epoch || (epoch == a->epoch && token < a->token))
+        return 0;   /* a dead instance: its mass no longer counts */
+    if (epoch > a->epoch || token > a->token) {
+        if (epoch > a->epoch) finish_epoch(a);
+        start_epoch(a, epoch, token, 0);
+    }
+
+    a->weight += weight;
+    a->leader += leader;
+
+    p = strstr(p, "\"agg\": [");
+    if (!p) return 1;
+    p += 8;
+    for (;;) {
+        while (*p == ' ' || *p == ',') p++;
+        if (*p != '"') break;
+        char name[AGG_NAME_LEN];
+        double s, w, max;
+        int used = 0;
+        if (sscanf(p + 1, "%31[^:\"]:%lf:%lf:%lf\"%n",
+                   name, &s, &w, &max, &used) != 4 || used == 0)
+            break;
+        p += 1 + used;
+        agg_value_t *v = find_or_add(a, name);
+        if (!v) continue;
+        v->s += s;
+        v->w += w;
+        if (max > v->max) v->max = max;
+    }
+    return 1;
+}
+
+/* =========================================================
+ * Results
+ * ========================================================= */
+
+int agg_result(const agg_state_t *a, const char *name, agg_result_t *out) {
+    if (!a->have_result) return -1;
+    for (int i = 0; i < a->count; i++) {
+        if (strcmp(a->vals[i].name, name) != 0) continue;
+        *out = a->results[i];
+        return 0;
+    }
+    return -1;
+}
+
+int agg_cluster_size(const agg_state_t *a, double *size) {
+    if (!a->have_result) return -1;
+    *size = a->result_size;
+    return 0;
+}
@@ -0,0 +1,317 @@
+#include "compress.h"
+#include "message.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ============================================================
+ * Shared dictionary for CODEC_LZ_DICT (no external deps).
+ * Both ends prime the LZ window with these bytes, so short JSON
+ * payloads can reference common keys and punctuation.
+ * ============================================================ */
+
+static const char LZ_DICT[] =
+    "\"timestamp\": \"value\": \"count\": \"status\": \"id\": \"name\": "
+    "\"type\": true, false, null, \"key\": \"values\": [], {}, "
+    "{ \"topic\": \"news\", \"data\": \"";
+
+#define LZ_DICT_LEN     (sizeof(LZ_DICT) - 1)
+#define LZ_MIN_MATCH    4
+#define LZ_MAX_OFFSET   65535
+#define LZ_HASH_BITS    12
+#define LZ_HASH_SIZE    (1 << LZ_HASH_BITS)
+/* Window: dictionary plus at most one payload, kept on the stack */
+#define LZ_WINDOW_SIZE  (LZ_DICT_LEN + MSG_BUF_SIZE)
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Write an LZ4-style extended length (runs of 255 + remainder) */
+static int put_len(uint8_t **op, const uint8_t *oend, size_t len) {
+    while (len >= 255) {
+        if (*op >= oend) return -1;
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    if (*op >= oend) return -1;
+    *(*op)++ = (uint8_t)len;
+    return 0;
+}
+
+static int emit_sequence(uint8_t **op, const uint8_t *oend,
+                         const uint8_t *lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+    if (*op >= oend) return -1;
+    uint8_t *token = (*op)++;
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+    *token = (uint8_t)(((lit_len < 15) ? lit_len : 15) << 4);
+    if (lit_len >= 15 && put_len(op, oend, lit_len - 15) != 0) return -1;
+    if ((size_t)(oend - *op) < lit_len) return -1;
+    memcpy(*op, lit, lit_len);
+    *op += lit_len;
+
+    if (!match_len) return 0;   /* final literal-only sequence */
+
+    if (oend - *op < 2) return -1;
+    *(*op)++ = (uint8_t)(offset & 0xff);
+    *(*op)++ = (uint8_t)(offset >> 8);
+    *token |= (uint8_t)((ml < 15) ? ml : 15);
+    if (ml >= 15 && put_len(op, oend, ml - 15) != 0) return -1;
+    return 0;
+}
+
+int lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                int use_dict) {
+    if (len > MSG_BUF_SIZE) return -1;
+    size_t dict_len = use_dict ? LZ_DICT_LEN : 0;
+    size_t total    = dict_len + len;
+    uint8_t buf[LZ_WINDOW_SIZE];
+    memcpy(buf, LZ_DICT, dict_len);
+    memcpy(buf + dict_len, src, len);
+
+    int table[LZ_HASH_SIZE];
+    for (int i = 0; i < LZ_HASH_SIZE; i++) table[i] = -1;
+    for (size_t i = 0; i + LZ_MIN_MATCH <= dict_len; i++)
+        table[lz_hash(read32(buf + i))] = (int)i;
+
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+    size_t ip = dict_len, anchor = dict_len;
+
+    while (ip + LZ_MIN_MATCH <= total) {
+        unsigned h = lz_hash(read32(buf + ip));
+        int ref = table[h];
+        table[h] = (int)ip;
+
+        if (ref < 0 || ip - (size_t)ref > LZ_MAX_OFFSET ||
+            read32(buf + ref) != read32(buf + ip)) {
+            ip++;
+            continue;
+        }
+
+        size_t mlen = LZ_MIN_MATCH;
+        while (ip + mlen < total && buf[ref + mlen] == buf[ip + mlen]) mlen++;
+
+        if (emit_sequence(&op, oend, buf + anchor, ip - anchor,
+                          ip - (size_t)ref, mlen) != 0)
+            return -1;
+        ip += mlen;
+        anchor = ip;
+    }
+
+    int rc = emit_sequence(&op, oend, buf + anchor, total - anchor, 0, 0);
+    return (rc == 0) ? (int)(op - dst) : -1;
+}
+
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                  int use_dict) {
+    size_t dict_len = use_dict ? LZ_DICT_LEN : 0;
+    uint8_t buf[LZ_WINDOW_SIZE];
+    if (cap > MSG_BUF_SIZE) cap = MSG_BUF_SIZE;
+    memcpy(buf, LZ_DICT, dict_len);
+
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = buf + dict_len, *oend = buf + dict_len + cap;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) return -1;
+        memcpy(op, ip, lit);
+        op += lit; ip += lit;
+
+        if (ip >= iend) break;   /* last sequence carries literals only */
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+
+        size_t mlen = (token & 15);
+        if (mlen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
+        }
+        mlen += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - buf)) return -1;
+        if ((size_t)(oend - op) < mlen) return -1;
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0; i < mlen; i++) op[i] = ref[i];  /* may overlap */
+        op += mlen;
+    }
+
+    size_t out_len = (size_t)(op - buf) - dict_len;
+    memcpy(dst, buf + dict_len, out_len);
+    return (int)out_len;
+}
+
+/* ============================================================
+ * Base64 (payload bytes must stay JSON-safe on the wire)
+ * ============================================================ */
+
+static const char B64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int b64_encode(const uint8_t *in, size_t len, char *out, size_t out_size) {
+    size_t need = ((len + 2) / 3) * 4 + 1;
+    if (need > out_size) return -1;
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)in[i + 1] << 8;
+        if (i + 2 < len) v |= in[i + 2];
+        out[o++] = B64[(v >> 18) & 63];
+        out[o++] = B64[(v >> 12) & 63];
+        out[o++] = (i + 1 < len) ? B64[(v >> 6) & 63] : '=';
+        out[o++] = (i + 2 < len) ? B64[v & 63] : '=';
+    }
+    out[o] = '\0';
+    return (int)o;
+}
+
+static int b64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/* Decode until the closing '"' (or NUL).  Returns byte count or -1. */
+static int b64_decode(const char *in, uint8_t *out, size_t out_size) {
+    size_t o = 0;
+    uint32_t acc = 0;
+    int bits = 0;
+    for (; *in && *in != '"'; in++) {
+        if (*in == '=') break;
+        int v = b64_value(*in);
+        if (v < 0) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (o >= out_size) return -1;
+            out[o++] = (uint8_t)(acc >> bits);
+        }
+    }
+    return (int)o;
+}
+
+/* ============================================================
+ * Payload wrapper
+ * ============================================================ */
+
+int codec_from_name(const char *name) {
+    if (strcmp(name, "none")    == 0) return CODEC_NONE;
+    if (strcmp(name, "lz")      == 0) return CODEC_LZ;
+    if (strcmp(name, "lz-dict") == 0) return CODEC_LZ_DICT;
+    return -1;
+}
+
+const char *codec_name(int codec) {
+    switch (codec) {
+        case CODEC_LZ:      return "lz";
+        case CODEC_LZ_DICT: return "lz-dict";
+        default:            return "none";
+    }
+}
+
+int payload_compress(int codec, const char *payload, char *out, size_t out_size) {
+    if (codec != CODEC_LZ && codec != CODEC_LZ_DICT) return -1;
+
+    size_t len = strlen(payload);
+    if (len < COMPRESS_MIN_LEN) return -1;
+
+    uint8_t block[MSG_BUF_SIZE];
+    int clen = lz_compress((const uint8_t *)payload, len, block, sizeof(block),
+                           codec == CODEC_LZ_DICT);
+    if (clen < 0) return -1;
+
+    char b64[MSG_BUF_SIZE];
+    if (b64_encode(block, (size_t)clen, b64, sizeof(b64)) < 0) return -1;
+
+    int n = snprintf(out, out_size,
+                     "{\"codec\":\"%s\",\"len\":%zu,\"b64\":\"%s\"}",
+                     codec_name(codec), len, b64);
+    if (n < 0 || (size_t)n >= out_size || (size_t)n >= len) return -1;
+    return 0;
+}
+
+int payload_codec(const char *payload) {
+    static const char prefix[] = "{\"codec\":\"";
+    if (strncmp(payload, prefix, sizeof(prefix) - 1) != 0) return CODEC_NONE;
+    const char *name = payload + sizeof(prefix) - 1;
+    if (strncmp(name, "lz-dict\"", 8) == 0) return CODEC_LZ_DICT;
+    if (strncmp(name, "lz\"", 3) == 0)      return CODEC_LZ;
+    return CODEC_NONE;
+}
+
+int payload_decompress(const char *payload, char *out, size_t out_size) {
+    int codec = payload_codec(payload);
+    if (codec == CODEC_NONE) return 0;
+
+    const char *p = strstr(payload, "\"len\":");
+    if (!p) return -1;
+    unsigned long raw_len = strtoul(p + 6, NULL, 10);
+    if (raw_len >= out_size) return -1;
+
+    p = strstr(payload, "\"b64\":\"");
+    if (!p) return -1;
+
+    uint8_t block[MSG_BUF_SIZE];
+    int clen = b64_decode(p + 7, block, sizeof(block));
+    if (clen < 0) return -1;
+
+    int n = lz_decompress(block, (size_t)clen, (uint8_t *)out, out_size - 1,
+                          codec == CODEC_LZ_DICT);
+    if (n < 0 || (unsigned long)n != raw_len) return -1;
+    out[n] = '\0';
+    return 1;
+}
+
+uint32_t caps_parse(const char *payload) {
+    const char *p = strstr(payload, "\"capabilities\":");
+    if (!p) return 0;
+    p = strchr(p, '[');
+    if (!p) return 0;
+    const char *end = strchr(p, ']');
+    if (!end) return 0;
+
+    uint32_t caps = 0;
+    while ((p = strchr(p, '"')) && p < end) {
+        const char *q = strchr(p + 1, '"');
+        if (!q || q > end) break;
+        char name[32];
+        size_t n = (size_t)(q - p - 1);
+        if (n < sizeof(name)) {
+            memcpy(name, p + 1, n);
+            name[n] = '\0';
+            int codec = codec_from_name(name);
+            if (codec > CODEC_NONE) caps |= 1u << codec;
+        }
+        p = q + 1;
+    }
+    return caps;
+}
@@ -0,0 +1,442 @@
+#include "control.h"
+#include "node.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* =========================================================
+ * Frame encoding
+ * ========================================================= */
+
+int ctl_put_u16(unsigned char *buf, int off, int size, uint16_t v) {
+    if (off < 0 || off + 2 > size) return -1;
+    buf[off]     = (unsigned char)(v >> 8);
+    buf[off + 1] = (unsigned char)v;
+    return off + 2;
+}
+
+int ctl_put_str(unsigned char *buf, int off, int size,
+                const char *s, int len) {
+    if (len < 0 || len > 0xffff) return -1;
+    off = ctl_put_u16(buf, off, size, (uint16_t)len);
+    if (off < 0 || off + len > size) return -1;
+    memcpy(buf + off, s, (size_t)len);
+    return off + len;
+}
+
+int ctl_get_u16(const unsigned char *buf, int off, int len, uint16_t *v) {
+    if (off < 0 || off + 2 > len) return -1;
+    *v = (uint16_t)((buf[off] << 8) | buf[off + 1]);
+    return off + 2;
+}
+
+int ctl_get_str(const unsigned char *buf, int off, int len,
+                const char **s, int *slen) {
+    uint16_t n;
+    off = ctl_get_u16(buf, off, len, &n);
+    if (off < 0 || off + n > len) return -1;
+    *s    = (const char *)buf + off;
+    *slen = n;
+    return off + n;
+}
+
+/* Copy a frame string into a NUL-terminated buffer; -1 if too long */
+static int copy_str(char *dst, int size, const char *s, int len) {
+    if (len >= size) return -1;
+    memcpy(dst, s, (size_t)len);
+    dst[len] = '\0';
+    return 0;
+}
+
+/* =========================================================
+ * Replies and deliveries
+ * ========================================================= */
+
+static void send_frame(int fd, const unsigned char *buf, int len) {
+    if (send(fd, buf, (size_t)len, MSG_NOSIGNAL) < 0 && errno != EPIPE)
+        perror("control send");
+}
+
+static void send_error(int fd, const char *reason) {
+    unsigned char buf[256];
+    buf[0] = CTL_OP_ERROR;
+    int off = ctl_put_str(buf, 1, sizeof(buf), reason, (int)strlen(reason));
+    if (off > 0) send_frame(fd, buf, off);
+}
+
+static int client_wants(const ctl_client_t *cl, const char *topic) {
+    for (int i = 0; i < cl->topic_count; i++)
+        if (strcmp(cl->topics[i], TOPIC_WILDCARD) == 0 ||
+            strcmp(cl->topics[i], topic) == 0)
+            return 1;
+    return 0;
+}
+
+/* Clients subscribed to exactly topic (caller holds c->lock) */
+static int topic_users(const control_t *c, const char *topic) {
+    int n = 0;
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        const ctl_client_t *cl = &c->clients[i];
+        if (cl->fd < 0) continue;
+        for (int j = 0; j < cl->topic_count; j++)
+            if (strcmp(cl->topics[j], topic) == 0) n++;
+    }
+    return n;
+}
+
+static void drop_topic(ctl_client_t *cl, int at) {
+    if (at != --cl->topic_count)
+        strcpy(cl->topics[at], cl->topics[cl->topic_count]);
+}
+
+/* Subscription callback (dispatcher thread).  Never blocks: a client
+ * whose socket buffer is full misses the delivery. */
+static void control_deliver(node_t *node, const gossip_msg_t *msg,
+                            const char *payload, void *ctx) {
+    control_t *c = ctx;
+    unsigned char buf[MAX_SERIALIZED_LEN];
+    int len = 0;
+    (void)node;
+
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        ctl_client_t *cl = &c->clients[i];
+        if (cl->fd < 0 || !client_wants(cl, msg->topic)) continue;
+        if (len == 0) {
+            buf[0] = CTL_OP_DELIVER;
+            int off = 1;
+            off = ctl_put_str(buf, off, sizeof(buf),
+                              msg->msg_id, (int)strlen(msg->msg_id));
+            off = ctl_put_str(buf, off, sizeof(buf),
+                              msg->topic, (int)strlen(msg->topic));
+            off = ctl_put_str(buf, off, sizeof(buf),
+                              msg->sender_addr, (int)strlen(msg->sender_addr));
+            off = ctl_put_str(buf, off, sizeof(buf),
+                              payload, (int)strlen(payload));
+            if (off < 0) break;
+            len = off;
+        }
+        if (send(cl->fd, buf, (size_t)len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+            cl->dropped++;
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+/* =========================================================
+ * Request handling (control thread)
+ * ========================================================= */
+
+/* Publish the (topic, data) pair at frame[off]; appends the msg_id to
+ * the reply.  Returns the new request offset or -1. */
+static int publish_one(control_t *c, const unsigned char *frame, int off,
+                       int len, unsigned char *reply, int *roff) {
+    const char *s;
+    int slen;
+    char topic[TOPIC_LEN];
+    char data[MSG_BUF_SIZE];
+    char id[ID_LEN];
+
+    off = ctl_get_str(frame, off, len, &s, &slen);
+    if (off < 0 || copy_str(topic, sizeof(topic), s, slen) != 0) return -1;
+    off = ctl_get_str(frame, off, len, &s, &slen);
+    if (off < 0 || copy_str(data, sizeof(data), s, slen) != 0) return -1;
+
+    if (node_publish(c->node, topic, data, id) != 0) return -1;
+    int r = ctl_put_str(reply, *roff, CTL_MAX_FRAME, id, (int)strlen(id));
+    if (r < 0) return -1;
+    *roff = r;
+    return off;
+}
+
+static void handle_publish(control_t *c, int fd, int len, int batch) {
+    unsigned char *reply = malloc(CTL_MAX_FRAME);
+    if (!reply) { send_error(fd, "out of memory"); return; }
+
+    uint16_t want = 1;
+    int off = 1;
+    if (batch) {
+        off = ctl_get_u16(c->frame, off, len, &want);
+        if (off < 0 || want > CTL_MAX_BATCH) {
+            send_error(fd, "bad batch");
+            free(reply);
+            return;
+        }
+    }
+
+    int roff = 3;   /* op + u16 count, filled in below */
+    uint16_t done = 0;
+    while (done < want) {
+        off = publish_one(c, c->frame, off, len, reply, &roff);
+        if (off < 0) break;
+        done++;
+    }
+
+    if (done == 0 && want > 0) {
+        send_error(fd, "publish failed");
+    } else {
+        reply[0] = CTL_OP_OK;
+        ctl_put_u16(reply, 1, CTL_MAX_FRAME, done);
+        send_frame(fd, reply, roff);
+    }
+    free(reply);
+}
+
+static void handle_subscribe(control_t *c, ctl_client_t *cl, int len,
+                             int subscribe) {
+    const char *s;
+    int slen;
+    char topic[TOPIC_LEN];
+    if (ctl_get_str(c->frame, 1, len, &s, &slen) < 0 ||
+        copy_str(topic, sizeof(topic), s, slen) != 0 ||
+        !msg_topic_valid(topic)) {
+        send_error(cl->fd, "bad topic");
+        return;
+    }
+
+    /* The node holds one subscription per topic, shared by every client
+     * that wants it, and control_deliver() filters per client.  Only this
+     * thread changes client topics, so the count cannot move between
+     * taking it and calling into the node. */
+    int rc = 0, first = 0, last = 0;
+    pthread_mutex_lock(&c->lock);
+    int at = -1;
+    for (int i = 0; i < cl->topic_count; i++)
+        if (strcmp(cl->topics[i], topic) == 0) at = i;
+    if (subscribe && at < 0) {
+        if (cl->topic_count == CTL_CLIENT_TOPICS) {
+            rc = -1;
+        } else {
+            first = topic_users(c, topic) == 0;
+            strcpy(cl->topics[cl->topic_count++], topic);
+        }
+    } else if (!subscribe && at >= 0) {
+        drop_topic(cl, at);
+        last = topic_users(c, topic) == 0;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (first && node_subscribe(c->node, topic, control_deliver, c) != 0) {
+        pthread_mutex_lock(&c->lock);
+        drop_topic(cl, cl->topic_count - 1);
+        pthread_mutex_unlock(&c->lock);
+        rc = -1;
+    }
+    if (last) node_unsubscribe_fn(c->node, topic, control_deliver, c);
+
+    if (rc != 0) {
+        send_error(cl->fd, "too many subscriptions");
+    } else {
+        unsigned char ok[3] = { CTL_OP_OK, 0, 0 };
+        send_frame(cl->fd, ok, sizeof(ok));
+    }
+}
+
+static void handle_metrics(control_t *c, int fd) {
+    char *text = malloc(METRICS_TEXT_SIZE);
+    unsigned char *reply = malloc(METRICS_TEXT_SIZE + 8);
+    if (!text || !reply) {
+        send_error(fd, "out of memory");
+    } else {
+        int len = node_metrics_text(c->node, text, METRICS_TEXT_SIZE);
+        reply[0] = CTL_OP_OK;
+        int off = ctl_put_u16(reply, 1, METRICS_TEXT_SIZE + 8, 1);
+        off = ctl_put_str(reply, off, METRICS_TEXT_SIZE + 8, text, len);
+        send_frame(fd, reply, off);
+    }
+    free(text);
+    free(reply);
+}
+
+/* SET / DELETE / GET on the replicated state */
+static void handle_state_op(control_t *c, int fd, int len) {
+    const char *s;
+    int slen;
+    char key[CRDT_KEY_LEN];
+    char value[CRDT_VALUE_LEN];
+    int op = c->frame[0];
+
+    int off = ctl_get_str(c->frame, 1, len, &s, &slen);
+    if (off < 0 || copy_str(key, sizeof(key), s, slen) != 0) {
+        send_error(fd, "bad key");
+        return;
+    }
+
+    if (op == CTL_OP_GET) {
+        if (node_state_get(c->node, key, value, sizeof(value)) != 0) {
+            send_error(fd, "no such key");
+            return;
+        }
+        unsigned char reply[CRDT_VALUE_LEN + 8];
+        reply[0] = CTL_OP_OK;
+        int roff = ctl_put_u16(reply, 1, sizeof(reply), 1);
+        roff = ctl_put_str(reply, roff, sizeof(reply), value,
+                           (int)strlen(value));
+        send_frame(fd, reply, roff);
+        return;
+    }
+
+    int rc;
+    if (op == CTL_OP_SET) {
+        if (ctl_get_str(c->frame, off, len, &s, &slen) < 0 ||
+            copy_str(value, sizeof(value), s, slen) != 0) {
+            send_error(fd, "bad value");
+            return;
+        }
+        rc = node_state_set(c->node, key, value);
+    } else {
+        rc = node_state_delete(c->node, key);
+    }
+
+    if (rc != 0) {
+        send_error(fd, "state update failed");
+    } else {
+        unsigned char ok[3] = { CTL_OP_OK, 0, 0 };
+        send_frame(fd, ok, sizeof(ok));
+    }
+}
+
+static void handle_frame(control_t *c, ctl_client_t *cl, int len) {
+    switch (c->frame[0]) {
+        case CTL_OP_PUBLISH:     handle_publish(c, cl->fd, len, 0);   break;
+        case CTL_OP_BATCH:       handle_publish(c, cl->fd, len, 1);   break;
+        case CTL_OP_SUBSCRIBE:   handle_subscribe(c, cl, len, 1);     break;
+        case CTL_OP_UNSUBSCRIBE: handle_subscribe(c, cl, len, 0);     break;
+        case CTL_OP_METRICS:     handle_metrics(c, cl->fd);           break;
+        case CTL_OP_SET:
+        case CTL_OP_DELETE:
+        case CTL_OP_GET:         handle_state_op(c, cl->fd, len);     break;
+        default:                 send_error(cl->fd, "unknown op");    break;
+    }
+}
+
+/* Close cl and release the node subscriptions it was the last user of */
+static void drop_client(control_t *c, ctl_client_t *cl) {
+    char topics[CTL_CLIENT_TOPICS][TOPIC_LEN];
+    int n = 0;
+
+    pthread_mutex_lock(&c->lock);
+    int count = cl->topic_count;
+    memcpy(topics, cl->topics, sizeof(topics));
+    close(cl->fd);
+    memset(cl, 0, sizeof(*cl));
+    cl->fd = -1;
+    for (int i = 0; i < count; i++)
+        if (topic_users(c, topics[i]) == 0) strcpy(topics[n++], topics[i]);
+    pthread_mutex_unlock(&c->lock);
+
+    for (int i = 0; i < n; i++)
+        node_unsubscribe_fn(c->node, topics[i], control_deliver, c);
+}
+
+static void accept_client(control_t *c) {
+    int fd = accept(c->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        if (c->clients[i].fd < 0) {
+            memset(&c->clients[i], 0, sizeof(c->clients[i]));
+            c->clients[i].fd = fd;
+            fd = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (fd >= 0) {
+        send_error(fd, "too many clients");
+        close(fd);
+    }
+}
+
+static void *control_thread_func(void *arg) {
+    control_t *c = arg;
+    struct pollfd pfd[1 + CTL_MAX_CLIENTS];
+    int slot[1 + CTL_MAX_CLIENTS];
+
+    while (c->node->running) {
+        int n = 0;
+        pfd[n].fd = c->listen_fd;
+        pfd[n].events = POLLIN;
+        slot[n++] = -1;
+        /* Only this thread changes fds, so no lock is needed to read them */
+        for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+            if (c->clients[i].fd < 0) continue;
+            pfd[n].fd = c->clients[i].fd;
+            pfd[n].events = POLLIN;
+            slot[n++] = i;
+        }
+
+        /* Wake up every 500 ms so we notice node->running */
+        if (poll(pfd, (nfds_t)n, 500) <= 0) continue;
+
+        for (int k = 1; k < n; k++) {
+            if (!pfd[k].revents) continue;
+            ctl_client_t *cl = &c->clients[slot[k]];
+            ssize_t len = recv(cl->fd, c->frame, sizeof(c->frame), 0);
+            if (len <= 0) drop_client(c, cl);
+            else          handle_frame(c, cl, (int)len);
+        }
+        if (pfd[0].revents & POLLIN) accept_client(c);
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Lifecycle
+ * ========================================================= */
+
+control_t *control_open(node_t *node, const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "control socket path too long: %s\n", path);
+        return NULL;
+    }
+
+    control_t *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->node = node;
+    strcpy(c->path, path);
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) c->clients[i].fd = -1;
+
+    c->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (c->listen_fd < 0) { perror("control socket"); free(c); return NULL; }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(c->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(c->listen_fd, CTL_MAX_CLIENTS) < 0) {
+        perror("control bind");
+        close(c->listen_fd);
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+int control_start(control_t *c) {
+    if (pthread_create(&c->thread, NULL, control_thread_func, c) != 0)
+        return -1;
+    c->started = 1;
+    return 0;
+}
+
+void control_close(control_t *c) {
+    if (!c) return;
+    if (c->started) pthread_join(c->thread, NULL);
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++)
+        if (c->clients[i].fd >= 0) close(c->clients[i].fd);
+    close(c->listen_fd);
+    unlink(c->path);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
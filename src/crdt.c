@@ -0,0 +1,262 @@
+#include "crdt.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CRDT_INITIAL_CAP 64
+
+/* =========================================================
+ * Hashing
+ * ========================================================= */
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t key_hash(const char *key) {
+    return fnv64(0xcbf29ce484222325ull, key, strlen(key));
+}
+
+int crdt_bucket(const char *key) {
+    return (int)(key_hash(key) >> 58) & (CRDT_BUCKETS - 1);
+}
+
+/* A write is identified by (key, ts, writer, deleted) */
+static uint64_t entry_hash(const crdt_entry_t *e) {
+    uint64_t h = key_hash(e->key);
+    h = fnv64(h, &e->ts, sizeof(e->ts));
+    h = fnv64(h, e->writer, strlen(e->writer));
+    return fnv64(h, &e->deleted, sizeof(e->deleted));
+}
+
+/* =========================================================
+ * Table
+ * ========================================================= */
+
+int crdt_init(crdt_map_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->slots = calloc(CRDT_INITIAL_CAP, sizeof(crdt_entry_t));
+    m->dirty = calloc(CRDT_INITIAL_CAP, sizeof(uint32_t));
+    if (!m->slots || !m->dirty) {
+        crdt_free(m);
+        return -1;
+    }
+    m->mask = CRDT_INITIAL_CAP - 1;
+    return 0;
+}
+
+void crdt_free(crdt_map_t *m) {
+    free(m->slots);
+    free(m->dirty);
+    m->slots = NULL;
+    m->dirty = NULL;
+}
+
+static crdt_entry_t *find(const crdt_map_t *m, const char *key) {
+    uint32_t i = (uint32_t)key_hash(key) & m->mask;
+    for (;;) {
+        crdt_entry_t *e = &m->slots[i];
+        if (!e->key[0]) return NULL;
+        if (strcmp(e->key, key) == 0) return e;
+        i = (i + 1) & m->mask;
+    }
+}
+
+/* Rehash into twice the slots; the dirty list is rebuilt from the flags */
+static int grow(crdt_map_t *m) {
+    uint32_t cap = (m->mask + 1) * 2;
+    crdt_entry_t *slots = calloc(cap, sizeof(crdt_entry_t));
+    uint32_t *dirty = calloc(cap, sizeof(uint32_t));
+    if (!slots || !dirty) {
+        free(slots);
+        free(dirty);
+        return -1;
+    }
+    int nd = 0;
+    for (uint32_t j = 0; j <= m->mask; j++) {
+        crdt_entry_t *e = &m->slots[j];
+        if (!e->key[0]) continue;
+        uint32_t i = (uint32_t)key_hash(e->key) & (cap - 1);
+        while (slots[i].key[0]) i = (i + 1) & (cap - 1);
+        slots[i] = *e;
+        if (e->dirty) dirty[nd++] = i;
+    }
+    free(m->slots);
+    free(m->dirty);
+    m->slots  = slots;
+    m->dirty  = dirty;
+    m->ndirty = nd;
+    m->mask   = cap - 1;
+    return 0;
+}
+
+/* Install e over whatever key held, keeping the bucket digests and the
+ * dirty list up to date */
+static int put(crdt_map_t *m, const crdt_entry_t *e) {
+    crdt_entry_t *slot = find(m, e->key);
+    if (!slot) {
+        if (m->count >= CRDT_MAX_KEYS) return -1;
+        if ((uint32_t)(m->count + 1) * 2 > m->mask + 1 && grow(m) != 0)
+            return -1;
+        uint32_t i = (uint32_t)key_hash(e->key) & m->mask;
+        while (m->slots[i].key[0]) i = (i + 1) & m->mask;
+        slot = &m->slots[i];
+        memset(slot, 0, sizeof(*slot));
+        m->count++;
+    } else {
+        m->buckets[crdt_bucket(slot->key)] ^= entry_hash(slot);
+    }
+
+    int dirty = slot->dirty;
+    *slot = *e;
+    slot->dirty = 1;
+    if (!dirty) m->dirty[m->ndirty++] = (uint32_t)(slot - m->slots);
+    m->buckets[crdt_bucket(slot->key)] ^= entry_hash(slot);
+    if (e->ts > m->clock) m->clock = e->ts;
+    return 0;
+}
+
+static int printable(const char *s, size_t max) {
+    size_t n = 0;
+    for (; *s; s++, n++)
+        if ((unsigned char)*s < 0x20 || n + 1 >= max) return 0;
+    return 1;
+}
+
+int crdt_set(crdt_map_t *m, const char *writer, const char *key,
+             const char *value) {
+    if (!key[0] || !printable(key, CRDT_KEY_LEN) ||
+        (value && !printable(value, CRDT_VALUE_LEN)) ||
+        strlen(writer) >= NODE_ID_LEN)
+        return -1;
+
+    crdt_entry_t e;
+    memset(&e, 0, sizeof(e));
+    strcpy(e.key, key);
+    if (value) strcpy(e.value, value);
+    e.deleted = (value == NULL);
+    strcpy(e.writer, writer);
+    uint64_t now = wall_time_us() / 1000;
+    e.ts = (now > m->clock) ? now : m->clock + 1;
+    return put(m, &e);
+}
+
+const crdt_entry_t *crdt_get(const crdt_map_t *m, const char *key) {
+    const crdt_entry_t *e = find(m, key);
+    return (e && !e->deleted) ? e : NULL;
+}
+
+static int newer(const crdt_entry_t *a, const crdt_entry_t *b) {
+    return a->ts > b->ts || (a->ts == b->ts && strcmp(a->writer, b->writer) > 0);
+}
+
+int crdt_merge(crdt_map_t *m, const crdt_entry_t *e) {
+    if (!e->key[0] || !e->writer[0] || e->ts == 0 ||
+        !printable(e->key, CRDT_KEY_LEN) ||
+        !printable(e->value, CRDT_VALUE_LEN))
+        return -1;
+    const crdt_entry_t *cur = find(m, e->key);
+    if (cur && !newer(e, cur)) return 0;
+    return put(m, e) == 0 ? 1 : -1;
+}
+
+int crdt_take_dirty(crdt_map_t *m, uint32_t *out, int max) {
+    int n = (m->ndirty < max) ? m->ndirty : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = m->dirty[i];
+        m->slots[out[i]].dirty = 0;
+    }
+    m->ndirty -= n;
+    memmove(m->dirty, m->dirty + n, (size_t)m->ndirty * sizeof(uint32_t));
+    return n;
+}
+
+const crdt_entry_t *crdt_slot(const crdt_map_t *m, uint32_t i) {
+    return m->slots[i].key[0] ? &m->slots[i] : NULL;
+}
+
+/* =========================================================
+ * Wire form
+ * ========================================================= */
+
+/* Quote-and-backslash escaping; keys and values have no control chars */
+static size_t escape(const char *s, char *out, size_t size) {
+    size_t o = 0;
+    for (; *s && o + 2 < size; s++) {
+        if (*s == '"' || *s == '\\') out[o++] = '\\';
+        out[o++] = *s;
+    }
+    out[o] = '\0';
+    return o;
+}
+
+/* Read an escaped string body up to its closing quote */
+static const char *unescape(const char *p, char *out, size_t size) {
+    size_t o = 0;
+    while (*p && *p != '"') {
+        if (*p == '\\' && p[1]) p++;
+        if (o + 1 >= size) return NULL;
+        out[o++] = *p++;
+    }
+    out[o] = '\0';
+    return (*p == '"') ? p + 1 : NULL;
+}
+
+int crdt_encode(const crdt_entry_t *e, char *buf, size_t size) {
+    char k[CRDT_KEY_LEN * 2], v[CRDT_VALUE_LEN * 2];
+    escape(e->key, k, sizeof(k));
+    escape(e->value, v, sizeof(v));
+    int n = snprintf(buf, size,
+                     "{\"k\":\"%s\",\"v\":\"%s\",\"t\":%llu,\"w\":\"%s\",\"d\":%d}",
+                     k, v, (unsigned long long)e->ts, e->writer, e->deleted);
+    return (n < 0 || (size_t)n >= size) ? -1 : n;
+}
+
+const char *crdt_decode(const char *p, crdt_entry_t *out) {
+    while (*p == ' ' || *p == ',' || *p == '\n') p++;
+    if (strncmp(p, "{\"k\":\"", 6) != 0) return NULL;
+    memset(out, 0, sizeof(*out));
+    p = unescape(p + 6, out->key, sizeof(out->key));
+    if (!p || strncmp(p, ",\"v\":\"", 6) != 0) return NULL;
+    p = unescape(p + 6, out->value, sizeof(out->value));
+    if (!p) return NULL;
+
+    unsigned long long ts;
+    int n = 0;
+    if (sscanf(p, ",\"t\":%llu,\"w\":\"%63[^\"]\",\"d\":%d}%n",
+               &ts, out->writer, &out->deleted, &n) != 3 || n == 0)
+        return NULL;
+    out->ts = (uint64_t)ts;
+    out->deleted = (out->deleted != 0);
+    return p + n;
+}
+
+void crdt_digest_hex(const crdt_map_t *m, char *out, size_t size) {
+    size_t o = 0;
+    out[0] = '\0';
+    for (int i = 0; i < CRDT_BUCKETS && o + 17 <= size; i++)
+        o += (size_t)snprintf(out + o, size - o, "%016llx",
+                              (unsigned long long)m->buckets[i]);
+}
+
+int crdt_digest_parse(const char *hex, uint64_t *buckets) {
+    for (int i = 0; i < CRDT_BUCKETS; i++) {
+        uint64_t v = 0;
+        for (int j = 0; j < 16; j++) {
+            char c = *hex++;
+            int d = (c >= '0' && c <= '9') ? c - '0'
+                  : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+            if (d < 0) return -1;
+            v = (v << 4) | (uint64_t)d;
+        }
+        buckets[i] = v;
+    }
+    return 0;
+}
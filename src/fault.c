@@ -0,0 +1,332 @@
+#include "fault.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+struct fault_held {
+    uint64_t           due_us;
+    uint64_t           seq;      /* FIFO among equal due times */
+    struct sockaddr_in to;
+    int                len;
+    char              *data;
+};
+
+/* =========================================================
+ * Spec parsing
+ * ========================================================= */
+
+static void rule_unset(fault_rule_t *r) {
+    memset(r, 0, sizeof(*r));
+    r->loss = r->dup = r->reorder = -1;
+    r->delay_ms = r->jitter_ms = r->hold_ms = -1;
+    r->dist = -1;
+}
+
+/* "6001" or "6001-6009" */
+static int parse_ports(const char *s, int *lo, int *hi) {
+    char *end;
+    long a = strtol(s, &end, 10), b = a;
+    if (end == s) return -1;
+    if (*end == '-') {
+        const char *p = end + 1;
+        b = strtol(p, &end, 10);
+        if (end == p) return -1;
+    }
+    if (*end != '\0' || a <= 0 || b < a || b > 65535) return -1;
+    *lo = (int)a;
+    *hi = (int)b;
+    return 0;
+}
+
+static int parse_prob(const char *v, double *out) {
+    char *end;
+    double d = strtod(v, &end);
+    if (end == v || *end != '\0' || d < 0 || d > 1) return -1;
+    *out = d;
+    return 0;
+}
+
+static int parse_ms(const char *v, double *out) {
+    char *end;
+    double d = strtod(v, &end);
+    if (end == v || (*end && strcmp(end, "ms") != 0) || d < 0) return -1;
+    *out = d;
+    return 0;
+}
+
+static int parse_partition(fault_t *f, char *item) {
+    if (f->nparts >= FAULT_MAX_PARTITIONS) return -1;
+    fault_partition_t *p = &f->parts[f->nparts];
+    memset(p, 0, sizeof(*p));
+    int have_ports = 0;
+    char *save = NULL;
+    for (char *kv = strtok_r(item, ",", &save); kv;
+         kv = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(kv, '=');
+        if (!eq) return -1;
+        *eq = '\0';
+        const char *v = eq + 1;
+        double secs;
+        if (strcmp(kv, "partition") == 0) {
+            if (parse_ports(v, &p->port_lo, &p->port_hi) != 0) return -1;
+            have_ports = 1;
+        } else if (strcmp(kv, "at") == 0 || strcmp(kv, "heal") == 0) {
+            char *end;
+            secs = strtod(v, &end);
+            if (end == v || *end || secs < 0) return -1;
+            uint64_t us = (uint64_t)(secs * 1e6);
+            if (kv[0] == 'a') p->at_us = us; else p->heal_us = us;
+        } else {
+            return -1;
+        }
+    }
+    if (!have_ports) return -1;
+    f->nparts++;
+    return 0;
+}
+
+static int parse_rule(fault_t *f, char *item) {
+    if (f->nrules >= FAULT_MAX_RULES) return -1;
+    fault_rule_t *r = &f->rules[f->nrules];
+    rule_unset(r);
+
+    /* Optional "<ports>:" destination prefix */
+    char *colon = strchr(item, ':');
+    if (colon) {
+        *colon = '\0';
+        if (parse_ports(item, &r->port_lo, &r->port_hi) != 0) return -1;
+        item = colon + 1;
+    }
+
+    char *save = NULL;
+    for (char *kv = strtok_r(item, ",", &save); kv;
+         kv = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(kv, '=');
+        if (!eq) return -1;
+        *eq = '\0';
+        const char *v = eq + 1;
+        int rc;
+        if      (strcmp(kv, "loss")    == 0) rc = parse_prob(v, &r->loss);
+        else if (strcmp(kv, "dup")     == 0) rc = parse_prob(v, &r->dup);
+        else if (strcmp(kv, "reorder") == 0) rc = parse_prob(v, &r->reorder);
+        else if (strcmp(kv, "delay")   == 0) rc = parse_ms(v, &r->delay_ms);
+        else if (strcmp(kv, "jitter")  == 0) rc = parse_ms(v, &r->jitter_ms);
+        else if (strcmp(kv, "hold")    == 0) rc = parse_ms(v, &r->hold_ms);
+        else if (strcmp(kv, "dist")    == 0) {
+            rc = 0;
+            if      (strcmp(v, "uniform") == 0) r->dist = FAULT_DIST_UNIFORM;
+            else if (strcmp(v, "exp")     == 0) r->dist = FAULT_DIST_EXP;
+            else rc = -1;
+        } else {
+            rc = -1;
+        }
+        if (rc != 0) return -1;
+    }
+    f->nrules++;
+    return 0;
+}
+
+fault_t *fault_open(const char *spec, int self_port, unsigned seed) {
+    fault_t *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->self_port = self_port;
+    f->start_us  = current_time_us();
+    f->rng       = 0x9e3779b97f4a7c15ull ^ ((uint64_t)seed << 16)
+                   ^ (uint64_t)self_port;
+    f->held      = calloc(FAULT_MAX_HELD, sizeof(fault_held_t));
+    if (!f->held) { free(f); return NULL; }
+
+    char *copy = strdup(spec);
+    if (!copy) { fault_close(f); return NULL; }
+    char *save = NULL;
+    for (char *item = strtok_r(copy, ";", &save); item;
+         item = strtok_r(NULL, ";", &save)) {
+        while (isspace((unsigned char)*item)) item++;
+        if (!*item) continue;
+        char orig[256];
+        snprintf(orig, sizeof(orig), "%s", item);
+        int rc = (strncmp(item, "partition=", 10) == 0)
+                 ? parse_partition(f, item) : parse_rule(f, item);
+        if (rc != 0) {
+            fprintf(stderr, "fault spec: bad item '%s'\n", orig);
+            free(copy);
+            fault_close(f);
+            return NULL;
+        }
+    }
+    free(copy);
+    return f;
+}
+
+void fault_close(fault_t *f) {
+    if (!f) return;
+    for (int i = 0; i < f->nheld; i++) free(f->held[i].data);
+    free(f->held);
+    free(f);
+}
+
+/* =========================================================
+ * Randomness
+ * ========================================================= */
+
+static double rnd(fault_t *f) {
+    /* xorshift64*: uniform in [0, 1) */
+    f->rng ^= f->rng >> 12;
+    f->rng ^= f->rng << 25;
+    f->rng ^= f->rng >> 27;
+    return (double)((f->rng * 0x2545f4914f6cdd1dull) >> 11) / 9007199254740992.0;
+}
+
+/* Global rule overlaid with the last rule matching the destination */
+static void effective_rule(const fault_t *f, int port, fault_rule_t *out) {
+    rule_unset(out);
+    for (int i = 0; i < f->nrules; i++) {
+        const fault_rule_t *r = &f->rules[i];
+        if (r->port_lo && (port < r->port_lo || port > r->port_hi)) continue;
+        if (r->loss      >= 0) out->loss      = r->loss;
+        if (r->dup       >= 0) out->dup       = r->dup;
+        if (r->reorder   >= 0) out->reorder   = r->reorder;
+        if (r->delay_ms  >= 0) out->delay_ms  = r->delay_ms;
+        if (r->jitter_ms >= 0) out->jitter_ms = r->jitter_ms;
+        if (r->hold_ms   >= 0) out->hold_ms   = r->hold_ms;
+        if (r->dist      >= 0) out->dist      = r->dist;
+    }
+}
+
+static int partitioned(const fault_t *f, int port, uint64_t now) {
+    uint64_t t = now - f->start_us;
+    for (int i = 0; i < f->nparts; i++) {
+        const fault_partition_t *p = &f->parts[i];
+        if (t < p->at_us || (p->heal_us && t >= p->heal_us)) continue;
+        int self_in = f->self_port >= p->port_lo && f->self_port <= p->port_hi;
+        int dest_in = port >= p->port_lo && port <= p->port_hi;
+        if (self_in != dest_in) return 1;
+    }
+    return 0;
+}
+
+/* =========================================================
+ * Held datagrams (binary min-heap on due time, then seq)
+ * ========================================================= */
+
+static int held_before(const fault_held_t *a, const fault_held_t *b) {
+    return a->due_us < b->due_us ||
+           (a->due_us == b->due_us && a->seq < b->seq);
+}
+
+static void held_push(fault_t *f, uint64_t due, const char *data, int len,
+                      const struct sockaddr_in *to) {
+    if (f->nheld >= FAULT_MAX_HELD) { f->stats.overflow++; return; }
+    char *copy = malloc((size_t)len);
+    if (!copy) { f->stats.overflow++; return; }
+    memcpy(copy, data, (size_t)len);
+
+    int i = f->nheld++;
+    fault_held_t h = { due, f->held_seq++, *to, len, copy };
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!held_before(&h, &f->held[parent])) break;
+        f->held[i] = f->held[parent];
+        i = parent;
+    }
+    f->held[i] = h;
+}
+
+static void held_pop(fault_t *f) {
+    fault_held_t last = f->held[--f->nheld];
+    int i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= f->nheld) break;
+        if (c + 1 < f->nheld && held_before(&f->held[c + 1], &f->held[c])) c++;
+        if (!held_before(&f->held[c], &last)) break;
+        f->held[i] = f->held[c];
+        i = c;
+    }
+    if (f->nheld > 0) f->held[i] = last;
+}
+
+/* =========================================================
+ * Send path
+ * ========================================================= */
+
+static void raw_send(fault_t *f, int fd, const char *data, int len,
+                     const struct sockaddr_in *to) {
+    sendto(fd, data, (size_t)len, 0, (const struct sockaddr *)to,
+           sizeof(*to));
+    f->stats.sent++;
+}
+
+/* One copy: delay it per the rule, or send it now */
+static void schedule(fault_t *f, int fd, const fault_rule_t *r,
+                     const char *data, int len, const struct sockaddr_in *to,
+                     uint64_t now) {
+    double ms = (r->delay_ms > 0) ? r->delay_ms : 0;
+    if (r->jitter_ms > 0) {
+        if (r->dist == FAULT_DIST_EXP)
+            ms += -r->jitter_ms * log(1.0 - rnd(f));
+        else
+            ms += r->jitter_ms * rnd(f);
+    }
+    if (r->reorder > 0 && rnd(f) < r->reorder) {
+        ms += (r->hold_ms >= 0) ? r->hold_ms : 10.0;
+        f->stats.reordered++;
+    }
+    if (ms <= 0 && f->nheld == 0) {
+        raw_send(f, fd, data, len, to);
+        return;
+    }
+    /* Zero-delay datagrams still queue behind held ones for the same
+     * instant, so only the rules above reorder traffic */
+    f->stats.delayed += (ms > 0);
+    held_push(f, now + (uint64_t)(ms * 1000.0), data, len, to);
+}
+
+void fault_send(fault_t *f, int fd, const char *data, int len,
+                const struct sockaddr_in *to) {
+    uint64_t now = current_time_us();
+    int port = ntohs(to->sin_port);
+
+    if (partitioned(f, port, now)) { f->stats.partitioned++; return; }
+
+    fault_rule_t r;
+    effective_rule(f, port, &r);
+    if (r.loss > 0 && rnd(f) < r.loss) { f->stats.lost++; return; }
+
+    schedule(f, fd, &r, data, len, to, now);
+    if (r.dup > 0 && rnd(f) < r.dup) {
+        f->stats.duplicated++;
+        schedule(f, fd, &r, data, len, to, now);
+    }
+    fault_flush(f, fd);
+}
+
+uint64_t fault_flush(fault_t *f, int fd) {
+    uint64_t now = current_time_us();
+    while (f->nheld > 0 && f->held[0].due_us <= now) {
+        fault_held_t h = f->held[0];
+        held_pop(f);
+        raw_send(f, fd, h.data, h.len, &h.to);
+        free(h.data);
+    }
+    return (f->nheld > 0) ? f->held[0].due_us - now : UINT64_MAX;
+}
+
+int fault_format(const fault_t *f, char *buf, size_t size) {
+    const fault_stats_t *s = &f->stats;
+    return snprintf(buf, size,
+                    "fault: sent=%llu lost=%llu partitioned=%llu "
+                    "duplicated=%llu delayed=%llu reordered=%llu overflow=%llu",
+                    (unsigned long long)s->sent, (unsigned long long)s->lost,
+                    (unsigned long long)s->partitioned,
+                    (unsigned long long)s->duplicated,
+                    (unsigned long long)s->delayed,
+                    (unsigned long long)s->reordered,
+                    (unsigned long long)s->overflow);
+}
@@ -1,4 +1,5 @@
 #include "node.h"
+#include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,35 @@
 
 node_t *global_node = NULL;
 
+/* Default delivery: print to stdout */
+static void print_gossip(node_t *node, const gossip_msg_t *msg,
+                         const char *payload, void *ctx) {
+    (void)node; (void)ctx;
+    printf("\n[GOSSIP] %s from %s\n> ", payload, msg->sender_addr);
+}
+
+static void print_event(node_t *node, node_event_t event,
+                        const char *detail, void *ctx) {
+    (void)node; (void)ctx;
+    switch (event) {
+        case NODE_EVENT_PEER_JOINED:
+            printf("[HELLO] from %s\n> ", detail);
+            break;
+        case NODE_EVENT_PEER_REMOVED:
+            printf("[Peer Removed] %s timed out\n> ", detail);
+            break;
+        case NODE_EVENT_POW_REJECTED:
+            fprintf(stderr, "[PoW] HELLO from %s rejected (bad PoW)\n", detail);
+            break;
+        case NODE_EVENT_RX_STATS:
+            fprintf(stderr, "[RX] %s\n", detail);
+            break;
+        case NODE_EVENT_AGGREGATE:
+            fprintf(stderr, "[AGG] %s\n", detail);
+            break;
+    }
+}
+
 void handle_signal(int sig) {
     (void)sig;
     if (global_node) {
@@ -29,11 +59,40 @@ static struct option long_options[] = {
     {"peer-timeout",  required_argument, 0, 'o'},
     {"seed",          required_argument, 0, 's'},
     {"message",       required_argument, 0, 'm'},
+    {"publish-rate",  required_argument, 0, 'R'},
+    {"publish-for",   required_argument, 0, 'D'},
     /* Hybrid Push-Pull */
     {"pull-interval", required_argument, 0, 'q'},
     {"max-ihave-ids", required_argument, 0, 'x'},
+    {"pull-ids",      no_argument,       0, 'I'},
+    {"gap-repair",    required_argument, 0, 'g'},
     /* PoW */
     {"pow-difficulty",required_argument, 0, 'k'},
+    /* Compression */
+    {"compress",      required_argument, 0, 'z'},
+    /* Outbound pacing */
+    {"rate-limit",    required_argument, 0, 'r'},
+    {"peer-rate",     required_argument, 0, 'P'},
+    /* Ingress queue */
+    {"rx-queue",      required_argument, 0, 'Q'},
+    /* Topics */
+    {"topic",         required_argument, 0, 'T'},
+    {"subscribe",     required_argument, 0, 'S'},
+    {"order",         required_argument, 0, 'O'},
+    {"order-hold",    required_argument, 0, 'W'},
+    /* Replicated state */
+    {"state-sync",    required_argument, 0, 'Y'},
+    /* Aggregation */
+    {"aggregate",     required_argument, 0, 'A'},
+    {"agg-epoch",     required_argument, 0, 'E'},
+    /* Local control socket */
+    {"control",       required_argument, 0, 'U'},
+    /* Metrics */
+    {"metrics",       required_argument, 0, 'M'},
+    {"metrics-port",  required_argument, 0, 'H'},
+    {"trace-latency", no_argument,       0, 'L'},
+    /* Fault injection */
+    {"fault",         required_argument, 0, 'F'},
     {0, 0, 0, 0}
 };
 
@@ -50,57 +109,145 @@ void print_usage() {
         "  -o, --peer-timeout   <secs>        Peer timeout (default 6)\n"
         "  -s, --seed           <n>           RNG seed (default 42)\n"
         "  -m, --message        <text>        Auto-inject a GOSSIP message\n"
-        "  -q, --pull-interval  <secs>        IHAVE broadcast interval (0=off, default 0)\n"
+        "  -R, --publish-rate   <msgs/s>      Keep publishing -m (numbered) at this rate\n"
+        "  -D, --publish-for    <secs>        Stop publishing after this long (0=until killed)\n"
+        "  -q, --pull-interval  <secs>        Anti-entropy DIGEST interval (0=off, default 0)\n"
         "  -x, --max-ihave-ids  <n>           Max IDs per IHAVE (default 32)\n"
+        "  -I, --pull-ids                     Pull with IHAVE lists of recent IDs instead\n"
+        "                                     of per-origin version vectors\n"
+        "  -g, --gap-repair     <ms>          Pull sequence gaps missing this long (0=off, default 200)\n"
         "  -k, --pow-difficulty <n>           PoW leading-zero nibbles (0=off, default 0)\n"
+        "  -z, --compress       <codec>       Payload codec: none|lz|lz-dict (default none)\n"
+        "  -r, --rate-limit     <pkts/s>      Global outbound rate, AIMD-paced (0=off, default 0)\n"
+        "  -P, --peer-rate      <pkts/s>      Per-peer outbound rate (0=off, default 0)\n"
+        "  -Q, --rx-queue       <n>           Ingress queue depth in datagrams (default 128)\n"
+        "  -T, --topic          <name>        Topic for published messages (default news)\n"
+        "  -S, --subscribe      <name>        Deliver only this topic; repeatable (default all)\n"
+        "  -O, --order          <mode>        Delivery order: arrival|fifo|causal (default arrival)\n"
+        "  -W, --order-hold     <ms>          Longest an out-of-order message is held (default 2000)\n"
+        "  -Y, --state-sync     <ms>          Replicated-state digest interval (0=off, default 1000)\n"
+        "  -A, --aggregate      <name>=<num>  Contribute to a cluster-wide sum/avg/max; repeatable\n"
+        "  -E, --agg-epoch      <rounds>      PING rounds per aggregation epoch (0=off, default 20)\n"
+        "  -U, --control        <path>        Serve publish/subscribe/state on a Unix socket\n"
+        "  -M, --metrics        <secs>        Dump metrics to node_<port>.metrics (0=off)\n"
+        "  -H, --metrics-port   <port>        Serve Prometheus /metrics on 127.0.0.1 (0=off)\n"
+        "  -L, --trace-latency                Stamp published GOSSIP with origin time/TTL\n"
+        "  -F, --fault          <spec>        Inject loss/delay/dup/reorder/partitions on\n"
+        "                                     outgoing datagrams (see fault.h), e.g.\n"
+        "                                     'loss=0.1,delay=20,jitter=10;6001-6004:loss=1'\n"
     );
 }
 
+/* Steady-state load: publish "<text> <seq>" at rate msgs/s until
+ * `secs` have passed (0 = until stopped).  Paced against the schedule
+ * so a slow publish is made up rather than lowering the rate. */
+static void publish_loop(node_t *node, const char *topic, const char *text,
+                         double rate, int secs) {
+    char data[MSG_BUF_SIZE];
+    uint64_t start = current_time_us();
+    uint64_t end   = start + (uint64_t)secs * 1000000ull;
+    for (uint64_t seq = 0; node->running; seq++) {
+        uint64_t due = start + (uint64_t)((double)seq * 1e6 / rate);
+        uint64_t now = current_time_us();
+        if (secs > 0 && due >= end) break;
+        if (due > now) sleep_us(due - now);
+        snprintf(data, sizeof(data), "%.*s %llu", MSG_BUF_SIZE - 32, text,
+                 (unsigned long long)seq);
+        node_publish(node, topic, data, NULL);
+    }
+}
+
 int main(int argc, char *argv[]) {
     char auto_message[MSG_BUF_SIZE] = {0};
+    double publish_rate = 0;
+    int    publish_for  = 0;
+
+    node_config_t cfg;
+    node_config_defaults(&cfg);
 
-    int port           = 0;
-    int fanout         = 3;
-    int ttl            = 5;
-    int peer_limit     = 20;
-    int ping_interval  = 2;
-    int peer_timeout   = 6;
-    int pull_interval  = 0;
-    int max_ihave_ids  = 32;
-    int pow_difficulty = 0;
-    unsigned int seed  = 42;
+    char topic[TOPIC_LEN] = "news";
+    char subscribe[MAX_SUBSCRIPTIONS][TOPIC_LEN];
+    int  sub_count     = 0;
+    char *aggregates[AGG_MAX];
+    int  agg_count     = 0;
     char boot_ip[64]   = {0};
     int  boot_port     = 0;
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "p:f:t:b:l:i:o:s:m:q:x:k:",
+    while ((opt = getopt_long(argc, argv, "p:f:t:b:l:i:o:s:m:R:D:q:x:Ig:k:z:r:P:Q:T:S:U:M:H:LF:O:W:Y:A:E:",
                               long_options, NULL)) != -1) {
         switch (opt) {
-            case 'p': port           = atoi(optarg); break;
-            case 'f': fanout         = atoi(optarg); break;
-            case 't': ttl            = atoi(optarg); break;
+            case 'p': cfg.port           = atoi(optarg); break;
+            case 'f': cfg.fanout         = atoi(optarg); break;
+            case 't': cfg.ttl            = atoi(optarg); break;
             case 'b': sscanf(optarg, "%63[^:]:%d", boot_ip, &boot_port); break;
-            case 'l': peer_limit     = atoi(optarg); break;
-            case 'i': ping_interval  = atoi(optarg); break;
-            case 'o': peer_timeout   = atoi(optarg); break;
-            case 's': seed           = (unsigned int)atoi(optarg); break;
+            case 'l': cfg.peer_limit     = atoi(optarg); break;
+            case 'i': cfg.ping_interval  = atoi(optarg); break;
+            case 'o': cfg.peer_timeout   = atoi(optarg); break;
+            case 's': cfg.seed           = (unsigned int)atoi(optarg); break;
             case 'm': strncpy(auto_message, optarg, MSG_BUF_SIZE - 1); break;
-            case 'q': pull_interval  = atoi(optarg); break;
-            case 'x': max_ihave_ids  = atoi(optarg); break;
-            case 'k': pow_difficulty = atoi(optarg); break;
+            case 'R': publish_rate       = atof(optarg); break;
+            case 'D': publish_for        = atoi(optarg); break;
+            case 'q': cfg.pull_interval  = atoi(optarg); break;
+            case 'x': cfg.max_ihave_ids  = atoi(optarg); break;
+            case 'I': cfg.pull_ids       = 1; break;
+            case 'g': cfg.gap_repair_ms  = atoi(optarg); break;
+            case 'k': cfg.pow_difficulty = atoi(optarg); break;
+            case 'z':
+                cfg.compress_codec = codec_from_name(optarg);
+                if (cfg.compress_codec < 0) { print_usage(); return 1; }
+                break;
+            case 'r': cfg.rate_limit     = atof(optarg); break;
+            case 'P': cfg.peer_rate      = atof(optarg); break;
+            case 'Q': cfg.rx_queue_depth = atoi(optarg); break;
+            case 'U': cfg.control_path   = optarg;       break;
+            case 'M': cfg.metrics_interval = atoi(optarg); break;
+            case 'H': cfg.metrics_http_port = atoi(optarg); break;
+            case 'L': cfg.trace_origin   = 1;            break;
+            case 'F': cfg.fault_spec     = optarg;       break;
+            case 'O':
+                cfg.delivery_order = order_mode_from_name(optarg);
+                if (cfg.delivery_order < 0) { print_usage(); return 1; }
+                break;
+            case 'W': cfg.order_hold_ms  = atoi(optarg); break;
+            case 'Y': cfg.state_sync_ms  = atoi(optarg); break;
+            case 'A':
+                if (agg_count < AGG_MAX) aggregates[agg_count++] = optarg;
+                break;
+            case 'E': cfg.agg_epoch_rounds = atoi(optarg); break;
+            case 'T':
+                if (!msg_topic_valid(optarg)) { print_usage(); return 1; }
+                snprintf(topic, sizeof(topic), "%s", optarg);
+                break;
+            case 'S':
+                if (!msg_topic_valid(optarg)) { print_usage(); return 1; }
+                if (sub_count < MAX_SUBSCRIPTIONS)
+                    snprintf(subscribe[sub_count++], TOPIC_LEN, "%s", optarg);
+                break;
             default:  print_usage(); return 1;
         }
     }
 
-    if (port == 0) { print_usage(); return 1; }
+    if (cfg.port == 0) { print_usage(); return 1; }
 
     node_t node;
-    if (node_init(&node, port, fanout, ttl, peer_limit,
-                  ping_interval, peer_timeout, seed,
-                  pull_interval, max_ihave_ids, pow_difficulty) != 0) {
+    if (node_init_config(&node, &cfg) != 0) {
         fprintf(stderr, "Failed to init node\n");
         return 1;
     }
+    node_set_event_handler(&node, print_event, NULL);
+
+    for (int i = 0; i < agg_count; i++) {
+        char *eq = strchr(aggregates[i], '=');
+        if (eq) *eq = '\0';
+        if (!eq || node_agg_set(&node, aggregates[i], atof(eq + 1)) != 0)
+            fprintf(stderr, "bad aggregate '%s'\n", aggregates[i]);
+    }
+
+    if (sub_count == 0)
+        node_subscribe(&node, TOPIC_WILDCARD, print_gossip, NULL);
+    for (int i = 0; i < sub_count; i++)
+        node_subscribe(&node, subscribe[i], print_gossip, NULL);
 
     global_node = &node;
     signal(SIGINT,  handle_signal);
@@ -111,47 +258,17 @@ int main(int argc, char *argv[]) {
     }
 
     node_run(&node);
-    printf("Gossip Node started on port %d\n", port);
+    printf("Gossip Node started on port %d\n", cfg.port);
 
     /* Brief delay so listener is ready before injecting */
     usleep(200000);
 
     /* --- Auto-inject message if provided --- */
     if (strlen(auto_message) > 0) {
-        gossip_msg_t m;
-        memset(&m, 0, sizeof(m));
-        m.version = 1;
-        snprintf(m.msg_id, ID_LEN, "%s_%llu",
-                 node.node_id, (unsigned long long)current_time_ms());
-        strcpy(m.msg_type,    "GOSSIP");
-        strcpy(m.sender_id,   node.node_id);
-        strcpy(m.sender_addr, node.self_addr);
-        m.timestamp_ms = current_time_ms();
-        m.ttl = node.ttl;
-        snprintf(m.payload, MSG_BUF_SIZE,
-                 "{ \"topic\": \"news\", \"data\": \"%s\" }",
-                 auto_message);
-
-        pthread_mutex_lock(&node.lock);
-        mark_seen_public(&node, m.msg_id);
-        pthread_mutex_unlock(&node.lock);
-
-        /* store for IWANT */
-        pthread_mutex_lock(&node.lock);
-        /* use internal store helper indirectly via log_event trick – 
-           actually call relay so it also gets stored in listener path.
-           We directly store here: */
-        {
-            int idx = node.gossip_store_count % MAX_STORED_GOSSIP;
-            strncpy(node.gossip_store[idx].msg_id, m.msg_id, ID_LEN - 1);
-            serialize_message(&m, node.gossip_store[idx].serialized,
-                              MAX_SERIALIZED_LEN);
-            node.gossip_store_count++;
-        }
-        pthread_mutex_unlock(&node.lock);
-
-        log_event(&node, "SEND", m.msg_type, m.msg_id);
-        relay_gossip(&node, &m, NULL);
+        if (publish_rate > 0)
+            publish_loop(&node, topic, auto_message, publish_rate, publish_for);
+        else
+            node_publish(&node, topic, auto_message, NULL);
     }
 
     /* --- Interactive or non-interactive mode ---
@@ -169,35 +286,48 @@ int main(int argc, char *argv[]) {
             input[strcspn(input, "\n")] = '\0';
 
             if (strncmp(input, "msg ", 4) == 0) {
-                gossip_msg_t m;
-                memset(&m, 0, sizeof(m));
-                m.version = 1;
-                snprintf(m.msg_id, ID_LEN, "%s_%llu",
-                         node.node_id,
-                         (unsigned long long)current_time_ms());
-                strcpy(m.msg_type,    "GOSSIP");
-                strcpy(m.sender_id,   node.node_id);
-                strcpy(m.sender_addr, node.self_addr);
-                m.timestamp_ms = current_time_ms();
-                m.ttl = node.ttl;
-                snprintf(m.payload, MSG_BUF_SIZE,
-                         "{ \"topic\": \"news\", \"data\": \"%s\" }",
-                         input + 4);
-
-                pthread_mutex_lock(&node.lock);
-                mark_seen_public(&node, m.msg_id);
-                {
-                    int idx = node.gossip_store_count % MAX_STORED_GOSSIP;
-                    strncpy(node.gossip_store[idx].msg_id,
-                            m.msg_id, ID_LEN - 1);
-                    serialize_message(&m, node.gossip_store[idx].serialized,
-                                      MAX_SERIALIZED_LEN);
-                    node.gossip_store_count++;
+                node_publish(&node, topic, input + 4, NULL);
+
+            } else if (strncmp(input, "set ", 4) == 0) {
+                char *key = input + 4;
+                char *val = strchr(key, ' ');
+                if (val) *val++ = '\0';
+                if (!val || node_state_set(&node, key, val) != 0)
+                    printf("set failed\n");
+
+            } else if (strncmp(input, "get ", 4) == 0) {
+                char val[CRDT_VALUE_LEN];
+                if (node_state_get(&node, input + 4, val, sizeof(val)) == 0)
+                    printf("%s\n", val);
+                else
+                    printf("(not set)\n");
+
+            } else if (strncmp(input, "del ", 4) == 0) {
+                if (node_state_delete(&node, input + 4) != 0)
+                    printf("del failed\n");
+
+            } else if (strcmp(input, "agg") == 0) {
+                double size;
+                if (node_cluster_size(&node, &size) != 0) {
+                    printf("no completed aggregation epoch yet\n");
+                } else {
+                    printf("cluster size ~%.1f\n", size);
+                    char names[AGG_MAX][AGG_NAME_LEN];
+                    int n = node_agg_names(&node, names, AGG_MAX);
+
+                    agg_result_t r;
+                    for (int i = 0; i < n; i++)
+                        if (node_agg_get(&node, names[i], &r) == 0)
+                            printf("  %s: n=%.1f sum=%g avg=%g max=%g\n",
+                                   names[i], r.n, r.sum, r.avg, r.max);
                 }
-                pthread_mutex_unlock(&node.lock);
 
-                log_event(&node, "SEND", m.msg_type, m.msg_id);
-                relay_gossip(&node, &m, NULL);
+            } else if (strncmp(input, "agg ", 4) == 0) {
+                char *name = input + 4;
+                char *val  = strchr(name, ' ');
+                if (val) *val++ = '\0';
+                if (!val || node_agg_set(&node, name, atof(val)) != 0)
+                    printf("agg failed\n");
 
             } else if (strcmp(input, "peers") == 0) {
                 pthread_mutex_lock(&node.membership.lock);
@@ -214,7 +344,8 @@ int main(int argc, char *argv[]) {
                        strcmp(input, "exit") == 0) {
                 break;
             } else if (strlen(input) > 0) {
-                printf("Commands: msg <text> | peers | quit\n");
+                printf("Commands: msg <text> | set <key> <value> | get <key> | "
+                       "del <key> | agg [<name> <num>] | peers | quit\n");
             }
 
             printf("> ");
@@ -25,6 +25,8 @@ int membership_add(membership_t *m, struct sockaddr_in addr) {
     if (m->count < m->limit) {
         m->list[m->count].addr      = addr;
         m->list[m->count].last_seen = current_time_ms();
+        m->list[m->count].caps      = 0;
+        m->list[m->count].topics_known = 0;
         m->count++;
         pthread_mutex_unlock(&m->lock);
         return 1;   /* newly added */
@@ -41,12 +43,19 @@ int membership_add(membership_t *m, struct sockaddr_in addr) {
     }
     m->list[oldest].addr      = addr;
     m->list[oldest].last_seen = current_time_ms();
+    m->list[oldest].caps      = 0;
+    m->list[oldest].topics_known = 0;
     pthread_mutex_unlock(&m->lock);
     return 1;
 }
 
-int membership_get_random(membership_t *m, struct sockaddr_in *targets, int count,
-                          struct sockaddr_in *exclude) {
+static int peer_interested(const peer_info_t *p, uint64_t bits) {
+    return !p->topics_known || (p->topic_mask & bits) == bits;
+}
+
+/* Shared sampler: filter < 0 takes every peer */
+static int get_random(membership_t *m, struct sockaddr_in *targets, int count,
+                      struct sockaddr_in *exclude, uint64_t bits, int filter) {
     pthread_mutex_lock(&m->lock);
     if (m->count == 0) {
         pthread_mutex_unlock(&m->lock);
@@ -63,14 +72,93 @@ int membership_get_random(membership_t *m, struct sockaddr_in *targets, int coun
 
     int found = 0;
     for (int i = 0; i < m->count && found < count; i++) {
-        struct sockaddr_in *candidate = &m->list[indices[i]].addr;
+        peer_info_t *peer = &m->list[indices[i]];
+        struct sockaddr_in *candidate = &peer->addr;
         if (exclude &&
             candidate->sin_port == exclude->sin_port &&
             candidate->sin_addr.s_addr == exclude->sin_addr.s_addr)
             continue;
+        if (filter >= 0 && peer_interested(peer, bits) != filter)
+            continue;
         targets[found++] = *candidate;
     }
 
     pthread_mutex_unlock(&m->lock);
     return found;
 }
+
+int membership_get_random(membership_t *m, struct sockaddr_in *targets, int count,
+                          struct sockaddr_in *exclude) {
+    return get_random(m, targets, count, exclude, 0, -1);
+}
+
+int membership_get_random_filtered(membership_t *m, struct sockaddr_in *targets,
+                                   int count, struct sockaddr_in *exclude,
+                                   uint64_t bits, int interested) {
+    return get_random(m, targets, count, exclude, bits, interested ? 1 : 0);
+}
+
+/* Two bits per topic out of 64 (FNV-1a of the name) */
+uint64_t topic_bits(const char *topic) {
+    uint32_t h = 2166136261u;
+    while (*topic) {
+        h ^= (uint8_t)*topic++;
+        h *= 16777619u;
+    }
+    return (1ull << (h & 63)) | (1ull << ((h >> 6) & 63));
+}
+
+void membership_set_topics(membership_t *m, struct sockaddr_in addr,
+                           uint64_t topic_mask) {
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < m->count; i++) {
+        if (m->list[i].addr.sin_port == addr.sin_port &&
+            m->list[i].addr.sin_addr.s_addr == addr.sin_addr.s_addr) {
+            m->list[i].topic_mask   = topic_mask;
+            m->list[i].topics_known = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+int membership_is_interested(membership_t *m, struct sockaddr_in *addr,
+                             uint64_t bits) {
+    int rc = -1;
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < m->count; i++) {
+        if (m->list[i].addr.sin_port == addr->sin_port &&
+            m->list[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+            rc = peer_interested(&m->list[i], bits);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return rc;
+}
+
+void membership_set_caps(membership_t *m, struct sockaddr_in addr, uint32_t caps) {
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < m->count; i++) {
+        if (m->list[i].addr.sin_port == addr.sin_port &&
+            m->list[i].addr.sin_addr.s_addr == addr.sin_addr.s_addr) {
+            m->list[i].caps = caps;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+}
+
+uint32_t membership_get_caps(membership_t *m, struct sockaddr_in *addr) {
+    uint32_t caps = 0;
+    pthread_mutex_lock(&m->lock);
+    for (int i = 0; i < m->count; i++) {
+        if (m->list[i].addr.sin_port == addr->sin_port &&
+            m->list[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+            caps = m->list[i].caps;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return caps;
+}
@@ -0,0 +1,82 @@
+#include "message.h"
+#include "queue.h"
+#include <pthread.h>
+#include <string.h>
+
+typedef struct {
+    char name[MSG_TYPE_LEN];
+    int  tclass;
+} msg_type_entry_t;
+
+static msg_type_entry_t type_table[MAX_MSG_TYPES] = {
+    [MSG_HELLO]      = { "HELLO",      CLASS_CONTROL },
+    [MSG_GET_PEERS]  = { "GET_PEERS",  CLASS_CONTROL },
+    [MSG_PEERS_LIST] = { "PEERS_LIST", CLASS_CONTROL },
+    [MSG_GOSSIP]     = { "GOSSIP",     CLASS_DATA    },
+    [MSG_PING]       = { "PING",       CLASS_CONTROL },
+    [MSG_PONG]       = { "PONG",       CLASS_CONTROL },
+    [MSG_IHAVE]      = { "IHAVE",      CLASS_PULL    },
+    [MSG_IWANT]      = { "IWANT",      CLASS_PULL    },
+    [MSG_DIGEST]     = { "DIGEST",     CLASS_PULL    },
+    [MSG_STATE]      = { "STATE",      CLASS_DATA    },
+    [MSG_STATE_DIGEST] = { "STATE_DIGEST", CLASS_PULL },
+};
+/* Entries below type_count never change.  Registration fills the next
+ * slot under type_lock and then publishes it with a release store of
+ * type_count, so the listener and dispatcher threads of running nodes
+ * read the table without taking the lock. */
+static int type_count = MSG_BUILTIN_COUNT;
+static pthread_mutex_t type_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int loaded_count(void) {
+    return __atomic_load_n(&type_count, __ATOMIC_ACQUIRE);
+}
+
+int msg_type_lookup(const char *name) {
+    int count = loaded_count();
+    /* First-byte check keeps this to ~one strcmp per datagram */
+    for (int i = 0; i < count; i++) {
+        if (type_table[i].name[0] == name[0] &&
+            strcmp(type_table[i].name, name) == 0)
+            return i;
+    }
+    return MSG_UNKNOWN;
+}
+
+int msg_type_register(const char *name, int tclass) {
+    pthread_mutex_lock(&type_lock);
+    int id = msg_type_lookup(name);
+    if (id != MSG_UNKNOWN) {
+        if (type_table[id].tclass != tclass) id = -1;
+    } else if (type_count >= MAX_MSG_TYPES || strlen(name) >= MSG_TYPE_LEN) {
+        id = -1;
+    } else {
+        id = type_count;
+        strcpy(type_table[id].name, name);
+        type_table[id].tclass = tclass;
+        __atomic_store_n(&type_count, id + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&type_lock);
+    return id;
+}
+
+const char *msg_type_name(int type) {
+    if (type < 0 || type >= loaded_count()) return "UNKNOWN";
+    return type_table[type].name;
+}
+
+int msg_type_class(int type) {
+    if (type < 0 || type >= loaded_count()) return CLASS_DATA;
+    return type_table[type].tclass;
+}
+
+int msg_type_count(void) {
+    return loaded_count();
+}
+
+int msg_topic_valid(const char *topic) {
+    size_t n = 0;
+    for (const char *p = topic; *p; p++, n++)
+        if ((unsigned char)*p < 0x20 || *p == '"' || *p == '\\') return 0;
+    return n < TOPIC_LEN;
+}
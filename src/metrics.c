@@ -0,0 +1,219 @@
+#include "metrics.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *counter_names[NUM_COUNTERS] = {
+    "sent", "received", "duplicate", "rx_dropped", "tx_dropped",
+    "sent_bytes", "received_bytes", "gap_requested", "gap_abandoned",
+    "state_merged"
+};
+static const char *hist_names[NUM_HISTOGRAMS] = {
+    "relay_us", "ping_rtt_us", "e2e_latency_us", "hop_latency_us", "hops"
+};
+static const char *gauge_names[NUM_GAUGES] = {
+    "peers", "seen_ids", "stored_msgs", "origins", "rx_queue",
+    "tx_queue", "state_keys", "cluster_size"
+};
+
+int metrics_init(metrics_t *m) {
+    memset(m, 0, sizeof(*m));
+    m->shards = aligned_alloc(64, METRICS_SHARDS * sizeof(metrics_shard_t));
+    m->hist   = calloc(NUM_HISTOGRAMS, sizeof(histogram_t));
+    if (!m->shards || !m->hist) {
+        metrics_free(m);
+        return -1;
+    }
+    memset(m->shards, 0, METRICS_SHARDS * sizeof(metrics_shard_t));
+    m->start_ms = current_time_ms();
+    return 0;
+}
+
+void metrics_free(metrics_t *m) {
+    free(m->shards);
+    free(m->hist);
+    memset(m, 0, sizeof(*m));
+}
+
+/* =========================================================
+ * Counters
+ * ========================================================= */
+
+/* Shard of the calling thread, handed out round-robin on first use */
+static int my_shard(void) {
+    static int next_shard;
+    static __thread int shard = -1;
+    if (shard < 0)
+        shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED)
+                % METRICS_SHARDS;
+    return shard;
+}
+
+static int type_slot(int type) {
+    return (type >= 0 && type < MAX_MSG_TYPES) ? type : MAX_MSG_TYPES;
+}
+
+void metrics_count(metrics_t *m, metric_counter_t c, int type) {
+    metrics_add(m, c, type, 1);
+}
+
+void metrics_add(metrics_t *m, metric_counter_t c, int type, uint64_t n) {
+    __atomic_fetch_add(&m->shards[my_shard()].c[c][type_slot(type)], n,
+                       __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_counter(const metrics_t *m, metric_counter_t c, int type) {
+    uint64_t sum = 0;
+    int slot = type_slot(type);
+    for (int s = 0; s < METRICS_SHARDS; s++)
+        sum += __atomic_load_n(&m->shards[s].c[c][slot], __ATOMIC_RELAXED);
+    return sum;
+}
+
+uint64_t metrics_counter_total(const metrics_t *m, metric_counter_t c) {
+    uint64_t sum = 0;
+    for (int t = 0; t < METRICS_TYPE_SLOTS; t++)
+        sum += metrics_counter(m, c, t);
+    return sum;
+}
+
+/* =========================================================
+ * Histograms
+ * ========================================================= */
+
+static int hist_bucket(uint64_t v) {
+    if (v < HIST_SUB) return (int)v;
+    int e = 63 - __builtin_clzll(v);   /* >= HIST_SUB_BITS */
+    if (e > HIST_MAX_EXP) return HIST_BUCKETS - 1;
+    int sub = (int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (e - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+static uint64_t hist_bucket_lower(int b) {
+    if (b < HIST_SUB) return (uint64_t)b;
+    int e   = b / HIST_SUB + HIST_SUB_BITS - 1;
+    int sub = b % HIST_SUB;
+    return (uint64_t)(HIST_SUB + sub) << (e - HIST_SUB_BITS);
+}
+
+static uint64_t hist_bucket_upper(int b) {
+    if (b >= HIST_BUCKETS - 1) return UINT64_MAX;
+    return hist_bucket_lower(b + 1) - 1;
+}
+
+void metrics_observe(metrics_t *m, metric_hist_t h, uint64_t value) {
+    histogram_t *hg = &m->hist[h];
+    __atomic_fetch_add(&hg->buckets[hist_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hg->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hg->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&hg->max, __ATOMIC_RELAXED);
+    while (value > max &&
+           !__atomic_compare_exchange_n(&hg->max, &max, value, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+uint64_t metrics_hist_count_le(const metrics_t *m, metric_hist_t h,
+                               uint64_t v) {
+    const histogram_t *hg = &m->hist[h];
+    uint64_t n = 0;
+    for (int b = 0; b < HIST_BUCKETS && hist_bucket_upper(b) <= v; b++)
+        n += __atomic_load_n(&hg->buckets[b], __ATOMIC_RELAXED);
+    return n;
+}
+
+void metrics_hist_summary(const metrics_t *m, metric_hist_t h,
+                          hist_summary_t *out) {
+    const histogram_t *hg = &m->hist[h];
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total = 0;
+
+    /* Snapshot first so the quantiles agree with each other */
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        counts[b] = __atomic_load_n(&hg->buckets[b], __ATOMIC_RELAXED);
+        total += counts[b];
+    }
+    memset(out, 0, sizeof(*out));
+    out->count = total;
+    out->sum   = __atomic_load_n(&hg->sum, __ATOMIC_RELAXED);
+    out->max   = __atomic_load_n(&hg->max, __ATOMIC_RELAXED);
+    if (total == 0) return;
+
+    static const double q[4] = { 0.50, 0.90, 0.99, 0.999 };
+    uint64_t *dst[4] = { &out->p50, &out->p90, &out->p99, &out->p999 };
+    uint64_t seen = 0;
+    int k = 0;
+    for (int b = 0; b < HIST_BUCKETS && k < 4; b++) {
+        seen += counts[b];
+        while (k < 4 && seen >= (uint64_t)(q[k] * (double)total + 0.999)) {
+            uint64_t v = hist_bucket_upper(b);
+            *dst[k++] = (v < out->max) ? v : out->max;
+        }
+    }
+}
+
+/* =========================================================
+ * Gauges
+ * ========================================================= */
+
+void metrics_gauge_set(metrics_t *m, metric_gauge_t g, int64_t v) {
+    __atomic_store_n(&m->gauges[g], v, __ATOMIC_RELAXED);
+}
+
+int64_t metrics_gauge(const metrics_t *m, metric_gauge_t g) {
+    return __atomic_load_n(&m->gauges[g], __ATOMIC_RELAXED);
+}
+
+/* =========================================================
+ * Names and text dump
+ * ========================================================= */
+
+const char *metrics_counter_name(metric_counter_t c) { return counter_names[c]; }
+const char *metrics_hist_name(metric_hist_t h)       { return hist_names[h]; }
+const char *metrics_gauge_name(metric_gauge_t g)     { return gauge_names[g]; }
+
+const char *metrics_type_name(int slot) {
+    if (slot >= MAX_MSG_TYPES) return "UNKNOWN";
+    const char *name = msg_type_name(slot);
+    return name ? name : "UNKNOWN";
+}
+
+int metrics_format(const metrics_t *m, char *buf, size_t size) {
+    size_t o = 0;
+#define EMIT(...) do { \
+        if (o < size) o += (size_t)snprintf(buf + o, size - o, __VA_ARGS__); \
+    } while (0)
+
+    EMIT("uptime_s %llu\n",
+         (unsigned long long)((current_time_ms() - m->start_ms) / 1000));
+
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        for (int t = 0; t < METRICS_TYPE_SLOTS; t++) {
+            uint64_t v = metrics_counter(m, (metric_counter_t)c, t);
+            if (v)
+                EMIT("counter %s %s %llu\n", counter_names[c],
+                     metrics_type_name(t), (unsigned long long)v);
+        }
+    }
+
+    for (int g = 0; g < NUM_GAUGES; g++)
+        EMIT("gauge %s %lld\n", gauge_names[g],
+             (long long)metrics_gauge(m, (metric_gauge_t)g));
+
+    for (int h = 0; h < NUM_HISTOGRAMS; h++) {
+        hist_summary_t s;
+        metrics_hist_summary(m, (metric_hist_t)h, &s);
+        EMIT("histogram %s count %llu mean %llu p50 %llu p90 %llu "
+             "p99 %llu p999 %llu max %llu\n", hist_names[h],
+             (unsigned long long)s.count,
+             (unsigned long long)(s.count ? s.sum / s.count : 0),
+             (unsigned long long)s.p50, (unsigned long long)s.p90,
+             (unsigned long long)s.p99, (unsigned long long)s.p999,
+             (unsigned long long)s.max);
+    }
+#undef EMIT
+    return (int)(o < size ? o : size - 1);
+}
@@ -1,8 +1,11 @@
 #include "node.h"
 #include "utils.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
 #include <uuid/uuid.h>
 #include <sys/time.h>
 #include <string.h>
@@ -13,55 +16,139 @@
  * Helpers
  * ========================================================= */
 
+/* Report a notification to the application, if it asked for them */
+static void emit_event(node_t *node, node_event_t event,
+                       const char *fmt, ...) {
+    if (!node->event_fn) return;
+    char detail[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(detail, sizeof(detail), fmt, ap);
+    va_end(ap);
+    node->event_fn(node, event, detail, node->event_ctx);
+}
+
+/* Hand a wire-format datagram to the sender thread.  A full queue sheds
+ * its oldest PULL, then DATA packet to make room for a higher class, so
+ * a GOSSIP burst cannot crowd out PINGs and PONGs. */
+static void send_raw(node_t *node, int type,
+                     const char *buf, int len, struct sockaddr_in *dest) {
+    int evicted;
+    int rc = pqueue_push_shed(&node->tx_queue, msg_class(type), buf, len,
+                              dest, type, &evicted);
+    if (evicted >= 0)
+        metrics_count(&node->metrics, M_TX_DROPPED, evicted);
+    if (rc != 0) {
+        metrics_count(&node->metrics, M_TX_DROPPED, type);
+        return;
+    }
+    metrics_count(&node->metrics, M_SENT, type);
+    metrics_add(&node->metrics, M_SENT_BYTES, type, (uint64_t)len);
+}
+
 static void send_msg(node_t *node, gossip_msg_t *msg,
                      struct sockaddr_in *dest) {
     char buf[MAX_SERIALIZED_LEN];
+    TRACE_BEGIN(t);
     int len = serialize_message(msg, buf, sizeof(buf));
-    if (len <= 0) return;
-    sendto(node->sockfd, buf, (size_t)len, 0,
-           (struct sockaddr *)dest, sizeof(struct sockaddr_in));
-    node->sent_messages++;
+    TRACE_END(t, TP_SERIALIZE);
+    if (len <= 0 || len >= (int)sizeof(buf)) return;
+    send_raw(node, msg_type_lookup(msg->msg_type), buf, len, dest);
     log_event(node, "SEND", msg->msg_type, msg->msg_id);
 }
 
-/* Mark a msg_id as seen.  Returns 1 if it was already seen, 0 if new. */
-static int mark_seen(node_t *node, const char *msg_id) {
-    int limit = (node->seen_count < MAX_SEEN_MSGS)
-                ? node->seen_count : MAX_SEEN_MSGS;
-    for (int i = 0; i < limit; i++) {
-        if (strcmp(node->seen_ids[i % MAX_SEEN_MSGS], msg_id) == 0)
-            return 1;
+/* Originated GOSSIP ids ("<node_id>_<seq>") are tracked by per-origin
+ * watermark; anything else, or an origin the table has no room for, by
+ * the seen-set. */
+
+/* Lookup without inserting (caller holds node->lock or seen_lock) */
+static int is_seen(node_t *node, const char *msg_id) {
+    char origin[NODE_ID_LEN];
+    uint64_t seq;
+    if (wm_parse_id(msg_id, origin, sizeof(origin), &seq) == 0) {
+        int r = wm_contains(&node->wm, origin, seq);
+        if (r >= 0) return r;
     }
-    strcpy(node->seen_ids[node->seen_count % MAX_SEEN_MSGS], msg_id);
-    node->seen_count++;
-    return 0;
+    return seen_contains(&node->seen, msg_id);
+}
+
+/* Mark a msg_id as seen, relayed by `from` (NULL for our own).
+ * Returns 1 if it was already seen, 0 if new.  Caller holds node->lock. */
+static int mark_seen(node_t *node, const char *msg_id,
+                     const struct sockaddr_in *from) {
+    char origin[NODE_ID_LEN];
+    uint64_t seq;
+    int r = -1;
+    pthread_mutex_lock(&node->seen_lock);
+    if (wm_parse_id(msg_id, origin, sizeof(origin), &seq) == 0)
+        r = wm_insert(&node->wm, origin, seq, from, current_time_us());
+    if (r < 0) r = seen_insert(&node->seen, msg_id);
+    pthread_mutex_unlock(&node->seen_lock);
+    return r;
 }
 
 /* Store the serialized form of a gossip message for later IWANT replies */
 static void store_gossip(node_t *node, gossip_msg_t *msg) {
-    int idx = node->gossip_store_count % MAX_STORED_GOSSIP;
-    strncpy(node->gossip_store[idx].msg_id, msg->msg_id, ID_LEN - 1);
-    serialize_message(msg, node->gossip_store[idx].serialized,
-                      MAX_SERIALIZED_LEN);
-    node->gossip_store_count++;
+    store_put(&node->store, msg);
 }
 
 /* Look up stored gossip by msg_id.  Returns pointer or NULL. */
 static stored_gossip_t *find_stored(node_t *node, const char *msg_id) {
-    int total = (node->gossip_store_count < MAX_STORED_GOSSIP)
-                ? node->gossip_store_count : MAX_STORED_GOSSIP;
-    for (int i = 0; i < total; i++) {
-        if (strcmp(node->gossip_store[i].msg_id, msg_id) == 0)
-            return &node->gossip_store[i];
+    return store_find(&node->store, msg_id);
+}
+
+/* JSON fragment advertising what we can decode, shared by HELLO/PING/PONG */
+#define CAPS_JSON "\"capabilities\": [\"udp\", \"json\", \"lz\", \"lz-dict\"]"
+
+/* Capabilities plus our topic interest, for HELLO/PING/PONG payloads */
+static void build_advert(node_t *node, char *buf, size_t size) {
+    snprintf(buf, size, CAPS_JSON ", \"topic_mask\": \"%016llx\"",
+             (unsigned long long)node_topic_mask(node));
+}
+
+/* Record what a peer advertised in HELLO/PING/PONG */
+static void note_advert(node_t *node, gossip_msg_t *msg,
+                        struct sockaddr_in *sender) {
+    membership_set_caps(&node->membership, *sender, caps_parse(msg->payload));
+    char *p = strstr(msg->payload, "\"topic_mask\": \"");
+    if (p)
+        membership_set_topics(&node->membership, *sender,
+                              strtoull(p + 15, NULL, 16));
+}
+
+/* Send a GOSSIP to dest.  A compressed payload is expanded first when
+ * dest has not advertised support for its codec. */
+static void send_gossip(node_t *node, gossip_msg_t *msg,
+                        struct sockaddr_in *dest) {
+    int codec = payload_codec(msg->payload);
+    if (codec == CODEC_NONE ||
+        (membership_get_caps(&node->membership, dest) & (1u << codec))) {
+        send_msg(node, msg, dest);
+        return;
     }
-    return NULL;
+
+    gossip_msg_t plain = *msg;
+    if (payload_decompress(msg->payload, plain.payload, MSG_BUF_SIZE) < 0)
+        return;
+    send_msg(node, &plain, dest);
+}
+
+void node_compress_payload(node_t *node, gossip_msg_t *msg) {
+    if (node->compress_codec == CODEC_NONE) return;
+
+    char packed[MSG_BUF_SIZE];
+    if (payload_compress(node->compress_codec, msg->payload,
+                         packed, sizeof(packed)) == 0)
+        strcpy(msg->payload, packed);
 }
 
 
 int node_build_hello_payload(node_t *node, char *payload_buf, size_t buf_size) {
+    char advert[256];
+    build_advert(node, advert, sizeof(advert));
+
     if (node->pow_difficulty <= 0) {
-        snprintf(payload_buf, buf_size,
-                 "{ \"capabilities\": [\"udp\", \"json\"] }");
+        snprintf(payload_buf, buf_size, "{ %s }", advert);
         return 0;
     }
 
@@ -71,12 +158,12 @@ int node_build_hello_payload(node_t *node, char *payload_buf, size_t buf_size) {
     pow_mine(node->node_id, node->pow_difficulty, &nonce, digest);
 
     snprintf(payload_buf, buf_size,
-             "{ \"capabilities\": [\"udp\", \"json\"], "
+             "{ %s, "
              "\"pow\": { \"hash_alg\": \"sha256\", "
              "\"difficulty_k\": %d, "
              "\"nonce\": %lu, "
              "\"digest_hex\": \"%s\" } }",
-             node->pow_difficulty, nonce, digest);
+             advert, node->pow_difficulty, nonce, digest);
     return 0;
 }
 
@@ -94,27 +181,170 @@ int node_verify_hello_pow(node_t *node, gossip_msg_t *msg) {
 
     char digest[65];
     int ok = pow_check(msg->sender_id, nonce, node->pow_difficulty, digest);
-    if (!ok) {
-        fprintf(stderr, "[PoW] HELLO from %s rejected (bad PoW)\n",
-                msg->sender_addr);
-    }
+    if (!ok)
+        emit_event(node, NODE_EVENT_POW_REJECTED, "%s", msg->sender_addr);
     return ok;
 }
 
 /* Public wrapper (caller must hold node->lock) */
 void mark_seen_public(node_t *node, const char *msg_id) {
-    mark_seen(node, msg_id);
+    mark_seen(node, msg_id, NULL);
 }
 
 
+/* =========================================================
+ * Handler registry
+ * ========================================================= */
+
+static void dispatch_peers_list(node_t *node, gossip_msg_t *msg,
+                                struct sockaddr_in *sender) {
+    (void)sender;
+    handle_peers_list(node, msg);
+}
+
+int node_register_handler(node_t *node, const char *type_name,
+                          msg_handler_fn fn, traffic_class_t tclass) {
+    int type = msg_type_register(type_name, tclass);
+    if (type < 0) return -1;
+    node->handlers[type] = fn;
+    return type;
+}
+
+static void register_builtin_handlers(node_t *node) {
+    node_register_handler(node, "HELLO",      handle_hello,        CLASS_CONTROL);
+    node_register_handler(node, "GET_PEERS",  handle_get_peers,    CLASS_CONTROL);
+    node_register_handler(node, "PEERS_LIST", dispatch_peers_list, CLASS_CONTROL);
+    node_register_handler(node, "GOSSIP",     handle_gossip,       CLASS_DATA);
+    node_register_handler(node, "PING",       handle_ping,         CLASS_CONTROL);
+    node_register_handler(node, "PONG",       handle_pong,         CLASS_CONTROL);
+    node_register_handler(node, "IHAVE",      handle_ihave,        CLASS_PULL);
+    node_register_handler(node, "IWANT",      handle_iwant,        CLASS_PULL);
+    node_register_handler(node, "DIGEST",     handle_digest,       CLASS_PULL);
+    node_register_handler(node, "STATE",      handle_state,        CLASS_DATA);
+    node_register_handler(node, "STATE_DIGEST", handle_state_digest, CLASS_PULL);
+}
+
+void node_config_defaults(node_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->fanout         = 3;
+    cfg->ttl            = 5;
+    cfg->peer_limit     = 20;
+    cfg->ping_interval  = 2;
+    cfg->peer_timeout   = 6;
+    cfg->seed           = 42;
+    cfg->max_ihave_ids  = 32;
+    cfg->compress_codec = CODEC_NONE;
+    cfg->rx_queue_depth = QUEUE_DEFAULT_DEPTH;
+    cfg->tx_queue_depth = QUEUE_DEFAULT_DEPTH;
+    cfg->store_capacity = MAX_STORED_GOSSIP;
+    cfg->gap_repair_ms  = 200;
+    cfg->state_flush_ms = 50;
+    cfg->state_sync_ms  = 1000;
+    cfg->agg_epoch_rounds = 20;
+}
+
 int node_init(node_t *node,
               int port, int fanout, int ttl, int peer_limit,
               int ping_interval, int peer_timeout, unsigned int seed,
               int pull_interval, int max_ihave_ids, int pow_difficulty) {
+    node_config_t cfg;
+    node_config_defaults(&cfg);
+    cfg.port           = port;
+    cfg.fanout         = fanout;
+    cfg.ttl            = ttl;
+    cfg.peer_limit     = peer_limit;
+    cfg.ping_interval  = ping_interval;
+    cfg.peer_timeout   = peer_timeout;
+    cfg.seed           = seed;
+    cfg.pull_interval  = pull_interval;
+    cfg.max_ihave_ids  = max_ihave_ids;
+    cfg.pow_difficulty = pow_difficulty;
+    return node_init_config(node, &cfg);
+}
+
+/* How far node_init_config() got; node_unwind() releases everything up
+ * to and including a stage, in reverse order */
+typedef enum {
+    INIT_NONE,
+    INIT_LOG,        /* event log opened */
+    INIT_TABLES,     /* seen/wm/order/state/store/metrics (free-safe when
+                        zeroed, so a partial set is released too) */
+    INIT_LOCKS,      /* node->lock, seen_lock, membership lock */
+    INIT_RX_QUEUE,
+    INIT_TX_QUEUE,
+    INIT_PACER,
+    INIT_FAULT,
+    INIT_CONTROL,
+    INIT_PROM,
+    INIT_SOCKET      /* everything */
+} init_stage_t;
+
+static void node_unwind(node_t *node, init_stage_t stage) {
+    switch (stage) {
+        case INIT_SOCKET:
+            close(node->sockfd);
+            /* fall through */
+        case INIT_PROM:
+            prom_close(node->prom);
+            node->prom = NULL;
+            /* fall through */
+        case INIT_CONTROL:
+            control_close(node->control);
+            node->control = NULL;
+            /* fall through */
+        case INIT_FAULT:
+            fault_close(node->fault);
+            node->fault = NULL;
+            /* fall through */
+        case INIT_PACER:
+            pacer_destroy(&node->pacer);
+            /* fall through */
+        case INIT_TX_QUEUE:
+            pqueue_destroy(&node->tx_queue);
+            /* fall through */
+        case INIT_RX_QUEUE:
+            pqueue_destroy(&node->rx_queue);
+            /* fall through */
+        case INIT_LOCKS:
+            pthread_mutex_destroy(&node->membership.lock);
+            pthread_mutex_destroy(&node->seen_lock);
+            pthread_mutex_destroy(&node->lock);
+            /* fall through */
+        case INIT_TABLES:
+            metrics_free(&node->metrics);
+            store_free(&node->store);
+            crdt_free(&node->state);
+            order_free(&node->order);
+            wm_free(&node->wm);
+            seen_free(&node->seen);
+            /* fall through */
+        case INIT_LOG:
+            if (node->log_file) fclose(node->log_file);
+            node->log_file = NULL;
+            /* fall through */
+        case INIT_NONE:
+            break;
+    }
+}
+
+/* Polled-delivery queue from node_subscribe_poll(), if any */
+static void free_deliveries(node_t *node) {
+    delivery_queue_t *dq = node->deliveries;
+    if (!dq) return;
+    pthread_mutex_destroy(&dq->lock);
+    pthread_cond_destroy(&dq->ready);
+    free(dq->items);
+    free(dq);
+    node->deliveries = NULL;
+}
+
+int node_init_config(node_t *node, const node_config_t *cfg) {
+    int port = cfg->port;
+    init_stage_t stage = INIT_NONE;
 
     memset(node, 0, sizeof(*node));
 
-    srand(seed);
+    srand(cfg->seed);
 
     uuid_t uuid;
     uuid_generate(uuid);
@@ -122,29 +352,96 @@ int node_init(node_t *node,
 
     snprintf(node->self_addr, ADDR_STR_LEN, "127.0.0.1:%d", port);
     node->port           = port;
-    node->fanout         = fanout;
-    node->ttl            = ttl;
-    node->ping_interval  = ping_interval;
-    node->peer_timeout   = peer_timeout;
-    node->seed           = seed;
+    node->fanout         = cfg->fanout;
+    node->ttl            = cfg->ttl;
+    node->ping_interval  = cfg->ping_interval;
+    node->peer_timeout   = cfg->peer_timeout;
+    node->seed           = cfg->seed;
     node->running        = 1;
-    node->seen_count     = 0;
-    node->gossip_store_count = 0;
-    node->pull_interval  = pull_interval;
-    node->max_ihave_ids  = (max_ihave_ids > 0) ? max_ihave_ids : 32;
-    node->pow_difficulty = pow_difficulty;
+    node->pull_interval  = cfg->pull_interval;
+    node->max_ihave_ids  = (cfg->max_ihave_ids > 0) ? cfg->max_ihave_ids : 32;
+    node->pull_ids       = cfg->pull_ids;
+    node->pow_difficulty = cfg->pow_difficulty;
+    node->compress_codec = cfg->compress_codec;
+    node->trace_origin   = cfg->trace_origin;
+    node->store_unsubscribed = 1;
+    node->gap_repair_ms  = cfg->gap_repair_ms;
+    node->state_flush_ms = (cfg->state_flush_ms > 0) ? cfg->state_flush_ms : 50;
+    node->state_sync_ms  = cfg->state_sync_ms;
+    node->agg_on         = (cfg->agg_epoch_rounds > 0);
+    agg_init(&node->agg, cfg->agg_epoch_rounds, node->node_id);
 
     char log_name[64];
-    snprintf(log_name, sizeof(log_name), "node_%d.log", port);
-    node->log_file = fopen(log_name, "w");
-    if (!node->log_file) { perror("log file"); return -1; }
-
-    node->sent_messages = 0;
+    const char *log_path = cfg->log_path;
+    if (!log_path) {
+        snprintf(log_name, sizeof(log_name), "node_%d.log", port);
+        log_path = log_name;
+    }
+    if (log_path[0]) {
+        node->log_file = fopen(log_path, "w");
+        if (!node->log_file) { perror("log file"); return -1; }
+    }
+    stage = INIT_TABLES;
+
+    if (seen_init(&node->seen, MAX_SEEN_MSGS) != 0 ||
+        wm_init(&node->wm) != 0 ||
+        order_init(&node->order, cfg->delivery_order, cfg->order_buffer,
+                   cfg->order_hold_ms) != 0 ||
+        crdt_init(&node->state) != 0 ||
+        store_init(&node->store, cfg->store_capacity > 0
+                                 ? cfg->store_capacity : MAX_STORED_GOSSIP) != 0 ||
+        metrics_init(&node->metrics) != 0) {
+        fprintf(stderr, "seen-set/watermark/order/state/store/metrics "
+                        "allocation failed\n");
+        goto fail;
+    }
+    node->metrics_interval = cfg->metrics_interval;
+    if (cfg->metrics_path)
+        snprintf(node->metrics_path, sizeof(node->metrics_path), "%s",
+                 cfg->metrics_path);
+    else
+        snprintf(node->metrics_path, sizeof(node->metrics_path),
+                 "node_%d.metrics", port);
     pthread_mutex_init(&node->lock, NULL);
-    membership_init(&node->membership, peer_limit);
+    pthread_mutex_init(&node->seen_lock, NULL);
+    membership_init(&node->membership, cfg->peer_limit);
+    stage = INIT_LOCKS;
+
+    /* pqueue_init() cleans up after itself when it fails */
+    if (pqueue_init(&node->rx_queue, cfg->rx_queue_depth) != 0) {
+        fprintf(stderr, "queue allocation failed\n");
+        goto fail;
+    }
+    stage = INIT_RX_QUEUE;
+    if (pqueue_init(&node->tx_queue, cfg->tx_queue_depth) != 0) {
+        fprintf(stderr, "queue allocation failed\n");
+        goto fail;
+    }
+    stage = INIT_TX_QUEUE;
+    pacer_init(&node->pacer, cfg->rate_limit, cfg->peer_rate);
+    stage = INIT_PACER;
+    register_builtin_handlers(node);
+
+    stage = INIT_FAULT;
+    if (cfg->fault_spec && *cfg->fault_spec) {
+        node->fault = fault_open(cfg->fault_spec, port, cfg->seed);
+        if (!node->fault) goto fail;
+    }
+
+    stage = INIT_CONTROL;
+    if (cfg->control_path) {
+        node->control = control_open(node, cfg->control_path);
+        if (!node->control) goto fail;
+    }
+    stage = INIT_PROM;
+    if (cfg->metrics_http_port > 0) {
+        node->prom = prom_open(node, cfg->metrics_http_port);
+        if (!node->prom) goto fail;
+    }
 
     node->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (node->sockfd < 0) return -1;
+    if (node->sockfd < 0) goto fail;
+    stage = INIT_SOCKET;
 
     struct sockaddr_in serv;
     memset(&serv, 0, sizeof(serv));
@@ -160,17 +457,35 @@ int node_init(node_t *node,
     setsockopt(node->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
     if (bind(node->sockfd, (struct sockaddr *)&serv, sizeof(serv)) < 0) {
-        perror("bind"); return -1;
+        perror("bind");
+        goto fail;
     }
 
     return 0;
+
+fail:
+    node_unwind(node, stage);
+    return -1;
+}
+
+void node_destroy(node_t *node) {
+    free_deliveries(node);
+    node_unwind(node, INIT_SOCKET);
 }
 
 void node_run(node_t *node) {
     pthread_create(&node->listener_thread, NULL, listener_thread_func, node);
+    pthread_create(&node->dispatch_thread, NULL, dispatch_thread_func, node);
+    pthread_create(&node->sender_thread,   NULL, sender_thread_func,   node);
     pthread_create(&node->ping_thread,     NULL, ping_thread_func,     node);
     if (node->pull_interval > 0)
         pthread_create(&node->pull_thread, NULL, pull_thread_func,     node);
+    if (node->metrics_interval > 0)
+        pthread_create(&node->metrics_thread, NULL, metrics_thread_func, node);
+    if (node->control)
+        control_start(node->control);
+    if (node->prom)
+        prom_start(node->prom);
 }
 
 void node_bootstrap(node_t *node, const char *boot_ip, int boot_port) {
@@ -210,18 +525,183 @@ void node_bootstrap(node_t *node, const char *boot_ip, int boot_port) {
     send_msg(node, &get, &boot_addr);
 }
 
+void node_set_event_handler(node_t *node, node_event_fn fn, void *ctx) {
+    node->event_fn  = fn;
+    node->event_ctx = ctx;
+}
+
+void node_state_watch(node_t *node, node_state_fn fn, void *ctx) {
+    node->state_fn  = fn;
+    node->state_ctx = ctx;
+}
+
+void node_stop(node_t *node) {
+    node->running = 0;
+    delivery_queue_t *dq = node->deliveries;
+    if (dq) {
+        pthread_mutex_lock(&dq->lock);
+        dq->closed = 1;
+        pthread_cond_broadcast(&dq->ready);
+        pthread_mutex_unlock(&dq->lock);
+    }
+}
+
 void node_cleanup(node_t *node) {
     node->running = 0;
-    close(node->sockfd);
     pthread_join(node->listener_thread, NULL);
     pthread_join(node->ping_thread, NULL);
     if (node->pull_interval > 0)
         pthread_join(node->pull_thread, NULL);
-    pthread_mutex_destroy(&node->lock);
-    if (node->log_file) fclose(node->log_file);
+    if (node->metrics_interval > 0)
+        pthread_join(node->metrics_thread, NULL);
+
+    /* Let the dispatcher and sender drain what is already queued */
+    pqueue_close(&node->rx_queue);
+    pthread_join(node->dispatch_thread, NULL);
+    node_stop(node);   /* no more deliveries; wake pollers */
+    pqueue_close(&node->tx_queue);
+    pthread_join(node->sender_thread, NULL);
+
+    if (node->fault) {
+        char line[256];
+        fault_format(node->fault, line, sizeof(line));
+        emit_event(node, NODE_EVENT_RX_STATS, "%s", line);
+    }
+
+    metrics_t *m = &node->metrics;
+    uint64_t dropped = metrics_counter_total(m, M_RX_DROPPED);
+    if (dropped > 0) {
+        char line[256];
+        size_t o = (size_t)snprintf(line, sizeof(line), "shed %llu datagrams:",
+                                    (unsigned long long)dropped);
+        for (int i = 0; i < METRICS_TYPE_SLOTS && o < sizeof(line); i++) {
+            uint64_t n = metrics_counter(m, M_RX_DROPPED, i);
+            if (n)
+                o += (size_t)snprintf(line + o, sizeof(line) - o, " %s=%llu",
+                                      metrics_type_name(i),
+                                      (unsigned long long)n);
+        }
+        emit_event(node, NODE_EVENT_RX_STATS, "%s", line);
+    }
+    uint64_t dups = metrics_counter(m, M_DUPLICATE, MSG_GOSSIP);
+    if (dups > 0)
+        emit_event(node, NODE_EVENT_RX_STATS,
+                   "%llu duplicate GOSSIP dropped", (unsigned long long)dups);
+    uint64_t asked     = metrics_counter(m, M_GAP_REQUESTED, MSG_GOSSIP);
+    uint64_t abandoned = metrics_counter(m, M_GAP_ABANDONED, MSG_GOSSIP);
+    if (asked > 0 || abandoned > 0 || node->wm.skipped > 0)
+        emit_event(node, NODE_EVENT_RX_STATS,
+                   "%d origins: %llu gaps requested, %llu abandoned, "
+                   "%llu skipped past the window", node->wm.count,
+                   (unsigned long long)asked, (unsigned long long)abandoned,
+                   (unsigned long long)node->wm.skipped);
+    if (node->order.mode != ORDER_ARRIVAL)
+        emit_event(node, NODE_EVENT_RX_STATS,
+                   "ordered delivery: %llu held back, %llu released on "
+                   "timeout/overflow, %llu late",
+                   (unsigned long long)node->order.buffered,
+                   (unsigned long long)node->order.forced,
+                   (unsigned long long)node->order.late);
+    if (node->deliveries && node->deliveries->dropped > 0)
+        emit_event(node, NODE_EVENT_RX_STATS,
+                   "%llu polled deliveries dropped (queue full)",
+                   (unsigned long long)node->deliveries->dropped);
+#ifdef GOSSIP_TRACE
+    char trace_path[64];
+    snprintf(trace_path, sizeof(trace_path), "trace_%d.json", node->port);
+    TRACE_DUMP(trace_path);
+#endif
+    node_destroy(node);
 }
 
 
+/* Refresh the eager-push mesh for topic and copy its members (other
+ * than exclude) into targets.  Members that left or lost interest are
+ * dropped; the mesh is topped up from interested peers. */
+static int mesh_targets(node_t *node, const char *topic, uint64_t bits,
+                        struct sockaddr_in *targets,
+                        struct sockaddr_in *exclude) {
+    pthread_mutex_lock(&node->lock);
+
+    topic_mesh_t *mesh = NULL;
+    int lru = 0;
+    for (int i = 0; i < node->mesh_count; i++) {
+        if (strcmp(node->meshes[i].topic, topic) == 0) {
+            mesh = &node->meshes[i];
+            break;
+        }
+        if (node->meshes[i].last_used < node->meshes[lru].last_used) lru = i;
+    }
+    if (!mesh) {
+        int idx = (node->mesh_count < MAX_MESH_TOPICS) ? node->mesh_count++ : lru;
+        mesh = &node->meshes[idx];
+        memset(mesh, 0, sizeof(*mesh));
+        strcpy(mesh->topic, topic);
+    }
+    mesh->last_used = current_time_ms();
+
+    for (int i = 0; i < mesh->count; ) {
+        if (membership_is_interested(&node->membership,
+                                     &mesh->peers[i], bits) != 1)
+            mesh->peers[i] = mesh->peers[--mesh->count];
+        else
+            i++;
+    }
+
+    if (mesh->count < node->fanout) {
+        struct sockaddr_in cand[MAX_PEERS];
+        int n = membership_get_random_filtered(&node->membership, cand,
+                                               MAX_PEERS, NULL, bits, 1);
+        for (int i = 0; i < n && mesh->count < node->fanout; i++) {
+            int dup = 0;
+            for (int j = 0; j < mesh->count && !dup; j++)
+                dup = (mesh->peers[j].sin_port == cand[i].sin_port &&
+                       mesh->peers[j].sin_addr.s_addr == cand[i].sin_addr.s_addr);
+            if (!dup) mesh->peers[mesh->count++] = cand[i];
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < mesh->count; i++) {
+        if (exclude &&
+            mesh->peers[i].sin_port == exclude->sin_port &&
+            mesh->peers[i].sin_addr.s_addr == exclude->sin_addr.s_addr)
+            continue;
+        targets[count++] = mesh->peers[i];
+    }
+
+    pthread_mutex_unlock(&node->lock);
+    return count;
+}
+
+/* ids_json/topics_json: parallel comma-separated quoted lists */
+static void send_ihave_list(node_t *node, const char *ids_json,
+                            const char *topics_json,
+                            struct sockaddr_in *dest) {
+    gossip_msg_t ihave;
+    memset(&ihave, 0, sizeof(ihave));
+    ihave.version = 1;
+    snprintf(ihave.msg_id, ID_LEN, "IHAVE_%llu",
+             (unsigned long long)current_time_ms());
+    strcpy(ihave.msg_type,    "IHAVE");
+    strcpy(ihave.sender_id,   node->node_id);
+    strcpy(ihave.sender_addr, node->self_addr);
+    ihave.timestamp_ms = current_time_ms();
+    ihave.ttl = 1;
+    snprintf(ihave.payload, MSG_BUF_SIZE,
+             "{ \"ids\": [%s], \"topics\": [%s] }", ids_json, topics_json);
+    send_msg(node, &ihave, dest);
+}
+
+/* Lazy path: tell a peer the message exists without sending it */
+static void send_ihave_one(node_t *node, gossip_msg_t *msg,
+                           struct sockaddr_in *dest) {
+    char id[ID_LEN + 2], topic[TOPIC_LEN + 2];
+    snprintf(id, sizeof(id), "\"%s\"", msg->msg_id);
+    snprintf(topic, sizeof(topic), "\"%s\"", msg->topic);
+    send_ihave_list(node, id, topic, dest);
+}
+
 void relay_gossip(node_t *node, gossip_msg_t *msg, struct sockaddr_in *exclude) {
     if (msg->ttl <= 0) return;
 
@@ -229,44 +709,549 @@ void relay_gossip(node_t *node, gossip_msg_t *msg, struct sockaddr_in *exclude)
     relay.ttl--;
 
     struct sockaddr_in targets[MAX_PEERS];
-    int count = membership_get_random(&node->membership, targets,
-                                      node->fanout, exclude);
-    for (int i = 0; i < count; i++) {
-        send_msg(node, &relay, &targets[i]);
+
+    if (!msg->topic[0]) {
+        /* No topic: plain random fanout */
+        int count = membership_get_random(&node->membership, targets,
+                                          node->fanout, exclude);
+        for (int i = 0; i < count; i++)
+            send_gossip(node, &relay, &targets[i]);
+        return;
+    }
+
+    /* Eager push to the topic mesh ... */
+    uint64_t bits = topic_bits(msg->topic);
+    int count = mesh_targets(node, msg->topic, bits, targets, exclude);
+    for (int i = 0; i < count; i++)
+        send_gossip(node, &relay, &targets[i]);
+
+    /* ... metadata only for peers outside it */
+    struct sockaddr_in lazy[MAX_PEERS];
+    int n = membership_get_random(&node->membership, lazy, MAX_PEERS, exclude);
+    int sent = 0;
+    for (int i = 0; i < n && sent < node->fanout; i++) {
+        int in_mesh = 0;
+        for (int j = 0; j < count && !in_mesh; j++)
+            in_mesh = (targets[j].sin_port == lazy[i].sin_port &&
+                       targets[j].sin_addr.s_addr == lazy[i].sin_addr.s_addr);
+        if (in_mesh) continue;
+        send_ihave_one(node, msg, &lazy[i]);
+        sent++;
     }
 }
 
 /* =========================================================
- * Listener thread
+ * Application API
  * ========================================================= */
 
+int node_subscribe(node_t *node, const char *topic,
+                   gossip_deliver_fn fn, void *ctx) {
+    if (!fn || !msg_topic_valid(topic)) return -1;
+
+    pthread_mutex_lock(&node->lock);
+    for (int i = 0; i < node->sub_count; i++) {
+        if (strcmp(node->subs[i].topic, topic) == 0 &&
+            node->subs[i].fn == fn) {
+            node->subs[i].ctx = ctx;
+            pthread_mutex_unlock(&node->lock);
+            return 0;
+        }
+    }
+    if (node->sub_count == MAX_SUBSCRIPTIONS) {
+        pthread_mutex_unlock(&node->lock);
+        return -1;
+    }
+    subscription_t *sub = &node->subs[node->sub_count++];
+    strcpy(sub->topic, topic);
+    sub->fn  = fn;
+    sub->ctx = ctx;
+    pthread_mutex_unlock(&node->lock);
+    return 0;
+}
+
+int node_unsubscribe(node_t *node, const char *topic) {
+    int rc = -1;
+    pthread_mutex_lock(&node->lock);
+    for (int i = 0; i < node->sub_count; ) {
+        if (strcmp(node->subs[i].topic, topic) == 0) {
+            node->subs[i] = node->subs[--node->sub_count];
+            rc = 0;
+        } else {
+            i++;
+        }
+    }
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_unsubscribe_fn(node_t *node, const char *topic,
+                        gossip_deliver_fn fn, void *ctx) {
+    int rc = -1;
+    pthread_mutex_lock(&node->lock);
+    for (int i = 0; i < node->sub_count; i++) {
+        if (strcmp(node->subs[i].topic, topic) == 0 &&
+            node->subs[i].fn == fn && node->subs[i].ctx == ctx) {
+            node->subs[i] = node->subs[--node->sub_count];
+            rc = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+/* Collect subscriptions matching topic (caller holds node->lock) */
+static int match_subscriptions(node_t *node, const char *topic,
+                               subscription_t *out) {
+    int n = 0;
+    for (int i = 0; i < node->sub_count; i++) {
+        if (strcmp(node->subs[i].topic, TOPIC_WILDCARD) != 0 &&
+            strcmp(node->subs[i].topic, topic) != 0)
+            continue;
+        /* A callback runs once per message even if several of its
+         * subscriptions match (e.g. "*" and the exact topic). */
+        int dup = 0;
+        for (int j = 0; j < n && !dup; j++)
+            dup = out[j].fn == node->subs[i].fn &&
+                  out[j].ctx == node->subs[i].ctx;
+        if (!dup) out[n++] = node->subs[i];
+    }
+    return n;
+}
+
+uint64_t node_topic_mask(node_t *node) {
+    uint64_t mask = 0;
+    pthread_mutex_lock(&node->lock);
+    for (int i = 0; i < node->sub_count; i++) {
+        if (strcmp(node->subs[i].topic, TOPIC_WILDCARD) == 0) {
+            mask = ~0ull;
+            break;
+        }
+        mask |= topic_bits(node->subs[i].topic);
+    }
+    pthread_mutex_unlock(&node->lock);
+    return mask;
+}
+
+int node_wants_topic(node_t *node, const char *topic) {
+    if (!topic[0]) return 1;
+    subscription_t matched[MAX_SUBSCRIPTIONS];
+    pthread_mutex_lock(&node->lock);
+    int n = match_subscriptions(node, topic, matched);
+    pthread_mutex_unlock(&node->lock);
+    return n > 0;
+}
+
+/* Copy s into a JSON string body, escaping quotes/backslashes/controls */
+static void json_escape(const char *s, char *out, size_t out_size) {
+    size_t o = 0;
+    for (; *s && o + 7 < out_size; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[o++] = '\\';
+            out[o++] = (char)c;
+        } else if (c < 0x20) {
+            o += (size_t)snprintf(out + o, out_size - o, "\\u%04x", c);
+        } else {
+            out[o++] = (char)c;
+        }
+    }
+    out[o] = '\0';
+}
+
+int node_publish(node_t *node, const char *topic, const char *data,
+                 char *msg_id_out) {
+    if (!msg_topic_valid(topic)) return -1;
+
+    gossip_msg_t m;
+    memset(&m, 0, sizeof(m));
+    m.version = 1;
+    m.type    = MSG_GOSSIP;
+    /* Per-origin sequence number: receivers spot a gap as soon as a
+     * later one arrives (see watermark.h) */
+    pthread_mutex_lock(&node->lock);
+    uint64_t seq = ++node->publish_seq;
+    order_deps(&node->order, &node->wm, node->node_id, m.deps, sizeof(m.deps));
+    pthread_mutex_unlock(&node->lock);
+    snprintf(m.msg_id, ID_LEN, "%s_%llu",
+             node->node_id, (unsigned long long)seq);
+    strcpy(m.msg_type,    "GOSSIP");
+    strcpy(m.sender_id,   node->node_id);
+    strcpy(m.sender_addr, node->self_addr);
+    strcpy(m.topic,       topic);
+    m.timestamp_ms = current_time_ms();
+    m.ttl = node->ttl;
+    if (node->trace_origin) {
+        m.origin_ttl = node->ttl;
+        m.origin_us  = wall_time_us();
+    }
+
+    char escaped[MSG_BUF_SIZE - 64];
+    json_escape(data, escaped, sizeof(escaped));
+    snprintf(m.payload, MSG_BUF_SIZE,
+             "{ \"topic\": \"%s\", \"data\": \"%s\" }", topic, escaped);
+    node_compress_payload(node, &m);
+
+    pthread_mutex_lock(&node->lock);
+    mark_seen(node, m.msg_id, NULL);
+    store_gossip(node, &m);
+    pthread_mutex_unlock(&node->lock);
+
+    log_event(node, "SEND", m.msg_type, m.msg_id);
+    relay_gossip(node, &m, NULL);
+
+    if (msg_id_out) strcpy(msg_id_out, m.msg_id);
+    return 0;
+}
+
+int node_agg_set(node_t *node, const char *name, double value) {
+    pthread_mutex_lock(&node->lock);
+    int rc = agg_set(&node->agg, name, value);
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_agg_get(node_t *node, const char *name, agg_result_t *out) {
+    if (!node->agg_on) return -1;
+    pthread_mutex_lock(&node->lock);
+    int rc = agg_result(&node->agg, name, out);
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_agg_names(node_t *node, char (*names)[AGG_NAME_LEN], int max) {
+    pthread_mutex_lock(&node->lock);
+    int n = 0;
+    for (; n < node->agg.count && n < max; n++)
+        strcpy(names[n], node->agg.vals[n].name);
+    pthread_mutex_unlock(&node->lock);
+    return n;
+}
+
+int node_cluster_size(node_t *node, double *size) {
+    if (!node->agg_on) return -1;
+    pthread_mutex_lock(&node->lock);
+    int rc = agg_cluster_size(&node->agg, size);
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_state_set(node_t *node, const char *key, const char *value) {
+    if (!value) return -1;
+    pthread_mutex_lock(&node->lock);
+    int rc = crdt_set(&node->state, node->node_id, key, value);
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_state_delete(node_t *node, const char *key) {
+    pthread_mutex_lock(&node->lock);
+    int rc = crdt_set(&node->state, node->node_id, key, NULL);
+    pthread_mutex_unlock(&node->lock);
+    return rc;
+}
+
+int node_state_get(node_t *node, const char *key, char *value, size_t size) {
+    pthread_mutex_lock(&node->lock);
+    const crdt_entry_t *e = crdt_get(&node->state, key);
+    if (e) snprintf(value, size, "%s", e->value);
+    pthread_mutex_unlock(&node->lock);
+    return e ? 0 : -1;
+}
+
+uint64_t node_origin_watermark(node_t *node, const char *origin) {
+    pthread_mutex_lock(&node->lock);
+    uint64_t w = wm_watermark(&node->wm, origin);
+    pthread_mutex_unlock(&node->lock);
+    return w;
+}
+
+/* Delivery callback behind node_subscribe_poll(): copy into the queue,
+ * dropping the message if the application is not keeping up. */
+static void enqueue_delivery(node_t *node, const gossip_msg_t *msg,
+                             const char *payload, void *ctx) {
+    delivery_queue_t *dq = ctx;
+    (void)node;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->closed || dq->count == DELIVERY_QUEUE_DEPTH) {
+        dq->dropped++;
+        pthread_mutex_unlock(&dq->lock);
+        return;
+    }
+    gossip_delivery_t *d =
+        &dq->items[(dq->head + dq->count) % DELIVERY_QUEUE_DEPTH];
+    snprintf(d->msg_id, sizeof(d->msg_id), "%s", msg->msg_id);
+    snprintf(d->topic, sizeof(d->topic), "%s", msg->topic);
+    snprintf(d->sender_addr, sizeof(d->sender_addr), "%s", msg->sender_addr);
+    d->timestamp_ms = msg->timestamp_ms;
+    snprintf(d->payload, sizeof(d->payload), "%s", payload);
+    dq->count++;
+    pthread_cond_signal(&dq->ready);
+    pthread_mutex_unlock(&dq->lock);
+}
+
+int node_subscribe_poll(node_t *node, const char *topic) {
+    if (!node->deliveries) {
+        delivery_queue_t *dq = calloc(1, sizeof(*dq));
+        if (!dq) return -1;
+        dq->items = calloc(DELIVERY_QUEUE_DEPTH, sizeof(*dq->items));
+        if (!dq->items) { free(dq); return -1; }
+        pthread_mutex_init(&dq->lock, NULL);
+        pthread_cond_init(&dq->ready, NULL);
+        node->deliveries = dq;
+    }
+    return node_subscribe(node, topic, enqueue_delivery, node->deliveries);
+}
+
+int node_poll(node_t *node, gossip_delivery_t *out, int max, int timeout_ms) {
+    delivery_queue_t *dq = node->deliveries;
+    if (!dq || max <= 0) return node->running ? 0 : -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->count == 0 && !dq->closed && timeout_ms > 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (dq->count == 0 && !dq->closed)
+            if (pthread_cond_timedwait(&dq->ready, &dq->lock,
+                                       &deadline) != 0)
+                break;
+    }
+    int n = 0;
+    while (n < max && dq->count > 0) {
+        out[n++] = dq->items[dq->head];
+        dq->head = (dq->head + 1) % DELIVERY_QUEUE_DEPTH;
+        dq->count--;
+    }
+    if (n == 0 && dq->closed) n = -1;
+    pthread_mutex_unlock(&dq->lock);
+    return n;
+}
+
+/* =========================================================
+ * Listener thread – receive only; classify, shed and enqueue
+ * ========================================================= */
+
+/* Traffic we can lose without hurting delivery: IHAVE and DIGEST are
+ * advisory and the next pull round repeats them.
+ * (Already-seen GOSSIP never gets this far, see rx_is_duplicate.) */
+static int rx_is_redundant(int type) {
+    return type == MSG_IHAVE || type == MSG_DIGEST;
+}
+
+/* Duplicate GOSSIP outnumber new ones by the fanout factor, so check the
+ * seen-set on the peeked msg_id before paying for a full parse. */
+static int rx_is_duplicate(node_t *node, int type, const char *msg_id) {
+    if (type != MSG_GOSSIP) return 0;
+    pthread_mutex_lock(&node->seen_lock);
+    int seen = is_seen(node, msg_id);
+    pthread_mutex_unlock(&node->seen_lock);
+    return seen;
+}
+
 void* listener_thread_func(void *arg) {
     node_t *node = (node_t *)arg;
 
     struct sockaddr_in sender;
     socklen_t len = sizeof(sender);
     char recv_buf[MAX_SERIALIZED_LEN];
+    TRACE_THREAD("listener");
 
     while (node->running) {
+        len = sizeof(sender);
         ssize_t rec = recvfrom(node->sockfd, recv_buf,
                                sizeof(recv_buf) - 1, 0,
                                (struct sockaddr *)&sender, &len);
         if (rec <= 0) continue;
         recv_buf[rec] = '\0';
 
+        char id[ID_LEN], type[MSG_TYPE_LEN];
+        TRACE_BEGIN(t_peek);
+        if (wire_peek_header(recv_buf, id, sizeof(id),
+                             type, sizeof(type)) != 0 &&
+            (wire_peek_field(recv_buf, "msg_type", type, sizeof(type)) != 0 ||
+             wire_peek_field(recv_buf, "msg_id", id, sizeof(id)) != 0))
+            continue;
+        TRACE_END(t_peek, TP_PEEK);
+
+        int tid = msg_type_lookup(type);
+        metrics_add(&node->metrics, M_RECEIVED_BYTES, tid, (uint64_t)rec);
+        if (tid == MSG_UNKNOWN || !node->handlers[tid]) {
+            metrics_count(&node->metrics, M_RX_DROPPED, MSG_UNKNOWN);
+            continue;
+        }
+        TRACE_BEGIN(t_dedup);
+        int dup = rx_is_duplicate(node, tid, id);
+        TRACE_END(t_dedup, TP_RX_DEDUP);
+        if (dup) {
+            metrics_count(&node->metrics, M_DUPLICATE, tid);
+            continue;
+        }
+
+        /* Past the watermark, shed duplicate-prone traffic up front */
+        int pending = pqueue_pending(&node->rx_queue);
+        if (pending * 100 >= pqueue_limit(&node->rx_queue) * RX_SHED_WATERMARK &&
+            rx_is_redundant(tid)) {
+            metrics_count(&node->metrics, M_RX_DROPPED, tid);
+            continue;
+        }
+
+        /* Full queue: evict lower-priority traffic, or drop this one */
+        int evicted;
+        if (pqueue_push_shed(&node->rx_queue, msg_class(tid),
+                             recv_buf, (int)rec + 1, &sender,
+                             tid, &evicted) != 0)
+            metrics_count(&node->metrics, M_RX_DROPPED, tid);
+        if (evicted >= 0)
+            metrics_count(&node->metrics, M_RX_DROPPED, evicted);
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Dispatch thread – serves the ingress queue by priority
+ * ========================================================= */
+
+static void repair_gaps(node_t *node);
+static void release_ordered(node_t *node);
+static void flush_state(node_t *node);
+static void sync_state(node_t *node);
+
+void* dispatch_thread_func(void *arg) {
+    node_t *node = (node_t *)arg;
+    packet_t *pkt = malloc(sizeof(*pkt));
+    if (!pkt) return NULL;
+    TRACE_THREAD("dispatcher");
+
+    /* Sequence gaps are checked a few times per repair delay, and held
+     * ordered deliveries a few times per hold limit */
+    int scan_ms = node->gap_repair_ms / 4;
+    if (scan_ms < 5) scan_ms = 5;
+    int order_ms = (int)(node->order.hold_us / 4000);
+    if (order_ms < 5) order_ms = 5;
+
+    for (;;) {
+        int timeout_ms = 500;
+        if (node->gap_repair_ms > 0) {
+            uint64_t now = current_time_us();
+            if (now >= node->next_gap_scan_us) {
+                repair_gaps(node);
+                node->next_gap_scan_us = now + (uint64_t)scan_ms * 1000;
+            }
+            timeout_ms = scan_ms;
+        }
+        if (node->order.count > 0) {
+            uint64_t now = current_time_us();
+            if (now >= node->next_order_scan_us) {
+                release_ordered(node);
+                node->next_order_scan_us = now + (uint64_t)order_ms * 1000;
+            }
+            if (timeout_ms > order_ms) timeout_ms = order_ms;
+        }
+        /* Replicated state: batched deltas, then periodic digests */
+        uint64_t now = current_time_us();
+        if (now >= node->next_state_flush_us) {
+            flush_state(node);
+            node->next_state_flush_us =
+                now + (uint64_t)node->state_flush_ms * 1000;
+        }
+        if (node->state_sync_ms > 0 && now >= node->next_state_sync_us) {
+            sync_state(node);
+            node->next_state_sync_us =
+                now + (uint64_t)node->state_sync_ms * 1000;
+        }
+        if (timeout_ms > node->state_flush_ms)
+            timeout_ms = node->state_flush_ms;
+        if (pqueue_pop(&node->rx_queue, pkt, timeout_ms) < 0) {
+            if (!node->running) break;
+            continue;
+        }
+
         gossip_msg_t msg;
         memset(&msg, 0, sizeof(msg));
-        if (deserialize_message(recv_buf, &msg) != 0) continue;
+        TRACE_BEGIN(t_parse);
+        int rc = deserialize_message(pkt->data, &msg);
+        TRACE_END(t_parse, TP_DESERIALIZE);
+        if (rc != 0) continue;
+        if (msg.type != MSG_UNKNOWN && node->handlers[msg.type]) {
+            metrics_count(&node->metrics, M_RECEIVED, msg.type);
+            node->dispatch_queued_us = pkt->queued_us;
+            TRACE_BEGIN(t_handle);
+            node->handlers[msg.type](node, &msg, &pkt->addr);
+            TRACE_END(t_handle, TP_HANDLE);
+        }
+    }
+    free(pkt);
+    return NULL;
+}
+
+/* =========================================================
+ * Sender thread – drains the egress queue by priority
+ * ========================================================= */
+
+void* sender_thread_func(void *arg) {
+    node_t *node = (node_t *)arg;
+    packet_t *pkt = malloc(sizeof(*pkt));
+    if (!pkt) return NULL;
+    TRACE_THREAD("sender");
+
+    int      blocked = 0;   /* packets requeued in a row, none sent since */
+    uint64_t soonest = 0;   /* shortest wait among them */
+    for (;;) {
+        /* Wake up in time for the next datagram the fault layer holds */
+        int timeout_ms = 500;
+        if (node->fault) {
+            uint64_t due = fault_flush(node->fault, node->sockfd);
+            if (due < 500000) timeout_ms = (int)((due + 999) / 1000);
+        }
+        int cls = pqueue_pop(&node->tx_queue, pkt, timeout_ms);
+        if (cls < 0) {
+            if (!node->running) break;
+            continue;
+        }
 
-        if      (strcmp(msg.msg_type, "HELLO")      == 0) handle_hello(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "GET_PEERS")  == 0) handle_get_peers(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "PEERS_LIST") == 0) handle_peers_list(node, &msg);
-        else if (strcmp(msg.msg_type, "GOSSIP")     == 0) handle_gossip(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "PING")        == 0) handle_ping(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "PONG")        == 0) handle_pong(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "IHAVE")       == 0) handle_ihave(node, &msg, &sender);
-        else if (strcmp(msg.msg_type, "IWANT")       == 0) handle_iwant(node, &msg, &sender);
+        /* Control traffic is never held back, but still spends tokens */
+        int peer_limited = 0;
+        uint64_t wait = pacer_delay_us(&node->pacer, &pkt->addr,
+                                       &peer_limited);
+        if (wait > 0 && cls != CLASS_CONTROL) {
+            int pending = pqueue_pending(&node->tx_queue);
+            if (peer_limited && pending > 0) {
+                /* Don't let one throttled peer block the others:
+                 * requeue at the tail of its class and move on.  Only
+                 * once every queued packet came round blocked is there
+                 * nothing to send until the first of them is due. */
+                if (blocked == 0 || wait < soonest) soonest = wait;
+                if (++blocked > pending) {
+                    sleep_us(soonest);
+                    blocked = 0;
+                }
+                if (pqueue_push(&node->tx_queue, (traffic_class_t)cls,
+                                pkt->data, pkt->len, &pkt->addr,
+                                pkt->tag) == 0)
+                    continue;
+            }
+            sleep_us(wait);
+        }
+        blocked = 0;
+
+        TRACE_BEGIN(t);
+        if (node->fault)
+            fault_send(node->fault, node->sockfd, pkt->data, pkt->len,
+                       &pkt->addr);
+        else
+            sendto(node->sockfd, pkt->data, (size_t)pkt->len, 0,
+                   (struct sockaddr *)&pkt->addr, sizeof(struct sockaddr_in));
+        TRACE_END(t, TP_SEND);
+        pacer_consume(&node->pacer, &pkt->addr);
     }
+    free(pkt);
     return NULL;
 }
 
@@ -279,7 +1264,8 @@ void handle_hello(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
     if (!node_verify_hello_pow(node, msg)) return;
 
     membership_add(&node->membership, *sender);
-    printf("[HELLO] from %s\n> ", msg->sender_addr);
+    note_advert(node, msg, sender);
+    emit_event(node, NODE_EVENT_PEER_JOINED, "%s", msg->sender_addr);
 
     /* Respond with our peer list */
     handle_get_peers(node, msg, sender);
@@ -343,27 +1329,142 @@ void handle_peers_list(node_t *node, gossip_msg_t *msg) {
     }
 }
 
+static void deliver(node_t *node, const gossip_msg_t *msg,
+                    const subscription_t *subs, int n) {
+    /* Expand a compressed payload for delivery only; the store and
+     * relays keep the compressed form. */
+    char plain[MSG_BUF_SIZE];
+    const char *body = msg->payload;
+    if (payload_decompress(msg->payload, plain, sizeof(plain)) > 0)
+        body = plain;
+    for (int i = 0; i < n; i++)
+        subs[i].fn(node, msg, body, subs[i].ctx);
+}
+
+/* Deliver what the ordering buffer can release now (dispatcher only) */
+static void release_ordered(node_t *node) {
+    enum { BATCH = 16 };
+    gossip_msg_t  *ready[BATCH];
+    subscription_t matched[MAX_SUBSCRIPTIONS];
+    int n;
+    do {
+        pthread_mutex_lock(&node->lock);
+        n = order_release(&node->order, &node->wm, current_time_us(),
+                          ready, BATCH);
+        pthread_mutex_unlock(&node->lock);
+        for (int i = 0; i < n; i++) {
+            pthread_mutex_lock(&node->lock);
+            int k = match_subscriptions(node, ready[i]->topic, matched);
+            pthread_mutex_unlock(&node->lock);
+            if (k > 0) deliver(node, ready[i], matched, k);
+            free(ready[i]);
+        }
+    } while (n == BATCH);
+}
+
+/* First receipt of a traced GOSSIP: end-to-end latency and hop count.
+ * Relays decrement ttl once per hop, so hops = origin_ttl - ttl. */
+static void record_propagation(node_t *node, const gossip_msg_t *msg) {
+    if (msg->origin_ttl <= 0) return;
+    int hops = msg->origin_ttl - msg->ttl;
+    if (hops < 1) return;
+
+    uint64_t now = wall_time_us();
+    metrics_observe(&node->metrics, H_HOPS, (uint64_t)hops);
+    if (now < msg->origin_us) return;   /* clocks disagree */
+    uint64_t latency = now - msg->origin_us;
+    metrics_observe(&node->metrics, H_E2E_US, latency);
+    metrics_observe(&node->metrics, H_HOP_US, latency / (uint64_t)hops);
+}
+
 void handle_gossip(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
+    subscription_t matched[MAX_SUBSCRIPTIONS];
+
     pthread_mutex_lock(&node->lock);
 
-    if (mark_seen(node, msg->msg_id)) {
+    TRACE_BEGIN(t_dedup);
+    int seen = mark_seen(node, msg->msg_id, sender);
+    TRACE_END(t_dedup, TP_DEDUP);
+    if (seen) {
         /* Already seen – drop */
         pthread_mutex_unlock(&node->lock);
+        metrics_count(&node->metrics, M_DUPLICATE, MSG_GOSSIP);
         return;
     }
 
     /* New message */
-    printf("\n[GOSSIP] %s from %s\n> ", msg->payload, msg->sender_addr);
     log_event(node, "RECEIVE", msg->msg_type, msg->msg_id);
-    store_gossip(node, msg);
+    record_propagation(node, msg);
+    int n = match_subscriptions(node, msg->topic, matched);
+    if (n > 0 || node->store_unsubscribed) {
+        TRACE_BEGIN(t_store);
+        store_gossip(node, msg);
+        TRACE_END(t_store, TP_STORE);
+    }
+    /* 0: held for ordered delivery, -1: too late to deliver in order */
+    int now_ok = (n > 0) ? order_offer(&node->order, &node->wm, msg,
+                                       current_time_us()) : 0;
 
     pthread_mutex_unlock(&node->lock);
 
+    TRACE_BEGIN(t_relay);
     relay_gossip(node, msg, sender);
+    TRACE_END(t_relay, TP_RELAY);
+    metrics_observe(&node->metrics, H_RELAY_US,
+                    current_time_us() - node->dispatch_queued_us);
+    if (now_ok > 0) deliver(node, msg, matched, n);
+    if (node->order.count > 0) release_ordered(node);
+}
+
+/* ---- Aggregation ---- */
+
+/* One-line summary of the last completed epoch (node->lock held) */
+static void agg_summary(node_t *node, char *buf, size_t size) {
+    const agg_state_t *a = &node->agg;
+    int n = snprintf(buf, size, "epoch %llu: size %.1f",
+                     (unsigned long long)a->result_epoch, a->result_size);
+    for (int i = 0; i < a->count && n >= 0 && (size_t)n < size; i++) {
+        const agg_result_t *r = &a->results[i];
+        n += snprintf(buf + n, size - (size_t)n,
+                      "; %s n=%.1f sum=%.4g avg=%.4g max=%.4g",
+                      a->vals[i].name, r->n, r->sum, r->avg, r->max);
+    }
+}
+
+/* Push-sum step: with payload NULL, count a PING round and, for
+ * parts >= 2, write ", <share>" for parts - 1 PING targets into share
+ * (left empty otherwise); else merge the share in a received PING.
+ * Shares ride on PINGs only, never on PONGs. */
+static void agg_exchange(node_t *node, const char *payload, int parts,
+                         char *share, size_t size) {
+    if (share) share[0] = '\0';
+    if (!node->agg_on) return;
+
+    char done[256];
+    pthread_mutex_lock(&node->lock);
+    uint64_t prev = node->agg.result_epoch;
+    if (payload) {
+        agg_merge(&node->agg, payload);
+    } else {
+        agg_round(&node->agg);
+        if (parts >= 2 &&
+            agg_share(&node->agg, parts, share + 2, size - 2) == 0)
+            memcpy(share, ", ", 2);
+    }
+    int finished = node->agg.result_epoch != prev;
+    if (finished) agg_summary(node, done, sizeof(done));
+    pthread_mutex_unlock(&node->lock);
+
+    if (finished) emit_event(node, NODE_EVENT_AGGREGATE, "%s", done);
 }
 
 void handle_ping(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
     membership_add(&node->membership, *sender);
+    note_advert(node, msg, sender);
+
+    char advert[256];
+    build_advert(node, advert, sizeof(advert));
+    agg_exchange(node, msg->payload, 0, NULL, 0);
 
     gossip_msg_t pong;
     memset(&pong, 0, sizeof(pong));
@@ -376,126 +1477,644 @@ void handle_ping(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
     pong.timestamp_ms = current_time_ms();
     pong.ttl = 1;
     snprintf(pong.payload, MSG_BUF_SIZE,
-             "{ \"reply_to\": \"%s\" }", msg->msg_id);
+             "{ \"reply_to\": \"%s\", %s }", msg->msg_id, advert);
     send_msg(node, &pong, sender);
 }
 
 void handle_pong(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
-    (void)msg;
+    pacer_note_pong(&node->pacer);
+
+    static const char key[] = "\"reply_to\": \"PING_";
+    const char *r = strstr(msg->payload, key);
+    if (r) {
+        uint64_t sent = strtoull(r + sizeof(key) - 1, NULL, 10);
+        uint64_t now  = current_time_us();
+        if (sent > 0 && sent <= now)
+            metrics_observe(&node->metrics, H_PING_RTT_US, now - sent);
+    }
     membership_add(&node->membership, *sender);
+    note_advert(node, msg, sender);
 }
 
 /* ---- Hybrid Push-Pull ---- */
 
+/* Read the next string of a JSON string array.  Returns the position
+ * after it, or NULL at the closing ']' / end of input. */
+static const char *next_json_string(const char *p, char *out, size_t size) {
+    while (*p == ' ' || *p == ',' || *p == '\n') p++;
+    if (*p != '"') return NULL;
+    p++;
+    size_t i = 0;
+    while (*p && *p != '"') {
+        if (i < size - 1) out[i++] = *p;
+        p++;
+    }
+    out[i] = '\0';
+    return (*p == '"') ? p + 1 : NULL;
+}
+
+/* Position just inside the '[' of the array named key, or NULL */
+static const char *json_array(const char *payload, const char *key) {
+    const char *p = strstr(payload, key);
+    if (!p) return NULL;
+    p = strchr(p, '[');
+    return p ? p + 1 : NULL;
+}
+
+/* list: comma-separated quoted ids ("ids") or ranges ("ranges") */
+static void send_iwant(node_t *node, const char *key, const char *list,
+                       struct sockaddr_in *dest) {
+    gossip_msg_t iwant;
+    memset(&iwant, 0, sizeof(iwant));
+    iwant.version = 1;
+    snprintf(iwant.msg_id, ID_LEN, "IWANT_%llu",
+             (unsigned long long)current_time_ms());
+    strcpy(iwant.msg_type,    "IWANT");
+    strcpy(iwant.sender_id,   node->node_id);
+    strcpy(iwant.sender_addr, node->self_addr);
+    iwant.timestamp_ms = current_time_ms();
+    iwant.ttl = 1;
+    snprintf(iwant.payload, MSG_BUF_SIZE, "{ \"%s\": [%s] }", key, list);
+    send_msg(node, &iwant, dest);
+}
+
 void handle_ihave(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
     /*
      * Parse the "ids" array from the payload and collect any IDs we
-     * haven't seen yet, then send IWANT if there are any.
+     * haven't seen yet, then send IWANT if there are any.  When the
+     * optional parallel "topics" array is present, IDs on topics we
+     * don't subscribe to are ignored.
      */
     char want_ids[MSG_BUF_SIZE] = "";
     int  want_count = 0;
 
-    char *p = strstr(msg->payload, "\"ids\":");
-    if (!p) return;
-    p = strchr(p, '[');
+    const char *p = json_array(msg->payload, "\"ids\":");
     if (!p) return;
-    p++;  /* skip '[' */
-
-    while (*p && *p != ']') {
-        /* Skip whitespace and commas */
-        while (*p == ' ' || *p == ',' || *p == '\n') p++;
-        if (*p == ']' || *p == '\0') break;
-        if (*p == '"') {
-            p++;
-            char id[ID_LEN] = {0};
-            int i = 0;
-            while (*p && *p != '"' && i < ID_LEN - 1)
-                id[i++] = *p++;
-            if (*p == '"') p++;
-
-            /* Check if we already have it */
-            pthread_mutex_lock(&node->lock);
-            int have = 0;
-            int limit = (node->seen_count < MAX_SEEN_MSGS)
-                        ? node->seen_count : MAX_SEEN_MSGS;
-            for (int j = 0; j < limit; j++) {
-                if (strcmp(node->seen_ids[j % MAX_SEEN_MSGS], id) == 0) {
-                    have = 1; break;
-                }
+    const char *t = json_array(msg->payload, "\"topics\":");
+
+    char id[ID_LEN];
+    while ((p = next_json_string(p, id, sizeof(id))) != NULL) {
+        char topic[TOPIC_LEN] = "";
+        if (t) t = next_json_string(t, topic, sizeof(topic));
+        if (!node_wants_topic(node, topic)) {
+            /* Exists but isn't for us: don't hold the watermark for it */
+            char origin[NODE_ID_LEN];
+            uint64_t seq;
+            if (wm_parse_id(id, origin, sizeof(origin), &seq) == 0) {
+                pthread_mutex_lock(&node->lock);
+                pthread_mutex_lock(&node->seen_lock);
+                wm_skip(&node->wm, origin, seq, current_time_us());
+                pthread_mutex_unlock(&node->seen_lock);
+                pthread_mutex_unlock(&node->lock);
             }
-            pthread_mutex_unlock(&node->lock);
+            continue;
+        }
 
-            if (!have) {
-                /* Append to want list */
-                if (want_count > 0)
-                    strncat(want_ids, ",",
-                            sizeof(want_ids) - strlen(want_ids) - 1);
-                char quoted[ID_LEN + 4];
-                snprintf(quoted, sizeof(quoted), "\"%s\"", id);
-                strncat(want_ids, quoted,
+        /* Check if we already have it */
+        pthread_mutex_lock(&node->lock);
+        int have = is_seen(node, id);
+        pthread_mutex_unlock(&node->lock);
+
+        if (!have) {
+            /* Append to want list */
+            if (want_count > 0)
+                strncat(want_ids, ",",
                         sizeof(want_ids) - strlen(want_ids) - 1);
-                want_count++;
-            }
-        } else {
-            p++;
+            char quoted[ID_LEN + 4];
+            snprintf(quoted, sizeof(quoted), "\"%s\"", id);
+            strncat(want_ids, quoted,
+                    sizeof(want_ids) - strlen(want_ids) - 1);
+            want_count++;
         }
     }
 
     if (want_count == 0) return;
+    send_iwant(node, "ids", want_ids, sender);
+}
 
-    gossip_msg_t iwant;
-    memset(&iwant, 0, sizeof(iwant));
-    iwant.version = 1;
-    snprintf(iwant.msg_id, ID_LEN, "IWANT_%llu",
-             (unsigned long long)current_time_ms());
-    strcpy(iwant.msg_type,    "IWANT");
-    strcpy(iwant.sender_id,   node->node_id);
-    strcpy(iwant.sender_addr, node->self_addr);
-    iwant.timestamp_ms = current_time_ms();
-    iwant.ttl = 1;
-    snprintf(iwant.payload, MSG_BUF_SIZE,
-             "{ \"ids\": [%s] }", want_ids);
-    send_msg(node, &iwant, sender);
+/* Gap repair and digests ask for every seq they are missing, including
+ * topics the requester does not subscribe to; those are answered with
+ * one IHAVE instead */
+typedef struct {
+    char ids[MSG_BUF_SIZE / 2];
+    char topics[MSG_BUF_SIZE / 2];
+    int  count;
+} iwant_skips_t;
+
+/* Ids one IWANT may make us look up; a DIGEST never asks for more */
+#define IWANT_MAX_IDS WM_WINDOW
+
+/* Stored messages sent back for one IWANT: what an IHAVE or a gap repair
+ * round asks for (max_ihave_ids), and at most a quarter of the tx queue
+ * so a catch-up burst leaves room for relays and PONGs.  Whatever is
+ * left over gets asked for again on the requester's next DIGEST round. */
+static int iwant_budget(node_t *node) {
+    int budget = pqueue_limit(&node->tx_queue) / 4;
+    if (budget > node->max_ihave_ids) budget = node->max_ihave_ids;
+    return (budget > 0) ? budget : 1;
+}
+
+/* Send the stored message id to sender, if we still hold it.  Returns 1
+ * if a GOSSIP went out.  lost: the requester saw the id announced (IHAVE)
+ * or skipped (gap repair) and did not get it, which the pacer counts as
+ * loss; catching up from a DIGEST is not. */
+static int serve_iwant_id(node_t *node, const char *id,
+                          struct sockaddr_in *sender, iwant_skips_t *skips,
+                          int lost) {
+    /* Copy it out under the lock; its slot may be reused right after */
+    char wire[MAX_SERIALIZED_LEN];
+    char topic[TOPIC_LEN];
+    int  codec = CODEC_NONE, found = 0;
+    pthread_mutex_lock(&node->lock);
+    stored_gossip_t *sg = find_stored(node, id);
+    if (sg) {
+        memcpy(wire, sg->serialized, strlen(sg->serialized) + 1);
+        memcpy(topic, sg->topic, sizeof(topic));
+        codec = sg->codec;
+        found = 1;
+    }
+    pthread_mutex_unlock(&node->lock);
+    if (!found) return 0;
+
+    if (topic[0] &&
+        membership_is_interested(&node->membership, sender,
+                                 topic_bits(topic)) == 0) {
+        char q[ID_LEN + TOPIC_LEN + 4];
+        const char *sep = skips->count ? "," : "";
+        snprintf(q, sizeof(q), "%s\"%s\"", sep, id);
+        strncat(skips->ids, q, sizeof(skips->ids) - strlen(skips->ids) - 1);
+        snprintf(q, sizeof(q), "%s\"%s\"", sep, topic);
+        strncat(skips->topics, q,
+                sizeof(skips->topics) - strlen(skips->topics) - 1);
+        skips->count++;
+        return 0;
+    }
+
+    if (codec != CODEC_NONE &&
+        !(membership_get_caps(&node->membership, sender) & (1u << codec))) {
+        /* Requester can't decode it – re-send expanded */
+        gossip_msg_t expand;
+        if (deserialize_message(wire, &expand) != 0) return 0;
+        send_gossip(node, &expand, sender);
+    } else {
+        /* Send the raw serialized gossip directly */
+        send_raw(node, MSG_GOSSIP, wire, (int)strlen(wire), sender);
+        log_event(node, "SEND", "GOSSIP", id);
+    }
+    if (lost) pacer_note_resend(&node->pacer, 1);
+    return 1;
+}
+
+/* "<origin>:<a><sep><b>" as used by DIGEST entries and IWANT ranges */
+static int parse_origin_pair(const char *s, char sep, char *origin,
+                             size_t size, uint64_t *a, uint64_t *b) {
+    const char *colon = strchr(s, ':');
+    if (!colon || colon == s || (size_t)(colon - s) >= size) return -1;
+    char *end;
+    const char *q = colon + 1;
+    *a = strtoull(q, &end, 10);
+    if (end == q || *end != sep) return -1;
+    q = end + 1;
+    *b = strtoull(q, &end, 10);
+    if (end == q || *end != '\0') return -1;
+    memcpy(origin, s, (size_t)(colon - s));
+    origin[colon - s] = '\0';
+    return 0;
 }
 
 void handle_iwant(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
     /*
-     * Parse the requested IDs and send back the full GOSSIP messages
-     * from our store.
+     * Send back the full GOSSIP messages from our store, for each id in
+     * "ids" and each seq of the "<origin>:<lo>-<hi>" entries in "ranges",
+     * until the budget runs out.
      */
-    char *p = strstr(msg->payload, "\"ids\":");
-    if (!p) return;
-    p = strchr(p, '[');
+    iwant_skips_t skips;
+    skips.ids[0] = skips.topics[0] = '\0';
+    skips.count = 0;
+    int budget  = iwant_budget(node);
+    int lookups = IWANT_MAX_IDS;
+
+    char id[ID_LEN];
+    const char *p = json_array(msg->payload, "\"ids\":");
+    while (p && budget > 0 && lookups > 0 &&
+           (p = next_json_string(p, id, sizeof(id))) != NULL) {
+        budget -= serve_iwant_id(node, id, sender, &skips, 1);
+        lookups--;
+    }
+
+    char range[NODE_ID_LEN + 48];
+    p = json_array(msg->payload, "\"ranges\":");
+    while (p && budget > 0 && lookups > 0 &&
+           (p = next_json_string(p, range, sizeof(range))) != NULL) {
+        char origin[NODE_ID_LEN];
+        uint64_t lo, hi;
+        if (parse_origin_pair(range, '-', origin, sizeof(origin),
+                              &lo, &hi) != 0 || lo == 0 || hi < lo)
+            continue;
+        if (hi - lo >= WM_WINDOW) hi = lo + WM_WINDOW - 1;
+        for (uint64_t s = lo; s <= hi && budget > 0 && lookups > 0; s++) {
+            snprintf(id, sizeof(id), "%s_%llu", origin, (unsigned long long)s);
+            budget -= serve_iwant_id(node, id, sender, &skips, 0);
+            lookups--;
+        }
+    }
+    if (skips.count > 0)
+        send_ihave_list(node, skips.ids, skips.topics, sender);
+}
+
+/* ---- Version-vector anti-entropy ---- */
+
+/* Seqs one DIGEST may ask for; the rest waits for the next round */
+#define DIGEST_MAX_REQUEST IWANT_MAX_IDS
+
+/*
+ * A DIGEST carries "<origin>:<contiguous>:<max_seq>" for the origins in
+ * our watermark table, so a pull round costs one entry per active
+ * publisher however many messages they sent.  The receiver asks for the
+ * seqs it lacks as IWANT ranges, and answers with its own digest (reply
+ * = 1, never answered again) when the sender is behind on something.
+ * "partial" says the vector was cut short to fit the datagram; the next
+ * round continues from where it stopped.
+ */
+static int build_digest(node_t *node, char *payload, size_t size, int reply) {
+    char vv[MSG_BUF_SIZE / 2];
+    size_t len = 0;
+    int n = 0, partial = 0;
+
+    pthread_mutex_lock(&node->lock);
+    watermark_table_t *wm = &node->wm;
+    uint32_t cap = wm->mask + 1, i;
+    for (i = 0; i < cap; i++) {
+        const origin_state_t *o =
+            wm_slot(wm, (node->digest_cursor + i) & wm->mask);
+        if (!o) continue;
+        char e[NODE_ID_LEN + 48];
+        int el = snprintf(e, sizeof(e), "%s\"%s:%llu:%llu\"", n ? "," : "",
+                          o->origin, (unsigned long long)o->contiguous,
+                          (unsigned long long)o->max_seq);
+        if (len + (size_t)el >= sizeof(vv)) { partial = 1; break; }
+        memcpy(vv + len, e, (size_t)el + 1);
+        len += (size_t)el;
+        n++;
+    }
+    if (!reply) node->digest_cursor = partial ? (node->digest_cursor + i) : 0;
+    pthread_mutex_unlock(&node->lock);
+
+    vv[len] = '\0';
+    snprintf(payload, size,
+             "{ \"vv\": [%s], \"partial\": %d, \"reply\": %d }",
+             vv, partial, reply);
+    return n;
+}
+
+static void send_digest(node_t *node, const char *payload,
+                        struct sockaddr_in *dest) {
+    gossip_msg_t d;
+    memset(&d, 0, sizeof(d));
+    d.version = 1;
+    snprintf(d.msg_id, ID_LEN, "DIGEST_%llu",
+             (unsigned long long)current_time_ms());
+    strcpy(d.msg_type,    "DIGEST");
+    strcpy(d.sender_id,   node->node_id);
+    strcpy(d.sender_addr, node->self_addr);
+    d.timestamp_ms = current_time_ms();
+    d.ttl = 1;
+    snprintf(d.payload, MSG_BUF_SIZE, "%s", payload);
+    send_msg(node, &d, dest);
+}
+
+void handle_digest(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
+    const char *p = json_array(msg->payload, "\"vv\":");
     if (!p) return;
-    p++;
+    int partial = strstr(msg->payload, "\"partial\": 1") != NULL;
+    int reply   = strstr(msg->payload, "\"reply\": 1") != NULL;
 
-    while (*p && *p != ']') {
-        while (*p == ' ' || *p == ',' || *p == '\n') p++;
-        if (*p == ']' || *p == '\0') break;
-        if (*p == '"') {
-            p++;
-            char id[ID_LEN] = {0};
-            int i = 0;
-            while (*p && *p != '"' && i < ID_LEN - 1)
-                id[i++] = *p++;
-            if (*p == '"') p++;
+    char ranges[MSG_BUF_SIZE / 2];
+    size_t len = 0;
+    int nranges = 0, requested = 0, listed = 0, peer_behind = 0;
 
-            pthread_mutex_lock(&node->lock);
-            stored_gossip_t *sg = find_stored(node, id);
-            if (sg) {
-                /* Send the raw serialized gossip directly */
-                sendto(node->sockfd, sg->serialized,
-                       strlen(sg->serialized), 0,
-                       (struct sockaddr *)sender,
-                       sizeof(struct sockaddr_in));
-                node->sent_messages++;
-                log_event(node, "SEND", "GOSSIP", id);
+    char entry[NODE_ID_LEN + 48];
+    pthread_mutex_lock(&node->lock);
+    while ((p = next_json_string(p, entry, sizeof(entry))) != NULL) {
+        char origin[NODE_ID_LEN];
+        uint64_t contiguous, max_seq;
+        if (parse_origin_pair(entry, ':', origin, sizeof(origin),
+                              &contiguous, &max_seq) != 0)
+            continue;
+
+        const origin_state_t *o = wm_find(&node->wm, origin);
+        if (o) {
+            listed++;
+            if (o->max_seq > contiguous) peer_behind = 1;
+        }
+        if (requested >= DIGEST_MAX_REQUEST) continue;
+
+        uint64_t r[8][2];
+        int k = wm_missing_ranges(&node->wm, origin, max_seq, r, 8);
+        for (int j = 0; j < k && requested < DIGEST_MAX_REQUEST; j++) {
+            uint64_t span = r[j][1] - r[j][0] + 1;
+            if (span > (uint64_t)(DIGEST_MAX_REQUEST - requested))
+                r[j][1] = r[j][0] + (uint64_t)(DIGEST_MAX_REQUEST - requested) - 1;
+            char q[NODE_ID_LEN + 48];
+            int ql = snprintf(q, sizeof(q), "%s\"%s:%llu-%llu\"",
+                              nranges ? "," : "", origin,
+                              (unsigned long long)r[j][0],
+                              (unsigned long long)r[j][1]);
+            if (len + (size_t)ql >= sizeof(ranges)) {
+                requested = DIGEST_MAX_REQUEST;
+                break;
             }
-            pthread_mutex_unlock(&node->lock);
-        } else {
-            p++;
+            memcpy(ranges + len, q, (size_t)ql + 1);
+            len += (size_t)ql;
+            requested += (int)(r[j][1] - r[j][0] + 1);
+            nranges++;
+        }
+    }
+    /* Origins the sender did not list at all */
+    if (!partial && listed < node->wm.count) peer_behind = 1;
+    pthread_mutex_unlock(&node->lock);
+
+    if (nranges > 0) send_iwant(node, "ranges", ranges, sender);
+    if (peer_behind && !reply) {
+        char payload[MSG_BUF_SIZE];
+        if (build_digest(node, payload, sizeof(payload), 1) > 0)
+            send_digest(node, payload, sender);
+    }
+}
+
+/* ---- Gap repair ---- */
+
+#define GAP_MAX_TRIES 3
+
+/* Ask for seqs that have been missing for gap_repair_ms: first from the
+ * peer that relayed the origin's newest seq (it most likely holds the
+ * ones before), then from random peers.  After GAP_MAX_TRIES attempts
+ * the holes are given up so the watermark keeps moving.  Runs on the
+ * dispatcher. */
+static void repair_gaps(node_t *node) {
+    uint64_t now   = current_time_us();
+    uint64_t delay = (uint64_t)node->gap_repair_ms * 1000;
+    watermark_table_t *wm = &node->wm;
+
+    pthread_mutex_lock(&node->lock);
+    for (uint32_t i = 0; wm->open_gaps > 0 && i <= wm->mask; i++) {
+        origin_state_t *o = wm_slot(wm, i);
+        if (!o || !o->gap_since_us) continue;
+        if (!o->next_repair_us) o->next_repair_us = o->gap_since_us + delay;
+        if (now < o->next_repair_us) continue;
+
+        /* Seqs from before we heard of the origin are not ours to fetch */
+        if (o->contiguous + 1 < o->repair_from) {
+            pthread_mutex_lock(&node->seen_lock);
+            wm_abandon(wm, o, o->repair_from - 1);
+            pthread_mutex_unlock(&node->seen_lock);
+        }
+        if (!o->gap_since_us) continue;
+
+        if (o->repair_tries > 0 && o->contiguous >= o->repair_upto)
+            o->repair_tries = 0;   /* filled; what's left is newer */
+        if (o->repair_tries >= GAP_MAX_TRIES) {
+            pthread_mutex_lock(&node->seen_lock);
+            int lost = wm_abandon(wm, o, o->repair_upto);
+            pthread_mutex_unlock(&node->seen_lock);
+            metrics_add(&node->metrics, M_GAP_ABANDONED, MSG_GOSSIP,
+                        (uint64_t)lost);
+            o->repair_tries   = 0;
+            o->next_repair_us = now + delay;
+            continue;
+        }
+        if (o->repair_tries == 0) o->repair_upto = o->max_seq;
+
+        uint64_t missing[WM_WINDOW];
+        int n = wm_missing(o, missing, node->max_ihave_ids);
+        char ids[MSG_BUF_SIZE / 2] = "";
+        size_t len = 0;
+        for (int k = 0; k < n && len < sizeof(ids); k++)
+            len += (size_t)snprintf(ids + len, sizeof(ids) - len,
+                                    "%s\"%s_%llu\"", k ? "," : "", o->origin,
+                                    (unsigned long long)missing[k]);
+
+        struct sockaddr_in dest = o->relayer;
+        if ((o->repair_tries > 0 || !dest.sin_port) &&
+            membership_get_random(&node->membership, &dest, 1, NULL) < 1) {
+            o->next_repair_us = now + delay;
+            continue;
+        }
+        if (n > 0 && len < sizeof(ids)) {
+            send_iwant(node, "ids", ids, &dest);
+            metrics_add(&node->metrics, M_GAP_REQUESTED, MSG_GOSSIP,
+                        (uint64_t)n);
         }
+        o->repair_tries++;
+        o->next_repair_us = now + 2 * delay;
     }
+    pthread_mutex_unlock(&node->lock);
+}
+
+/* ---- Replicated state ---- */
+
+#define STATE_CHUNK        (MSG_BUF_SIZE - 256)
+#define STATE_ENTRY_MAX    (CRDT_KEY_LEN * 2 + CRDT_VALUE_LEN * 2 + NODE_ID_LEN + 64)
+#define STATE_FLUSH_CHUNKS 4    /* STATE messages per flush tick; the rest
+                                   stays dirty for the next one */
+#define STATE_SYNC_CHUNKS  8    /* STATE messages one digest may trigger */
+
+/* STATE messages for a fixed set of peers, packed under node->lock and
+ * sent after it is released */
+typedef struct {
+    struct sockaddr_in dests[MAX_PEERS];
+    int    ndest;
+    int    max_chunks;
+    int    chunks;   /* closed chunks in json[0 .. chunks) */
+    int    n;        /* entries in the open chunk, json[chunks] */
+    size_t len;
+    char   json[STATE_SYNC_CHUNKS][STATE_CHUNK];
+} state_batch_t;
+
+static state_batch_t *batch_new(int max_chunks) {
+    state_batch_t *b = malloc(sizeof(*b));
+    if (!b) return NULL;
+    b->ndest      = 0;
+    b->max_chunks = max_chunks;
+    b->chunks = b->n = 0;
+    b->len    = 0;
+    return b;
+}
+
+/* 1 if any entry is guaranteed to fit */
+static int batch_room(const state_batch_t *b) {
+    return b->chunks < b->max_chunks - 1 ||
+           (b->chunks == b->max_chunks - 1 &&
+            b->len + STATE_ENTRY_MAX + 2 <= STATE_CHUNK);
+}
+
+/* Append e; call only while batch_room() */
+static void batch_add(state_batch_t *b, const crdt_entry_t *e) {
+    char enc[STATE_ENTRY_MAX];
+    int el = crdt_encode(e, enc, sizeof(enc));
+    if (el < 0) return;
+    if (b->len + (size_t)el + 2 > STATE_CHUNK) {
+        b->chunks++;
+        b->n   = 0;
+        b->len = 0;
+    }
+    char *json = b->json[b->chunks];
+    if (b->n > 0) json[b->len++] = ',';
+    memcpy(json + b->len, enc, (size_t)el + 1);
+    b->len += (size_t)el;
+    b->n++;
+}
+
+/* Send every chunk to every destination (node->lock not held) */
+static void batch_send(node_t *node, state_batch_t *b) {
+    int total = b->chunks + (b->n > 0);
+    for (int c = 0; c < total; c++) {
+        gossip_msg_t m;
+        memset(&m, 0, sizeof(m));
+        m.version = 1;
+        snprintf(m.msg_id, ID_LEN, "STATE_%llu",
+                 (unsigned long long)current_time_us());
+        strcpy(m.msg_type,    "STATE");
+        strcpy(m.sender_id,   node->node_id);
+        strcpy(m.sender_addr, node->self_addr);
+        m.timestamp_ms = current_time_ms();
+        m.ttl = 1;
+        snprintf(m.payload, MSG_BUF_SIZE, "{ \"entries\": [%s] }", b->json[c]);
+        for (int i = 0; i < b->ndest; i++) send_msg(node, &m, &b->dests[i]);
+    }
+}
+
+/* Push what changed since the last flush (local writes and merges
+ * alike) to `fanout` random peers.  A replica forwards a write only the
+ * first time it sees it, and a key written several times in one window
+ * goes out once.  At most STATE_FLUSH_CHUNKS messages leave per tick
+ * so a burst of writes does not overrun peers' receive buffers; what a
+ * peer still loses is repaired by the digest exchange.  Runs on the
+ * dispatcher. */
+static void flush_state(node_t *node) {
+    pthread_mutex_lock(&node->lock);
+    int pending = node->state.ndirty;
+    pthread_mutex_unlock(&node->lock);
+    if (pending == 0) return;
+
+    state_batch_t *b = batch_new(STATE_FLUSH_CHUNKS);
+    if (!b) return;
+    b->ndest = membership_get_random(&node->membership, b->dests,
+                                     node->fanout, NULL);
+    if (b->ndest == 0) {   /* keep it dirty until we have peers */
+        free(b);
+        return;
+    }
+
+    uint32_t idx;
+    pthread_mutex_lock(&node->lock);
+    while (batch_room(b) && crdt_take_dirty(&node->state, &idx, 1) == 1) {
+        const crdt_entry_t *e = crdt_slot(&node->state, idx);
+        if (e) batch_add(b, e);
+    }
+    pthread_mutex_unlock(&node->lock);
+
+    batch_send(node, b);
+    free(b);
+}
+
+static void send_state_digest(node_t *node, struct sockaddr_in *dest,
+                              int reply) {
+    gossip_msg_t m;
+    memset(&m, 0, sizeof(m));
+    m.version = 1;
+    snprintf(m.msg_id, ID_LEN, "STATE_DIGEST_%llu",
+             (unsigned long long)current_time_ms());
+    strcpy(m.msg_type,    "STATE_DIGEST");
+    strcpy(m.sender_id,   node->node_id);
+    strcpy(m.sender_addr, node->self_addr);
+    m.timestamp_ms = current_time_ms();
+    m.ttl = 1;
+
+    char hex[CRDT_BUCKETS * 16 + 1];
+    pthread_mutex_lock(&node->lock);
+    crdt_digest_hex(&node->state, hex, sizeof(hex));
+    pthread_mutex_unlock(&node->lock);
+    snprintf(m.payload, MSG_BUF_SIZE,
+             "{ \"buckets\": \"%s\", \"reply\": %d }", hex, reply);
+    send_msg(node, &m, dest);
+}
+
+/* Anti-entropy round with one random peer (dispatcher) */
+static void sync_state(node_t *node) {
+    pthread_mutex_lock(&node->lock);
+    int keys = node->state.count;
+    pthread_mutex_unlock(&node->lock);
+    if (keys == 0) return;   /* peers with state will reach us */
+
+    struct sockaddr_in peer;
+    if (membership_get_random(&node->membership, &peer, 1, NULL) == 1)
+        send_state_digest(node, &peer, 0);
+}
+
+void handle_state(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
+    (void)sender;
+    const char *p = json_array(msg->payload, "\"entries\":");
+    if (!p) return;
+
+    crdt_entry_t e;
+    while ((p = crdt_decode(p, &e)) != NULL) {
+        pthread_mutex_lock(&node->lock);
+        int changed = crdt_merge(&node->state, &e);
+        pthread_mutex_unlock(&node->lock);
+        if (changed != 1) continue;
+        metrics_count(&node->metrics, M_STATE_MERGED, MSG_STATE);
+        if (node->state_fn)
+            node->state_fn(node, e.key, e.deleted ? NULL : e.value,
+                           node->state_ctx);
+    }
+}
+
+/* Send our entries in every bucket whose digest differs from the
+ * sender's; answer a first digest with ours so it does the same.
+ *
+ * One reply carries at most STATE_SYNC_CHUNKS messages.  The scan
+ * resumes where the previous reply stopped (node->state_cursor), so a
+ * difference larger than that is covered over successive rounds
+ * instead of the same leading slots being resent every time. */
+void handle_state_digest(node_t *node, gossip_msg_t *msg,
+                         struct sockaddr_in *sender) {
+    static const char key[] = "\"buckets\": \"";
+    const char *p = strstr(msg->payload, key);
+    uint64_t theirs[CRDT_BUCKETS];
+    if (!p || crdt_digest_parse(p + sizeof(key) - 1, theirs) != 0) return;
+    int reply = strstr(msg->payload, "\"reply\": 1") != NULL;
+
+    int differ[CRDT_BUCKETS], ndiffer = 0;
+    pthread_mutex_lock(&node->lock);
+    crdt_map_t *st = &node->state;
+    for (int i = 0; i < CRDT_BUCKETS; i++) {
+        differ[i] = (theirs[i] != st->buckets[i]);
+        ndiffer += differ[i];
+    }
+    pthread_mutex_unlock(&node->lock);
+    if (ndiffer == 0) return;
+
+    state_batch_t *b = batch_new(STATE_SYNC_CHUNKS);
+    if (b) {
+        b->dests[0] = *sender;
+        b->ndest    = 1;
+        pthread_mutex_lock(&node->lock);
+        uint32_t slots = st->mask + 1;
+        uint32_t i = node->state_cursor % slots;
+        for (uint32_t seen = 0; seen < slots && batch_room(b); seen++) {
+            const crdt_entry_t *e = crdt_slot(st, i);
+            if (e && differ[crdt_bucket(e->key)]) batch_add(b, e);
+            i = (i + 1) % slots;
+        }
+        node->state_cursor = i;
+        pthread_mutex_unlock(&node->lock);
+
+        batch_send(node, b);
+        free(b);
+    }
+
+    if (!reply) send_state_digest(node, sender, 1);
 }
 
 /* =========================================================
@@ -503,17 +2122,18 @@ void handle_iwant(node_t *node, gossip_msg_t *msg, struct sockaddr_in *sender) {
  * ========================================================= */
 
 void membership_remove_expired(node_t *node) {
+    /* Events go out once the lock is released: a handler may well call
+     * back into the membership */
+    struct sockaddr_in gone[MAX_PEERS];
+    int ngone = 0;
+
     pthread_mutex_lock(&node->membership.lock);
     uint64_t now = current_time_ms();
 
     for (int i = 0; i < node->membership.count; ) {
         uint64_t last = node->membership.list[i].last_seen;
         if ((now - last) > (uint64_t)(node->peer_timeout) * 1000) {
-            char ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &node->membership.list[i].addr.sin_addr,
-                      ip, INET_ADDRSTRLEN);
-            int port = ntohs(node->membership.list[i].addr.sin_port);
-            printf("[Peer Removed] %s:%d timed out\n> ", ip, port);
+            gone[ngone++] = node->membership.list[i].addr;
             /* Swap with last */
             node->membership.list[i] =
                 node->membership.list[node->membership.count - 1];
@@ -523,32 +2143,53 @@ void membership_remove_expired(node_t *node) {
         }
     }
     pthread_mutex_unlock(&node->membership.lock);
+
+    for (int i = 0; i < ngone; i++) {
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &gone[i].sin_addr, ip, INET_ADDRSTRLEN);
+        emit_event(node, NODE_EVENT_PEER_REMOVED, "%s:%d", ip,
+                   ntohs(gone[i].sin_port));
+    }
 }
 
 void* ping_thread_func(void *arg) {
     node_t *node = (node_t *)arg;
+    TRACE_THREAD("ping");
 
     while (node->running) {
         sleep((unsigned)node->ping_interval);
         if (!node->running) break;
 
+        /* Close the loss window before this round's PINGs go out, so it
+         * holds the last round's PINGs and the PONGs they got back */
+        pacer_adjust(&node->pacer);
+
+        char advert[256];
+        build_advert(node, advert, sizeof(advert));
+
         struct sockaddr_in targets[MAX_PEERS];
         int count = membership_get_random(&node->membership, targets,
                                           node->fanout, NULL);
+        /* Each target gets an equal share of our aggregation mass */
+        char share[AGG_SHARE_SIZE];
+        agg_exchange(node, NULL, count + 1, share, sizeof(share));
         for (int i = 0; i < count; i++) {
             gossip_msg_t ping;
             memset(&ping, 0, sizeof(ping));
             ping.version = 1;
+            /* Monotonic send time; echoed back as the PONG's reply_to */
             snprintf(ping.msg_id, ID_LEN, "PING_%llu",
-                     (unsigned long long)current_time_ms());
+                     (unsigned long long)current_time_us());
             strcpy(ping.msg_type,    "PING");
             strcpy(ping.sender_id,   node->node_id);
             strcpy(ping.sender_addr, node->self_addr);
             ping.timestamp_ms = current_time_ms();
             ping.ttl = 1;
             snprintf(ping.payload, MSG_BUF_SIZE,
-                     "{ \"ping_id\": \"%s\" }", ping.msg_id);
+                     "{ \"ping_id\": \"%s\", %s%s }", ping.msg_id, advert,
+                     share);
             send_msg(node, &ping, &targets[i]);
+            pacer_note_ping(&node->pacer);
         }
 
         membership_remove_expired(node);
@@ -557,38 +2198,45 @@ void* ping_thread_func(void *arg) {
 }
 
 /* =========================================================
- * Hybrid Pull thread – broadcasts IHAVE periodically
+ * Hybrid Pull thread – broadcasts a DIGEST (or IHAVE) periodically
  * ========================================================= */
 
 void* pull_thread_func(void *arg) {
     node_t *node = (node_t *)arg;
+    TRACE_THREAD("pull");
 
     while (node->running) {
         sleep((unsigned)node->pull_interval);
         if (!node->running) break;
 
-        /* Collect up to max_ihave_ids recent message IDs */
-        pthread_mutex_lock(&node->lock);
-        int total = (node->seen_count < MAX_SEEN_MSGS)
-                    ? node->seen_count : MAX_SEEN_MSGS;
-        int limit = (total < node->max_ihave_ids)
-                    ? total : node->max_ihave_ids;
+        if (!node->pull_ids) {
+            char payload[MSG_BUF_SIZE];
+            if (build_digest(node, payload, sizeof(payload), 0) == 0)
+                continue;
+            struct sockaddr_in targets[MAX_PEERS];
+            int count = membership_get_random(&node->membership, targets,
+                                              node->fanout, NULL);
+            for (int i = 0; i < count; i++)
+                send_digest(node, payload, &targets[i]);
+            continue;
+        }
 
+        /* Advertise up to max_ihave_ids of the most recently stored
+         * messages (the ones we can actually serve), with their topics */
+        pthread_mutex_lock(&node->lock);
         char ids_json[MSG_BUF_SIZE] = "";
-        /* Take the most recent 'limit' IDs */
-        int start = (node->seen_count >= MAX_SEEN_MSGS)
-                    ? node->seen_count % MAX_SEEN_MSGS
-                    : 0;
+        char topics_json[MSG_BUF_SIZE] = "";
+        int stored = store_size(&node->store);
         int collected = 0;
-        for (int i = 0; i < MAX_SEEN_MSGS && collected < limit; i++) {
-            int idx = (start + MAX_SEEN_MSGS - i - 1) % MAX_SEEN_MSGS;
-            if (node->seen_ids[idx][0] == '\0') continue;
-            if (collected > 0)
-                strncat(ids_json, ",",
-                        sizeof(ids_json) - strlen(ids_json) - 1);
+        while (collected < node->max_ihave_ids && collected < stored) {
+            stored_gossip_t *sg = store_recent(&node->store, collected);
+            const char *sep = (collected > 0) ? "," : "";
             char q[ID_LEN + 4];
-            snprintf(q, sizeof(q), "\"%s\"", node->seen_ids[idx]);
+            snprintf(q, sizeof(q), "%s\"%s\"", sep, sg->msg_id);
             strncat(ids_json, q, sizeof(ids_json) - strlen(ids_json) - 1);
+            snprintf(q, sizeof(q), "%s\"%s\"", sep, sg->topic);
+            strncat(topics_json, q,
+                    sizeof(topics_json) - strlen(topics_json) - 1);
             collected++;
         }
         pthread_mutex_unlock(&node->lock);
@@ -606,8 +2254,8 @@ void* pull_thread_func(void *arg) {
         ihave.timestamp_ms = current_time_ms();
         ihave.ttl = 1;
         snprintf(ihave.payload, MSG_BUF_SIZE,
-                 "{ \"ids\": [%s], \"max_ids\": %d }",
-                 ids_json, node->max_ihave_ids);
+                 "{ \"ids\": [%s], \"topics\": [%s], \"max_ids\": %d }",
+                 ids_json, topics_json, node->max_ihave_ids);
 
         struct sockaddr_in targets[MAX_PEERS];
         int count = membership_get_random(&node->membership, targets,
@@ -619,12 +2267,73 @@ void* pull_thread_func(void *arg) {
     return NULL;
 }
 
+/* =========================================================
+ * Metrics – gauges are sampled when a dump is taken
+ * ========================================================= */
+
+void node_metrics_sample(node_t *node) {
+    metrics_t *m = &node->metrics;
+
+    pthread_mutex_lock(&node->membership.lock);
+    metrics_gauge_set(m, G_PEERS, node->membership.count);
+    pthread_mutex_unlock(&node->membership.lock);
+
+    pthread_mutex_lock(&node->lock);
+    metrics_gauge_set(m, G_SEEN_IDS, seen_size(&node->seen));
+    metrics_gauge_set(m, G_STORED, store_size(&node->store));
+    metrics_gauge_set(m, G_ORIGINS, node->wm.count);
+    metrics_gauge_set(m, G_STATE_KEYS, node->state.count);
+    double size;
+    metrics_gauge_set(m, G_CLUSTER_SIZE,
+                      agg_cluster_size(&node->agg, &size) == 0
+                          ? (int64_t)(size + 0.5) : 0);
+    pthread_mutex_unlock(&node->lock);
+
+    metrics_gauge_set(m, G_RX_QUEUE, pqueue_pending(&node->rx_queue));
+    metrics_gauge_set(m, G_TX_QUEUE, pqueue_pending(&node->tx_queue));
+}
+
+int node_metrics_text(node_t *node, char *buf, size_t size) {
+    node_metrics_sample(node);
+    return metrics_format(&node->metrics, buf, size);
+}
+
+/* Rewrite node->metrics_path every metrics_interval seconds.  The dump
+ * goes to a temporary file first so readers never see a partial one. */
+void* metrics_thread_func(void *arg) {
+    node_t *node = (node_t *)arg;
+    char *text = malloc(METRICS_TEXT_SIZE);
+    if (!text) return NULL;
+
+    char tmp[sizeof(node->metrics_path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", node->metrics_path);
+
+    uint64_t next = current_time_ms();
+    while (node->running) {
+        if (current_time_ms() < next) {
+            sleep_us(100000);
+            continue;
+        }
+        next += (uint64_t)node->metrics_interval * 1000;
+
+        int len = node_metrics_text(node, text, METRICS_TEXT_SIZE);
+        FILE *f = fopen(tmp, "w");
+        if (!f) continue;
+        fwrite(text, 1, (size_t)len, f);
+        fclose(f);
+        rename(tmp, node->metrics_path);
+    }
+    free(text);
+    return NULL;
+}
+
 /* =========================================================
  * Logging
  * ========================================================= */
 
 void log_event(node_t *node, const char *event,
                const char *msg_type, const char *msg_id) {
+    if (!node->log_file) return;
     uint64_t now = current_time_ms();
     fprintf(node->log_file, "%llu,%s,%s,%s\n",
             (unsigned long long)now, event, msg_type, msg_id);
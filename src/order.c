@@ -0,0 +1,301 @@
+#include "order.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int order_init(order_buffer_t *b, int mode, int capacity, int hold_ms) {
+    memset(b, 0, sizeof(*b));
+    b->mode     = mode;
+    b->capacity = (capacity > 0) ? capacity : ORDER_DEFAULT_CAPACITY;
+    b->hold_us  = (uint64_t)((hold_ms > 0) ? hold_ms : ORDER_DEFAULT_HOLD_MS)
+                  * 1000;
+    b->free = b->oldest = b->newest = -1;
+    if (mode == ORDER_ARRIVAL) return 0;
+    /* One spare slot: an arrival is buffered before the overflow is
+     * forced out by the next order_release() */
+    int n = b->capacity + 1;
+    b->held  = calloc((size_t)n, sizeof(order_held_t));
+    b->heads = calloc((size_t)n, sizeof(int));
+    b->ready = calloc((size_t)n, sizeof(int));
+    if (!b->held || !b->heads || !b->ready) {
+        order_free(b);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) b->held[i].next = (i + 1 < n) ? i + 1 : -1;
+    b->free = 0;
+    return 0;
+}
+
+void order_free(order_buffer_t *b) {
+    for (int i = b->oldest; i >= 0; i = b->held[i].newer)
+        free(b->held[i].msg);
+    free(b->held);
+    free(b->heads);
+    free(b->ready);
+    b->held   = NULL;
+    b->heads  = b->ready = NULL;
+    b->oldest = b->newest = -1;
+    b->count  = b->nheads = 0;
+}
+
+int order_mode_from_name(const char *name) {
+    if (strcmp(name, "arrival") == 0) return ORDER_ARRIVAL;
+    if (strcmp(name, "fifo")    == 0) return ORDER_FIFO;
+    if (strcmp(name, "causal")  == 0) return ORDER_CAUSAL;
+    return -1;
+}
+
+/* =========================================================
+ * Readiness
+ * ========================================================= */
+
+/* Lowest buffered seq of o, UINT64_MAX if none */
+static uint64_t held_min(const order_buffer_t *b, const origin_state_t *o) {
+    return o->held ? b->held[o->held - 1].seq : UINT64_MAX;
+}
+
+/* Highest seq of origin up to which nothing is left to deliver */
+static uint64_t settled(const order_buffer_t *b, const watermark_table_t *wm,
+                        const char *origin) {
+    const origin_state_t *o = wm_find(wm, origin);
+    if (!o) return 0;
+    uint64_t s  = o->contiguous;
+    uint64_t lo = held_min(b, o);
+    if (lo != UINT64_MAX && lo - 1 < s) s = lo - 1;
+    return (o->delivered > s) ? o->delivered : s;
+}
+
+/* Every earlier seq of the origin accounted for */
+static int fifo_ready(const origin_state_t *o, uint64_t seq) {
+    return o->contiguous >= seq || o->delivered + 1 >= seq;
+}
+
+/* Every dependency settled; otherwise the first that is not goes to
+ * wait / *wait_seq */
+static int deps_ready(const order_buffer_t *b, const watermark_table_t *wm,
+                      const char *deps, char *wait, uint64_t *wait_seq) {
+    const char *p = deps;
+    while (*p) {
+        while (*p == ' ') p++;
+        const char *colon = strchr(p, ':');
+        if (!colon) break;
+        char origin[NODE_ID_LEN];
+        size_t len = (size_t)(colon - p);
+        char *end;
+        uint64_t seq = strtoull(colon + 1, &end, 10);
+        if (len > 0 && len < sizeof(origin)) {
+            memcpy(origin, p, len);
+            origin[len] = '\0';
+            if (settled(b, wm, origin) < seq) {
+                strcpy(wait, origin);
+                *wait_seq = seq;
+                return 0;
+            }
+        }
+        p = end;
+    }
+    wait[0] = '\0';
+    return 1;
+}
+
+static int ready(const order_buffer_t *b, const watermark_table_t *wm,
+                 const origin_state_t *o, uint64_t seq, const char *deps,
+                 char *wait, uint64_t *wait_seq) {
+    if (!fifo_ready(o, seq)) return 0;
+    return b->mode != ORDER_CAUSAL || deps_ready(b, wm, deps, wait, wait_seq);
+}
+
+/* Readiness of the head entry i; a dependency that held it before and
+ * still isn't settled saves parsing its deps again */
+static int head_ready(order_buffer_t *b, const watermark_table_t *wm, int i) {
+    order_held_t *h = &b->held[i];
+    const origin_state_t *o = wm_find(wm, h->origin);
+    if (!o) return 0;
+    if (h->wait[0] && fifo_ready(o, h->seq) &&
+        settled(b, wm, h->wait) < h->wait_seq)
+        return 0;
+    return ready(b, wm, o, h->seq, h->msg->deps, h->wait, &h->wait_seq);
+}
+
+/* =========================================================
+ * Buffering
+ * ========================================================= */
+
+static void heads_add(order_buffer_t *b, int i) {
+    b->held[i].head_pos = b->nheads;
+    b->heads[b->nheads++] = i;
+}
+
+static void heads_remove(order_buffer_t *b, int i) {
+    int pos  = b->held[i].head_pos;
+    int last = b->heads[--b->nheads];
+    b->heads[pos] = last;
+    b->held[last].head_pos = pos;
+    b->held[i].head_pos = -1;
+}
+
+int order_offer(order_buffer_t *b, watermark_table_t *wm,
+                const gossip_msg_t *msg, uint64_t now_us) {
+    if (b->mode == ORDER_ARRIVAL) return 1;
+
+    char origin[NODE_ID_LEN];
+    uint64_t seq;
+    if (wm_parse_id(msg->msg_id, origin, sizeof(origin), &seq) != 0) return 1;
+    origin_state_t *o = wm_find(wm, origin);
+    if (!o) return 1;   /* table full: nothing to order against */
+
+    if (seq <= o->delivered) {
+        b->late++;
+        return -1;
+    }
+    char wait[NODE_ID_LEN] = "";
+    uint64_t wait_seq = 0;
+    if (held_min(b, o) > seq &&
+        ready(b, wm, o, seq, msg->deps, wait, &wait_seq)) {
+        o->delivered = seq;
+        return 1;
+    }
+    if (b->free < 0) return 1;   /* never: order_release keeps one spare */
+
+    gossip_msg_t *copy = malloc(sizeof(*copy));
+    if (!copy) return 1;
+    *copy = *msg;
+    int i = b->free;
+    order_held_t *h = &b->held[i];
+    b->free = h->next;
+    strcpy(h->origin, origin);
+    h->seq      = seq;
+    h->held_us  = now_us;
+    h->msg      = copy;
+    h->head_pos = -1;
+    h->queued   = 0;
+    strcpy(h->wait, (b->mode == ORDER_CAUSAL && fifo_ready(o, seq))
+                    ? wait : "");
+    h->wait_seq = wait_seq;
+
+    /* Into the origin's list, sorted by seq */
+    if (!o->held || seq < held_min(b, o)) {
+        h->next = o->held - 1;
+        if (o->held) heads_remove(b, o->held - 1);
+        o->held = i + 1;
+        heads_add(b, i);
+    } else {
+        int p = o->held - 1;
+        while (b->held[p].next >= 0 && b->held[b->held[p].next].seq < seq)
+            p = b->held[p].next;
+        h->next = b->held[p].next;
+        b->held[p].next = i;
+    }
+
+    /* ... and at the new end of the arrival order */
+    h->older = b->newest;
+    h->newer = -1;
+    if (b->newest >= 0) b->held[b->newest].newer = i;
+    else                b->oldest = i;
+    b->newest = i;
+
+    b->count++;
+    b->buffered++;
+    return 0;
+}
+
+/* Unlink head entry i of origin o; the origin's next seq becomes its
+ * head and the entry goes back on the free list */
+static order_held_t take_head(order_buffer_t *b, origin_state_t *o, int i) {
+    order_held_t h = b->held[i];
+    heads_remove(b, i);
+    o->held = h.next + 1;
+    if (h.next >= 0) heads_add(b, h.next);
+
+    if (h.older >= 0) b->held[h.older].newer = h.newer;
+    else              b->oldest = h.newer;
+    if (h.newer >= 0) b->held[h.newer].older = h.older;
+    else              b->newest = h.older;
+
+    b->held[i].msg  = NULL;
+    b->held[i].next = b->free;
+    b->free = i;
+    b->count--;
+    return h;
+}
+
+/* Queue head entry i for release if it is ready (and not queued yet) */
+static void consider(order_buffer_t *b, const watermark_table_t *wm,
+                     int i, int *nready) {
+    if (b->held[i].queued || !head_ready(b, wm, i)) return;
+    b->held[i].queued = 1;
+    b->ready[(*nready)++] = i;
+}
+
+int order_release(order_buffer_t *b, watermark_table_t *wm,
+                  uint64_t now_us, gossip_msg_t **out, int max) {
+    if (b->count == 0) return 0;
+
+    int n = 0, nready = 0;
+    for (int k = 0; k < b->nheads; k++) consider(b, wm, b->heads[k], &nready);
+
+    while (n < max) {
+        /* A ready head, else the lowest seq of the oldest entry's origin
+         * if that entry waited too long or the buffer overflowed */
+        int i, forced = 0;
+        origin_state_t *o;
+        if (nready > 0) {
+            i = b->ready[--nready];
+            b->held[i].queued = 0;
+            o = wm_find(wm, b->held[i].origin);
+        } else if (b->oldest >= 0 &&
+                   (now_us - b->held[b->oldest].held_us >= b->hold_us ||
+                    b->count > b->capacity)) {
+            o = wm_find(wm, b->held[b->oldest].origin);
+            i = o->held - 1;
+            forced = 1;
+        } else {
+            break;
+        }
+
+        order_held_t h = take_head(b, o, i);
+        if (h.seq <= o->delivered) {
+            b->late++;
+            free(h.msg);
+        } else {
+            o->delivered = h.seq;
+            b->forced += (uint64_t)forced;
+            out[n++] = h.msg;
+        }
+
+        /* What this may have unblocked: the origin's next seq, and
+         * entries whose dependency was on this origin */
+        if (o->held) consider(b, wm, o->held - 1, &nready);
+        if (b->mode == ORDER_CAUSAL)
+            for (int k = 0; k < b->nheads; k++) {
+                int j = b->heads[k];
+                if (b->held[j].wait[0] &&
+                    strcmp(b->held[j].wait, h.origin) == 0)
+                    consider(b, wm, j, &nready);
+            }
+    }
+    /* Whatever is still queued is picked up again next time */
+    for (int k = 0; k < nready; k++) b->held[b->ready[k]].queued = 0;
+    return n;
+}
+
+void order_deps(order_buffer_t *b, watermark_table_t *wm, const char *self,
+                char *out, size_t size) {
+    out[0] = '\0';
+    if (b->mode != ORDER_CAUSAL) return;
+
+    size_t len = 0;
+    for (uint32_t i = 0; i <= wm->mask; i++) {
+        origin_state_t *o = wm_slot(wm, i);
+        if (!o || o->delivered <= o->dep_sent || strcmp(o->origin, self) == 0)
+            continue;
+        char e[NODE_ID_LEN + 24];
+        int el = snprintf(e, sizeof(e), "%s%s:%llu", len ? " " : "",
+                          o->origin, (unsigned long long)o->delivered);
+        if (len + (size_t)el >= size) continue;   /* next publish carries it */
+        memcpy(out + len, e, (size_t)el + 1);
+        len += (size_t)el;
+        o->dep_sent = o->delivered;
+    }
+}
@@ -0,0 +1,138 @@
+#include "pacer.h"
+#include "utils.h"
+#include <string.h>
+
+static void bucket_refill(token_bucket_t *tb, double rate, uint64_t now) {
+    double burst = rate * PACER_BURST_SECS;
+    if (burst < 1.0) burst = 1.0;
+    if (tb->last_us == 0) {
+        tb->tokens  = burst;
+    } else if (now > tb->last_us) {
+        tb->tokens += rate * (double)(now - tb->last_us) / 1e6;
+        if (tb->tokens > burst) tb->tokens = burst;
+    }
+    tb->last_us = now;
+}
+
+/* Microseconds until the bucket holds one token */
+static uint64_t bucket_wait(const token_bucket_t *tb, double rate) {
+    if (tb->tokens >= 1.0) return 0;
+    return (uint64_t)((1.0 - tb->tokens) * 1e6 / rate) + 1;
+}
+
+/* Find or create the bucket for dest (lock held).  When the table is
+ * full the least recently used entry is recycled. */
+static peer_bucket_t *peer_bucket(pacer_t *p, const struct sockaddr_in *dest,
+                                  uint64_t now) {
+    int lru = 0;
+    for (int i = 0; i < p->npeers; i++) {
+        if (p->peers[i].addr.sin_port == dest->sin_port &&
+            p->peers[i].addr.sin_addr.s_addr == dest->sin_addr.s_addr)
+            return &p->peers[i];
+        if (p->peers[i].last_used_us < p->peers[lru].last_used_us) lru = i;
+    }
+    int idx = (p->npeers < PACER_MAX_PEERS) ? p->npeers++ : lru;
+    memset(&p->peers[idx], 0, sizeof(p->peers[idx]));
+    p->peers[idx].addr = *dest;
+    p->peers[idx].last_used_us = now;
+    return &p->peers[idx];
+}
+
+void pacer_init(pacer_t *p, double global_rate, double peer_rate) {
+    memset(p, 0, sizeof(*p));
+    p->global_rate = (global_rate > 0) ? global_rate : 0;
+    p->peer_rate   = (peer_rate   > 0) ? peer_rate   : 0;
+    p->scale       = 1.0;
+    pthread_mutex_init(&p->lock, NULL);
+}
+
+void pacer_destroy(pacer_t *p) {
+    pthread_mutex_destroy(&p->lock);
+}
+
+int pacer_enabled(pacer_t *p) {
+    return p->global_rate > 0 || p->peer_rate > 0;
+}
+
+uint64_t pacer_delay_us(pacer_t *p, const struct sockaddr_in *dest,
+                        int *peer_limited) {
+    *peer_limited = 0;
+    if (!pacer_enabled(p)) return 0;
+
+    uint64_t now = current_time_us();
+    uint64_t wait_global = 0, wait_peer = 0;
+
+    pthread_mutex_lock(&p->lock);
+    if (p->global_rate > 0) {
+        double rate = p->global_rate * p->scale;
+        bucket_refill(&p->global, rate, now);
+        wait_global = bucket_wait(&p->global, rate);
+    }
+    if (p->peer_rate > 0) {
+        double rate = p->peer_rate * p->scale;
+        peer_bucket_t *pb = peer_bucket(p, dest, now);
+        bucket_refill(&pb->tb, rate, now);
+        wait_peer = bucket_wait(&pb->tb, rate);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (wait_peer > wait_global) {
+        *peer_limited = 1;
+        return wait_peer;
+    }
+    return wait_global;
+}
+
+void pacer_consume(pacer_t *p, const struct sockaddr_in *dest) {
+    __atomic_fetch_add(&p->packets_sent, 1, __ATOMIC_RELAXED);
+    if (!pacer_enabled(p)) return;
+
+    uint64_t now = current_time_us();
+    pthread_mutex_lock(&p->lock);
+    if (p->global_rate > 0) p->global.tokens -= 1.0;
+    if (p->peer_rate > 0) {
+        peer_bucket_t *pb = peer_bucket(p, dest, now);
+        pb->tb.tokens -= 1.0;
+        pb->last_used_us = now;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pacer_note_ping(pacer_t *p) {
+    __atomic_fetch_add(&p->pings_sent, 1, __ATOMIC_RELAXED);
+}
+
+void pacer_note_pong(pacer_t *p) {
+    __atomic_fetch_add(&p->pongs_recv, 1, __ATOMIC_RELAXED);
+}
+
+void pacer_note_resend(pacer_t *p, int ids) {
+    __atomic_fetch_add(&p->resend_ids, (uint64_t)ids, __ATOMIC_RELAXED);
+}
+
+double pacer_adjust(pacer_t *p) {
+    uint64_t pings   = __atomic_exchange_n(&p->pings_sent,   0, __ATOMIC_RELAXED);
+    uint64_t pongs   = __atomic_exchange_n(&p->pongs_recv,   0, __ATOMIC_RELAXED);
+    uint64_t resends = __atomic_exchange_n(&p->resend_ids,   0, __ATOMIC_RELAXED);
+    uint64_t packets = __atomic_exchange_n(&p->packets_sent, 0, __ATOMIC_RELAXED);
+
+    double loss = 0.0;
+    if (pings > 0 && pongs < pings)
+        loss = (double)(pings - pongs) / (double)pings;
+    if (packets > 0) {
+        double resend_ratio = (double)resends / (double)packets;
+        if (resend_ratio > loss) loss = resend_ratio;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (loss > PACER_LOSS_THRESHOLD) {
+        p->scale *= 0.5;
+        if (p->scale < PACER_MIN_SCALE) p->scale = PACER_MIN_SCALE;
+    } else {
+        p->scale += PACER_ADD_STEP;
+        if (p->scale > 1.0) p->scale = 1.0;
+    }
+    double scale = p->scale;
+    pthread_mutex_unlock(&p->lock);
+    return scale;
+}
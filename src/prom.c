@@ -0,0 +1,249 @@
+#include "prom.h"
+#include "node.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+static const char *counter_help[NUM_COUNTERS] = {
+    "Datagrams queued for sending.",
+    "Datagrams dispatched to a handler.",
+    "GOSSIP messages dropped as already seen.",
+    "Datagrams shed by the ingress queue or of unknown type.",
+    "Datagrams dropped because the egress queue was full.",
+    "Bytes queued for sending.",
+    "Bytes received, including datagrams dropped on arrival.",
+    "Missing sequence numbers requested from peers.",
+    "Missing sequence numbers given up on.",
+    "Replicated state entries received that changed the local map.",
+};
+
+static const char *gauge_help[NUM_GAUGES] = {
+    "Peers in the membership table.",
+    "Message IDs held in the seen-set.",
+    "Messages held for IWANT replies.",
+    "Origins tracked with a sequence watermark.",
+    "Datagrams waiting in the ingress queue.",
+    "Datagrams waiting in the egress queue.",
+    "Keys in the replicated state map, deletions included.",
+    "Cluster size estimated by gossip aggregation (last epoch).",
+};
+
+static const char *hist_help[NUM_HISTOGRAMS] = {
+    "Time from a GOSSIP being queued on receipt to being relayed.",
+    "Round-trip time from PING to PONG.",
+    "Time from a traced GOSSIP being published to its first receipt here.",
+    "End-to-end latency of traced GOSSIP divided by its hop count.",
+    "Hops a traced GOSSIP took from its origin to this node.",
+};
+
+/* =========================================================
+ * Exposition format
+ * ========================================================= */
+
+/* "relay_us" -> "gossip_relay_seconds", "hops" -> "gossip_hops".
+ * Returns 1 for a time histogram (exported in seconds). */
+static int hist_metric_name(metric_hist_t h, char *out, size_t size) {
+    const char *name = metrics_hist_name(h);
+    size_t len = strlen(name);
+    if (len > 3 && strcmp(name + len - 3, "_us") == 0) {
+        snprintf(out, size, "gossip_%.*s_seconds", (int)len - 3, name);
+        return 1;
+    }
+    snprintf(out, size, "gossip_%s", name);
+    return 0;
+}
+
+int prom_format(node_t *node, char *buf, size_t size) {
+    metrics_t *m = &node->metrics;
+    size_t o = 0;
+#define EMIT(...) do { \
+        if (o < size) o += (size_t)snprintf(buf + o, size - o, __VA_ARGS__); \
+    } while (0)
+
+    node_metrics_sample(node);
+
+    EMIT("# HELP gossip_node_info Identity of this node.\n"
+         "# TYPE gossip_node_info gauge\n"
+         "gossip_node_info{node_id=\"%s\",addr=\"%s\"} 1\n",
+         node->node_id, node->self_addr);
+    EMIT("# HELP gossip_uptime_seconds Seconds since the node started.\n"
+         "# TYPE gossip_uptime_seconds gauge\n"
+         "gossip_uptime_seconds %llu\n",
+         (unsigned long long)((current_time_ms() - m->start_ms) / 1000));
+
+    /* Every registered type is exported, zero or not, so series are
+     * stable from the first scrape. */
+    int types = msg_type_count();
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        /* "sent" -> gossip_messages_sent_total,
+         * "sent_bytes" -> gossip_sent_bytes_total */
+        const char *name = metrics_counter_name((metric_counter_t)c);
+        const char *unit = strstr(name, "_bytes") ? "" : "messages_";
+        EMIT("# HELP gossip_%s%s_total %s\n"
+             "# TYPE gossip_%s%s_total counter\n",
+             unit, name, counter_help[c], unit, name);
+        for (int t = 0; t <= types; t++) {
+            int slot = (t < types) ? t : MAX_MSG_TYPES;
+            EMIT("gossip_%s%s_total{type=\"%s\"} %llu\n", unit, name,
+                 metrics_type_name(slot),
+                 (unsigned long long)metrics_counter(m, (metric_counter_t)c,
+                                                     slot));
+        }
+    }
+
+    for (int g = 0; g < NUM_GAUGES; g++) {
+        const char *name = metrics_gauge_name((metric_gauge_t)g);
+        EMIT("# HELP gossip_%s %s\n# TYPE gossip_%s gauge\ngossip_%s %lld\n",
+             name, gauge_help[g], name, name,
+             (long long)metrics_gauge(m, (metric_gauge_t)g));
+    }
+
+    for (int h = 0; h < NUM_HISTOGRAMS; h++) {
+        char name[64];
+        int secs = hist_metric_name((metric_hist_t)h, name, sizeof(name));
+        hist_summary_t s;
+        metrics_hist_summary(m, (metric_hist_t)h, &s);
+
+        EMIT("# HELP %s %s\n# TYPE %s histogram\n", name, hist_help[h], name);
+        if (secs) {
+            for (int e = PROM_HIST_MIN_EXP; e <= PROM_HIST_MAX_EXP; e++) {
+                uint64_t le = (1ull << e) - 1;   /* exact bucket boundary */
+                EMIT("%s_bucket{le=\"%.6f\"} %llu\n", name, (double)le / 1e6,
+                     (unsigned long long)metrics_hist_count_le(
+                         m, (metric_hist_t)h, le));
+            }
+        } else {
+            /* Small counts: one bucket per value below HIST_SUB is exact */
+            for (uint64_t le = 0; le < HIST_SUB; le++)
+                EMIT("%s_bucket{le=\"%llu\"} %llu\n", name,
+                     (unsigned long long)le,
+                     (unsigned long long)metrics_hist_count_le(
+                         m, (metric_hist_t)h, le));
+        }
+        EMIT("%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n",
+             name, (unsigned long long)s.count,
+             name, secs ? (double)s.sum / 1e6 : (double)s.sum,
+             name, (unsigned long long)s.count);
+    }
+#undef EMIT
+    return (int)(o < size ? o : size - 1);
+}
+
+/* =========================================================
+ * HTTP
+ * ========================================================= */
+
+static void send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+static void serve_client(prom_t *p, int fd) {
+    struct timeval tv = { PROM_TIMEOUT_MS / 1000,
+                          (PROM_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    /* Only the request line matters; read until the header ends */
+    char req[2048];
+    size_t got = 0;
+    while (got < sizeof(req) - 1) {
+        ssize_t n = recv(fd, req + got, sizeof(req) - 1 - got, 0);
+        if (n <= 0) break;
+        got += (size_t)n;
+        req[got] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[got] = '\0';
+
+    char header[160];
+    if (strncmp(req, "GET /metrics ", 13) != 0 &&
+        strncmp(req, "GET / ", 6) != 0) {
+        static const char nf[] =
+            "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n"
+            "Connection: close\r\n\r\n";
+        send_all(fd, nf, sizeof(nf) - 1);
+        return;
+    }
+
+    char *body = malloc(PROM_TEXT_SIZE);
+    if (!body) return;
+    int len = prom_format(p->node, body, PROM_TEXT_SIZE);
+    int hlen = snprintf(header, sizeof(header),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %d\r\n"
+                        "Connection: close\r\n\r\n", len);
+    send_all(fd, header, (size_t)hlen);
+    send_all(fd, body, (size_t)len);
+    free(body);
+}
+
+static void *prom_thread_func(void *arg) {
+    prom_t *p = arg;
+    struct pollfd pfd = { .fd = p->listen_fd, .events = POLLIN };
+
+    while (p->node->running) {
+        /* Wake up every 500 ms so we notice node->running */
+        if (poll(&pfd, 1, 500) <= 0) continue;
+        int fd = accept(p->listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        serve_client(p, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Lifecycle
+ * ========================================================= */
+
+prom_t *prom_open(node_t *node, int port) {
+    prom_t *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->node = node;
+    p->port = port;
+
+    p->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (p->listen_fd < 0) { perror("metrics socket"); free(p); return NULL; }
+
+    int opt = 1;
+    setsockopt(p->listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons((uint16_t)port);
+    if (bind(p->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(p->listen_fd, 16) < 0) {
+        perror("metrics bind");
+        close(p->listen_fd);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+int prom_start(prom_t *p) {
+    if (pthread_create(&p->thread, NULL, prom_thread_func, p) != 0)
+        return -1;
+    p->started = 1;
+    return 0;
+}
+
+void prom_close(prom_t *p) {
+    if (!p) return;
+    if (p->started) pthread_join(p->thread, NULL);
+    close(p->listen_fd);
+    free(p);
+}
@@ -0,0 +1,206 @@
+#include "queue.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+static const int wrr_weight[NUM_CLASSES] = {
+    [CLASS_CONTROL] = 0,               /* strict priority, not weighted */
+    [CLASS_PULL]    = WRR_PULL_WEIGHT,
+    [CLASS_DATA]    = WRR_DATA_WEIGHT,
+};
+
+/* Eviction order under overload: lower rank is shed first */
+static const int shed_rank[NUM_CLASSES] = {
+    [CLASS_PULL]    = 0,
+    [CLASS_DATA]    = 1,
+    [CLASS_CONTROL] = 2,
+};
+
+traffic_class_t msg_class(int type) {
+    return (traffic_class_t)msg_type_class(type);
+}
+
+int pqueue_init(packet_queue_t *q, int depth) {
+    memset(q, 0, sizeof(*q));
+    if (depth <= 0) depth = QUEUE_DEFAULT_DEPTH;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->nonempty, NULL);
+    /* One pool of depth packets; the classes only queue indices into it.
+     * Free slots are reused last-in first-out, so a queue that never
+     * fills touches only a few of its pages. */
+    q->pool       = calloc((size_t)depth, sizeof(packet_t));
+    q->free_slots = calloc((size_t)depth, sizeof(int));
+    int ok = q->pool && q->free_slots;
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        q->ring[c].idx = calloc((size_t)depth, sizeof(int));
+        ok = ok && q->ring[c].idx;
+        q->credit[c] = wrr_weight[c];
+    }
+    if (!ok) {
+        pqueue_destroy(q);
+        return -1;
+    }
+    for (int i = 0; i < depth; i++) q->free_slots[i] = depth - 1 - i;
+    q->nfree = depth;
+    q->limit = depth;
+    return 0;
+}
+
+void pqueue_destroy(packet_queue_t *q) {
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        free(q->ring[c].idx);
+        q->ring[c].idx = NULL;
+    }
+    free(q->free_slots);
+    free(q->pool);
+    q->free_slots = NULL;
+    q->pool = NULL;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->nonempty);
+}
+
+/* Append to the tail of a class (lock held, room checked) */
+static void ring_append(packet_queue_t *q, traffic_class_t cls,
+                        const char *data, int len,
+                        const struct sockaddr_in *addr, int tag) {
+    packet_ring_t *r = &q->ring[cls];
+    int i = q->free_slots[--q->nfree];
+    packet_t *slot = &q->pool[i];
+    slot->addr = *addr;
+    slot->len  = len;
+    slot->tag  = tag;
+    slot->queued_us = current_time_us();
+    memcpy(slot->data, data, (size_t)len);
+    r->idx[(r->head + r->count) % q->limit] = i;
+    r->count++;
+    q->count++;
+    pthread_cond_signal(&q->nonempty);
+}
+
+/* Remove the head of a class and return its pool slot (lock held, class
+ * non-empty).  The slot stays readable until the next append. */
+static packet_t *ring_shift(packet_queue_t *q, int cls) {
+    packet_ring_t *r = &q->ring[cls];
+    int i = r->idx[r->head];
+    r->head = (r->head + 1) % q->limit;
+    r->count--;
+    q->count--;
+    q->free_slots[q->nfree++] = i;
+    return &q->pool[i];
+}
+
+int pqueue_push(packet_queue_t *q, traffic_class_t cls,
+                const char *data, int len, const struct sockaddr_in *addr,
+                int tag) {
+    if (len < 0 || len > MAX_SERIALIZED_LEN) return -1;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->closed || q->count >= q->limit) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    ring_append(q, cls, data, len, addr, tag);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+int pqueue_push_shed(packet_queue_t *q, traffic_class_t cls,
+                     const char *data, int len,
+                     const struct sockaddr_in *addr, int tag,
+                     int *evicted_tag) {
+    *evicted_tag = -1;
+    if (len < 0 || len > MAX_SERIALIZED_LEN) return -1;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+
+    if (q->count >= q->limit) {
+        /* Find the lowest-ranked non-empty class below the newcomer */
+        int victim = -1;
+        for (int c = 0; c < NUM_CLASSES; c++) {
+            if (q->ring[c].count == 0 || shed_rank[c] >= shed_rank[cls])
+                continue;
+            if (victim < 0 || shed_rank[c] < shed_rank[victim]) victim = c;
+        }
+        if (victim < 0) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        *evicted_tag = ring_shift(q, victim)->tag;
+    }
+
+    ring_append(q, cls, data, len, addr, tag);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/* Pick the class to serve next (lock held).  Returns -1 if all empty. */
+static int next_class(packet_queue_t *q) {
+    if (q->ring[CLASS_CONTROL].count > 0) return CLASS_CONTROL;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int c = CLASS_DATA; c > CLASS_CONTROL; c--) {
+            if (q->ring[c].count > 0 && q->credit[c] > 0) {
+                q->credit[c]--;
+                return c;
+            }
+        }
+        /* Round exhausted – refill credits and try again */
+        for (int c = 0; c < NUM_CLASSES; c++) q->credit[c] = wrr_weight[c];
+    }
+    return -1;
+}
+
+int pqueue_pop(packet_queue_t *q, packet_t *out, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    int cls;
+    while ((cls = next_class(q)) < 0) {
+        if (q->closed ||
+            pthread_cond_timedwait(&q->nonempty, &q->lock, &deadline)
+                == ETIMEDOUT) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+    }
+
+    packet_t *slot = ring_shift(q, cls);
+    out->addr = slot->addr;
+    out->len  = slot->len;
+    out->tag  = slot->tag;
+    out->queued_us = slot->queued_us;
+    memcpy(out->data, slot->data, (size_t)slot->len);
+    pthread_mutex_unlock(&q->lock);
+    return cls;
+}
+
+int pqueue_pending(packet_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    int n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+int pqueue_limit(packet_queue_t *q) {
+    return q->limit;
+}
+
+void pqueue_close(packet_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
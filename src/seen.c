@@ -0,0 +1,119 @@
+#include "seen.h"
+#include <stdlib.h>
+#include <string.h>
+
+int seen_init(seen_set_t *s, int capacity) {
+    memset(s, 0, sizeof(*s));
+    if (capacity <= 0) return -1;
+
+    uint32_t size = 1;
+    while (size < (uint32_t)capacity * 2) size <<= 1;
+
+    s->ids    = calloc((size_t)capacity, ID_LEN);
+    s->hashes = calloc((size_t)capacity, sizeof(uint32_t));
+    s->index  = malloc(size * sizeof(int32_t));
+    if (!s->ids || !s->hashes || !s->index) {
+        seen_free(s);
+        return -1;
+    }
+    memset(s->index, 0xff, size * sizeof(int32_t));   /* all -1 */
+    s->capacity   = capacity;
+    s->index_mask = size - 1;
+    return 0;
+}
+
+void seen_free(seen_set_t *s) {
+    free(s->ids);
+    free(s->hashes);
+    free(s->index);
+    memset(s, 0, sizeof(*s));
+}
+
+/* FNV-1a */
+uint32_t seen_hash(const char *id) {
+    uint32_t h = 2166136261u;
+    while (*id) {
+        h ^= (uint8_t)*id++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Table position holding ring slot `slot`, or the empty position where
+ * `id` would go.  Sets *found accordingly. */
+static uint32_t probe(const seen_set_t *s, const char *id, uint32_t h,
+                      int *found) {
+    uint32_t pos = h & s->index_mask;
+    for (;;) {
+        int32_t slot = s->index[pos];
+        if (slot < 0) {
+            *found = 0;
+            return pos;
+        }
+        if (s->hashes[slot] == h && strcmp(s->ids[slot], id) == 0) {
+            *found = 1;
+            return pos;
+        }
+        pos = (pos + 1) & s->index_mask;
+    }
+}
+
+/* Remove the index entry at pos, shifting later entries of the same
+ * probe run back so lookups never stop at a hole. */
+static void index_delete(seen_set_t *s, uint32_t pos) {
+    uint32_t hole = pos, next = pos;
+    for (;;) {
+        next = (next + 1) & s->index_mask;
+        int32_t slot = s->index[next];
+        if (slot < 0) break;
+        uint32_t home = s->hashes[slot] & s->index_mask;
+        /* Can this entry legally move into the hole? */
+        int movable = (hole <= next) ? (home <= hole || home > next)
+                                     : (home <= hole && home > next);
+        if (movable) {
+            s->index[hole] = slot;
+            hole = next;
+        }
+    }
+    s->index[hole] = -1;
+}
+
+int seen_contains(const seen_set_t *s, const char *id) {
+    int found;
+    probe(s, id, seen_hash(id), &found);
+    return found;
+}
+
+int seen_insert(seen_set_t *s, const char *id) {
+    uint32_t h = seen_hash(id);
+    int found;
+    probe(s, id, h, &found);
+    if (found) return 1;
+
+    int slot = (int)(s->count % (uint64_t)s->capacity);
+    if (s->count >= (uint64_t)s->capacity) {
+        /* Evict the oldest ID occupying this ring slot */
+        int old_found;
+        uint32_t old = probe(s, s->ids[slot], s->hashes[slot], &old_found);
+        if (old_found) index_delete(s, old);
+    }
+
+    strncpy(s->ids[slot], id, ID_LEN - 1);
+    s->ids[slot][ID_LEN - 1] = '\0';
+    s->hashes[slot] = h;
+
+    uint32_t pos = probe(s, s->ids[slot], h, &found);
+    s->index[pos] = slot;
+    s->count++;
+    return 0;
+}
+
+int seen_size(const seen_set_t *s) {
+    return (s->count < (uint64_t)s->capacity) ? (int)s->count : s->capacity;
+}
+
+const char *seen_recent(const seen_set_t *s, int i) {
+    if (i < 0 || i >= seen_size(s)) return NULL;
+    uint64_t pos = s->count - 1 - (uint64_t)i;
+    return s->ids[pos % (uint64_t)s->capacity];
+}
@@ -4,6 +4,20 @@
 #include <inttypes.h>
 
 int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size) {
+    /* Optional header fields sit between "ttl" and "payload" */
+    char opt[TOPIC_LEN + DEPS_LEN + 80] = "";
+    int o = 0;
+    if (msg->topic[0])
+        o += snprintf(opt + o, sizeof(opt) - (size_t)o,
+                      "\"topic\":\"%s\",", msg->topic);
+    if (msg->origin_ttl > 0)
+        o += snprintf(opt + o, sizeof(opt) - (size_t)o,
+                      "\"origin_ttl\":%d,\"origin_us\":%llu,", msg->origin_ttl,
+                      (unsigned long long)msg->origin_us);
+    if (msg->deps[0])
+        snprintf(opt + o, sizeof(opt) - (size_t)o,
+                 "\"deps\":\"%s\",", msg->deps);
+
     return snprintf(buffer, buf_size,
         "{"
         "\"version\":%d,"
@@ -13,6 +27,7 @@ int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size) {
         "\"sender_addr\":\"%s\","
         "\"timestamp_ms\":%llu,"
         "\"ttl\":%d,"
+        "%s"
         "\"payload\":%s"
         "}",
         msg->version,
@@ -22,6 +37,7 @@ int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size) {
         msg->sender_addr,
         (unsigned long long)msg->timestamp_ms,
         msg->ttl,
+        opt,
         msg->payload   /* payload must already be valid JSON */
     );
 }
@@ -30,6 +46,8 @@ int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size) {
  * Minimal hand-rolled deserializer.
  * We use a two-pass approach:
  *   1. Parse all scalar fields with sscanf up to "payload":
+ *      (optional fields "topic", then "origin_ttl"/"origin_us", then
+ *      "deps", follow "ttl" when present)
  *   2. Find the payload JSON value by scanning for the key and
  *      copying everything until the final closing '}'.
  *
@@ -39,6 +57,7 @@ int serialize_message(const gossip_msg_t *msg, char *buffer, size_t buf_size) {
 int deserialize_message(const char *buffer, gossip_msg_t *msg) {
     /* Temporary holders for sscanf */
     unsigned long long ts = 0;
+    int consumed = 0;
 
     int items = sscanf(buffer,
         "{"
@@ -48,19 +67,48 @@ int deserialize_message(const char *buffer, gossip_msg_t *msg) {
         "\"sender_id\":\"%63[^\"]\","
         "\"sender_addr\":\"%63[^\"]\","
         "\"timestamp_ms\":%llu,"
-        "\"ttl\":%d,",
+        "\"ttl\":%d,%n",
         &msg->version,
         msg->msg_id,
         msg->msg_type,
         msg->sender_id,
         msg->sender_addr,
         &ts,
-        &msg->ttl
+        &msg->ttl,
+        &consumed
     );
 
-    if (items < 7) return -1;
+    if (items < 7 || consumed == 0) return -1;
+
+    /* Optional fields default to absent */
+    msg->topic[0]   = '\0';
+    msg->origin_ttl = 0;
+    msg->origin_us  = 0;
+    msg->deps[0]    = '\0';
+
+    const char *opt = buffer + consumed;
+    int n = 0;
+    if (strncmp(opt, "\"topic\":\"", 9) == 0 &&
+        sscanf(opt, "\"topic\":\"%63[^\"]\",%n", msg->topic, &n) == 1 && n > 0)
+        opt += n;
+    unsigned long long origin_us = 0;
+    n = 0;
+    if (strncmp(opt, "\"origin_ttl\":", 13) == 0 &&
+        sscanf(opt, "\"origin_ttl\":%d,\"origin_us\":%llu,%n",
+               &msg->origin_ttl, &origin_us, &n) == 2 && n > 0) {
+        msg->origin_us = (uint64_t)origin_us;
+        opt += n;
+    } else {
+        msg->origin_ttl = 0;   /* partial match */
+    }
+    n = 0;
+    if (strncmp(opt, "\"deps\":\"", 8) == 0 &&
+        (sscanf(opt, "\"deps\":\"%1023[^\"]\",%n", msg->deps, &n) != 1 ||
+         n == 0))
+        msg->deps[0] = '\0';
 
     msg->timestamp_ms = (uint64_t)ts;
+    msg->type = msg_type_lookup(msg->msg_type);
 
     /* Extract payload: find "payload": and copy the JSON value */
     const char *key = "\"payload\":";
@@ -89,3 +137,57 @@ int deserialize_message(const char *buffer, gossip_msg_t *msg) {
 
     return 0;
 }
+
+int wire_peek_field(const char *buffer, const char *field,
+                    char *out, size_t out_size) {
+    char key[48];
+    int klen = snprintf(key, sizeof(key), "\"%s\":\"", field);
+    if (klen <= 0 || (size_t)klen >= sizeof(key)) return -1;
+
+    const char *p = strstr(buffer, key);
+    if (!p) return -1;
+    p += klen;
+
+    size_t n = 0;
+    while (p[n] && p[n] != '"') {
+        if (n + 1 >= out_size) return -1;
+        out[n] = p[n];
+        n++;
+    }
+    out[n] = '\0';
+    return 0;
+}
+
+/* Copy a quoted string body up to the closing '"'; returns the position
+ * after the quote, or NULL if it is unterminated or too long. */
+static const char *copy_quoted(const char *p, char *out, size_t out_size) {
+    size_t n = 0;
+    while (p[n] != '"') {
+        if (p[n] == '\0' || n + 1 >= out_size) return NULL;
+        out[n] = p[n];
+        n++;
+    }
+    out[n] = '\0';
+    return p + n + 1;
+}
+
+int wire_peek_header(const char *buffer,
+                     char *id_out, size_t id_size,
+                     char *type_out, size_t type_size) {
+    static const char v_key[]  = "{\"version\":";
+    static const char id_key[] = ",\"msg_id\":\"";
+    static const char ty_key[] = ",\"msg_type\":\"";
+
+    const char *p = buffer;
+    if (strncmp(p, v_key, sizeof(v_key) - 1) != 0) return -1;
+    p += sizeof(v_key) - 1;
+    while (*p >= '0' && *p <= '9') p++;
+
+    if (strncmp(p, id_key, sizeof(id_key) - 1) != 0) return -1;
+    p = copy_quoted(p + sizeof(id_key) - 1, id_out, id_size);
+    if (!p) return -1;
+
+    if (strncmp(p, ty_key, sizeof(ty_key) - 1) != 0) return -1;
+    p = copy_quoted(p + sizeof(ty_key) - 1, type_out, type_size);
+    return p ? 0 : -1;
+}
@@ -0,0 +1,50 @@
+#include "store.h"
+#include "serialization.h"
+#include "compress.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int store_init(gossip_store_t *s, int capacity) {
+    memset(s, 0, sizeof(*s));
+    if (capacity <= 0) return -1;
+    s->items = calloc((size_t)capacity, sizeof(stored_gossip_t));
+    if (!s->items) return -1;
+    s->capacity = capacity;
+    return 0;
+}
+
+void store_free(gossip_store_t *s) {
+    free(s->items);
+    memset(s, 0, sizeof(*s));
+}
+
+void store_put(gossip_store_t *s, const gossip_msg_t *msg) {
+    stored_gossip_t *sg = &s->items[s->count % (uint64_t)s->capacity];
+    strncpy(sg->msg_id, msg->msg_id, ID_LEN - 1);
+    sg->msg_id[ID_LEN - 1] = '\0';
+    sg->codec = payload_codec(msg->payload);
+    snprintf(sg->topic, sizeof(sg->topic), "%s", msg->topic);
+    serialize_message(msg, sg->serialized, MAX_SERIALIZED_LEN);
+    s->count++;
+}
+
+stored_gossip_t *store_find(gossip_store_t *s, const char *msg_id) {
+    int total = store_size(s);
+    for (int i = 0; i < total; i++) {
+        if (strcmp(s->items[i].msg_id, msg_id) == 0)
+            return &s->items[i];
+    }
+    return NULL;
+}
+
+int store_size(const gossip_store_t *s) {
+    return (s->count < (uint64_t)s->capacity) ? (int)s->count : s->capacity;
+}
+
+stored_gossip_t *store_recent(gossip_store_t *s, int i) {
+    if (i < 0 || i >= store_size(s)) return NULL;
+    uint64_t pos = s->count - 1 - (uint64_t)i;
+    return &s->items[pos % (uint64_t)s->capacity];
+}
@@ -0,0 +1,124 @@
+#include "trace.h"
+
+#ifdef GOSSIP_TRACE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    int      tp;
+} trace_span_t;
+
+typedef struct trace_ring {
+    trace_span_t      *spans;
+    uint64_t           count;   /* spans ever recorded; ring index = count % size */
+    int                tid;
+    char               name[32];
+    struct trace_ring *next;
+} trace_ring_t;
+
+static const char *tp_names[NUM_TRACE_POINTS] = {
+    "peek", "rx_dedup", "deserialize", "handle",
+    "dedup", "store", "relay", "serialize", "send"
+};
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t   *rings;
+static int             next_tid = 1;
+
+/* Reference point for converting ticks to microseconds */
+static uint64_t base_ticks, base_ns;
+
+static __thread trace_ring_t *my_ring;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Allocate and register the calling thread's ring (first use only) */
+static trace_ring_t *ring_get(void) {
+    if (my_ring) return my_ring;
+
+    trace_ring_t *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->spans = calloc(TRACE_RING_SIZE, sizeof(trace_span_t));
+    if (!r->spans) { free(r); return NULL; }
+
+    pthread_mutex_lock(&rings_lock);
+    if (!rings) {
+        base_ticks = trace_ticks();
+        base_ns    = mono_ns();
+    }
+    r->tid  = next_tid++;
+    snprintf(r->name, sizeof(r->name), "thread-%d", r->tid);
+    r->next = rings;
+    rings   = r;
+    pthread_mutex_unlock(&rings_lock);
+
+    my_ring = r;
+    return r;
+}
+
+void trace_record(trace_point_t tp, uint64_t start, uint64_t end) {
+    trace_ring_t *r = ring_get();
+    if (!r) return;
+    trace_span_t *s = &r->spans[r->count & (TRACE_RING_SIZE - 1)];
+    s->start = start;
+    s->end   = end;
+    s->tp    = tp;
+    /* Publish after the span is written so a concurrent dump never
+     * reads a half-filled slot as new */
+    __atomic_store_n(&r->count, r->count + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread_name(const char *name) {
+    trace_ring_t *r = ring_get();
+    if (r) snprintf(r->name, sizeof(r->name), "%s", name);
+}
+
+int trace_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    pthread_mutex_lock(&rings_lock);
+
+    /* Ticks per microsecond, measured over the whole run */
+    uint64_t ticks = trace_ticks() - base_ticks;
+    uint64_t ns    = mono_ns() - base_ns;
+    double per_us  = (ns > 0) ? (double)ticks * 1000.0 / (double)ns : 1.0;
+    if (per_us <= 0) per_us = 1.0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    int first = 1;
+    for (trace_ring_t *r = rings; r; r = r->next) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",\n", r->tid, r->name);
+        first = 0;
+
+        uint64_t count = __atomic_load_n(&r->count, __ATOMIC_ACQUIRE);
+        uint64_t from  = (count > TRACE_RING_SIZE) ? count - TRACE_RING_SIZE : 0;
+        for (uint64_t i = from; i < count; i++) {
+            const trace_span_t *s = &r->spans[i & (TRACE_RING_SIZE - 1)];
+            double ts  = (double)(s->start - base_ticks) / per_us;
+            double dur = (double)(s->end - s->start) / per_us;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%.3f,\"dur\":%.3f}",
+                    tp_names[s->tp], r->tid, ts, dur);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    pthread_mutex_unlock(&rings_lock);
+    fclose(f);
+    return 0;
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "utils.h"
 #include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
@@ -78,10 +79,14 @@ static void s256_final(S256 *c, uint8_t h[32]){
         h[i+24]=(c->s[6]>>(24-i*8))&0xff;h[i+28]=(c->s[7]>>(24-i*8))&0xff;}
 }
 
+void sha256(const void *data, size_t len, uint8_t digest[32]){
+    S256 ctx; s256_init(&ctx); s256_update(&ctx,(const uint8_t*)data,len);
+    s256_final(&ctx,digest);
+}
+
 static void sha256_hex(const char *node_id, unsigned long nonce, char *hex_out){
     char input[256]; int ilen=snprintf(input,sizeof(input),"%s%lu",node_id,nonce);
-    S256 ctx; s256_init(&ctx); s256_update(&ctx,(const uint8_t*)input,(size_t)ilen);
-    uint8_t digest[32]; s256_final(&ctx,digest);
+    uint8_t digest[32]; sha256(input,(size_t)ilen,digest);
     for(int i=0;i<32;i++) snprintf(hex_out+i*2,3,"%02x",digest[i]);
     hex_out[64]='\0';
 }
@@ -93,6 +98,20 @@ uint64_t current_time_ms(void){
     return (uint64_t)tv.tv_sec*1000+(uint64_t)tv.tv_usec/1000;
 }
 
+uint64_t current_time_us(void){
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec*1000000+(uint64_t)ts.tv_nsec/1000;
+}
+
+uint64_t wall_time_us(void){
+    struct timeval tv; gettimeofday(&tv,NULL);
+    return (uint64_t)tv.tv_sec*1000000+(uint64_t)tv.tv_usec;
+}
+void sleep_us(uint64_t us){
+    struct timespec ts={(time_t)(us/1000000),(long)(us%1000000)*1000};
+    nanosleep(&ts,NULL);
+}
+
 int pow_check(const char *node_id, unsigned long nonce, int difficulty, char *digest_hex_out){
     char hex[65]; sha256_hex(node_id,nonce,hex);
     if(digest_hex_out) memcpy(digest_hex_out,hex,65);
@@ -0,0 +1,257 @@
+#include "watermark.h"
+#include "seen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WM_WORDS        (WM_WINDOW / 64)
+#define WM_INITIAL_CAP  64
+
+/* =========================================================
+ * Window bitmap
+ * ========================================================= */
+
+static int bit_get(const origin_state_t *o, uint64_t i) {
+    return (int)((o->above[i / 64] >> (i % 64)) & 1);
+}
+
+static void bit_set(origin_state_t *o, uint64_t i) {
+    o->above[i / 64] |= 1ull << (i % 64);
+}
+
+/* Drop the lowest k bits (bit k becomes bit 0) */
+static void shift_down(origin_state_t *o, uint64_t k) {
+    if (k >= WM_WINDOW) {
+        memset(o->above, 0, sizeof(o->above));
+        return;
+    }
+    int words = (int)(k / 64), bits = (int)(k % 64);
+    for (int w = 0; w < WM_WORDS; w++) {
+        uint64_t lo = (w + words < WM_WORDS) ? o->above[w + words] : 0;
+        uint64_t hi = (w + words + 1 < WM_WORDS) ? o->above[w + words + 1] : 0;
+        o->above[w] = bits ? (lo >> bits) | (hi << (64 - bits)) : lo;
+    }
+}
+
+/* Move the watermark over everything that has arrived */
+static void advance(origin_state_t *o) {
+    uint64_t run = 0;
+    while (run < WM_WINDOW && bit_get(o, run)) run++;
+    if (run == 0) return;
+    shift_down(o, run);
+    o->contiguous += run;
+}
+
+static void update_gap(watermark_table_t *t, origin_state_t *o,
+                       uint64_t now_us) {
+    int has = o->max_seq > o->contiguous;
+    if (has && !o->gap_since_us) {
+        o->gap_since_us   = now_us ? now_us : 1;
+        o->next_repair_us = 0;
+        o->repair_tries   = 0;
+        t->open_gaps++;
+    } else if (!has && o->gap_since_us) {
+        o->gap_since_us = 0;
+        t->open_gaps--;
+    }
+}
+
+/* =========================================================
+ * Origin table
+ * ========================================================= */
+
+int wm_init(watermark_table_t *t) {
+    memset(t, 0, sizeof(*t));
+    t->slots = calloc(WM_INITIAL_CAP, sizeof(origin_state_t));
+    if (!t->slots) return -1;
+    t->mask = WM_INITIAL_CAP - 1;
+    return 0;
+}
+
+void wm_free(watermark_table_t *t) {
+    free(t->slots);
+    t->slots = NULL;
+}
+
+int wm_parse_id(const char *msg_id, char *origin, size_t size, uint64_t *seq) {
+    const char *us = strrchr(msg_id, '_');
+    if (!us || us == msg_id || (size_t)(us - msg_id) >= size) return -1;
+    const char *d = us + 1;
+    if (*d < '1' || *d > '9') return -1;
+    uint64_t v = 0;
+    for (; *d; d++) {
+        if (*d < '0' || *d > '9') return -1;
+        v = v * 10 + (uint64_t)(*d - '0');
+    }
+    memcpy(origin, msg_id, (size_t)(us - msg_id));
+    origin[us - msg_id] = '\0';
+    *seq = v;
+    return 0;
+}
+
+static origin_state_t *find(const watermark_table_t *t, const char *origin) {
+    uint32_t i = seen_hash(origin) & t->mask;
+    for (;;) {
+        origin_state_t *o = &t->slots[i];
+        if (!o->origin[0]) return NULL;
+        if (strcmp(o->origin, origin) == 0) return o;
+        i = (i + 1) & t->mask;
+    }
+}
+
+origin_state_t *wm_find(const watermark_table_t *t, const char *origin) {
+    return find(t, origin);
+}
+
+static int grow(watermark_table_t *t) {
+    uint32_t cap = (t->mask + 1) * 2;
+    origin_state_t *slots = calloc(cap, sizeof(origin_state_t));
+    if (!slots) return -1;
+    for (uint32_t j = 0; j <= t->mask; j++) {
+        origin_state_t *o = &t->slots[j];
+        if (!o->origin[0]) continue;
+        uint32_t i = seen_hash(o->origin) & (cap - 1);
+        while (slots[i].origin[0]) i = (i + 1) & (cap - 1);
+        slots[i] = *o;
+    }
+    free(t->slots);
+    t->slots = slots;
+    t->mask  = cap - 1;
+    return 0;
+}
+
+/* Existing entry for origin, or a new one starting just below seq */
+static origin_state_t *find_or_add(watermark_table_t *t, const char *origin,
+                                   uint64_t seq) {
+    origin_state_t *o = find(t, origin);
+    if (o) return o;
+    if (t->count >= WM_MAX_ORIGINS || strlen(origin) >= NODE_ID_LEN)
+        return NULL;
+    if ((uint32_t)(t->count + 1) * 2 > t->mask + 1 && grow(t) != 0)
+        return NULL;
+
+    uint32_t i = seen_hash(origin) & t->mask;
+    while (t->slots[i].origin[0]) i = (i + 1) & t->mask;
+    o = &t->slots[i];
+    memset(o, 0, sizeof(*o));
+    strcpy(o->origin, origin);
+    uint64_t back = (seq - 1 < WM_JOIN_SLACK) ? seq - 1 : WM_JOIN_SLACK;
+    o->contiguous  = seq - 1 - back;
+    o->max_seq     = o->contiguous;
+    o->repair_from = seq;
+    t->count++;
+    return o;
+}
+
+int wm_contains(const watermark_table_t *t, const char *origin, uint64_t seq) {
+    const origin_state_t *o = find(t, origin);
+    if (!o) return t->count >= WM_MAX_ORIGINS ? -1 : 0;
+    if (seq <= o->contiguous) return 1;
+    uint64_t off = seq - o->contiguous - 1;
+    return off < WM_WINDOW && bit_get(o, off);
+}
+
+/* Make room for seq at the top of the window, giving up on what the
+ * watermark jumps over */
+static void slide_to(watermark_table_t *t, origin_state_t *o, uint64_t seq) {
+    uint64_t base = seq - WM_WINDOW;
+    for (uint64_t s = o->contiguous + 1; s <= base; s++) {
+        uint64_t off = s - o->contiguous - 1;
+        if (off >= WM_WINDOW) { t->skipped += base - s + 1; break; }
+        if (!bit_get(o, off)) t->skipped++;
+    }
+    shift_down(o, base - o->contiguous);
+    o->contiguous = base;
+    advance(o);
+}
+
+static int mark(watermark_table_t *t, origin_state_t *o, uint64_t seq,
+                uint64_t now_us) {
+    if (seq <= o->contiguous) return 1;
+    if (seq - o->contiguous > WM_WINDOW) slide_to(t, o, seq);
+    uint64_t off = seq - o->contiguous - 1;
+    if (bit_get(o, off)) return 1;
+    bit_set(o, off);
+    if (seq > o->max_seq) o->max_seq = seq;
+    advance(o);
+    update_gap(t, o, now_us);
+    return 0;
+}
+
+int wm_insert(watermark_table_t *t, const char *origin, uint64_t seq,
+              const struct sockaddr_in *from, uint64_t now_us) {
+    origin_state_t *o = find_or_add(t, origin, seq);
+    if (!o) return -1;
+    uint64_t prev_max = o->max_seq;
+    int dup = mark(t, o, seq, now_us);
+    if (!dup && from && seq > prev_max) o->relayer = *from;
+    return dup;
+}
+
+void wm_skip(watermark_table_t *t, const char *origin, uint64_t seq,
+             uint64_t now_us) {
+    origin_state_t *o = find_or_add(t, origin, seq);
+    if (o) mark(t, o, seq, now_us);
+}
+
+uint64_t wm_watermark(const watermark_table_t *t, const char *origin) {
+    const origin_state_t *o = find(t, origin);
+    return o ? o->contiguous : 0;
+}
+
+int wm_missing(const origin_state_t *o, uint64_t *out, int max) {
+    int n = 0;
+    uint64_t span = o->max_seq - o->contiguous;
+    if (span > WM_WINDOW) span = WM_WINDOW;
+    for (uint64_t i = 0; i < span && n < max; i++)
+        if (!bit_get(o, i)) out[n++] = o->contiguous + 1 + i;
+    return n;
+}
+
+int wm_missing_ranges(const watermark_table_t *t, const char *origin,
+                      uint64_t peer_max, uint64_t (*ranges)[2], int max) {
+    const origin_state_t *o = find(t, origin);
+    if (!o) {
+        if (peer_max == 0 || max < 1) return 0;
+        ranges[0][0] = (peer_max > WM_JOIN_SLACK) ? peer_max - WM_JOIN_SLACK : 1;
+        ranges[0][1] = peer_max;
+        return 1;
+    }
+
+    uint64_t lo = o->contiguous + 1;
+    if (lo < o->repair_from) lo = o->repair_from;
+    uint64_t hi = peer_max;
+    if (hi > o->contiguous + WM_WINDOW) hi = o->contiguous + WM_WINDOW;
+
+    int n = 0;
+    for (uint64_t s = lo; s <= hi; s++) {
+        if (bit_get(o, s - o->contiguous - 1)) continue;
+        if (n > 0 && ranges[n - 1][1] == s - 1) {
+            ranges[n - 1][1] = s;
+        } else {
+            if (n == max) break;
+            ranges[n][0] = ranges[n][1] = s;
+            n++;
+        }
+    }
+    return n;
+}
+
+int wm_abandon(watermark_table_t *t, origin_state_t *o, uint64_t upto) {
+    int n = 0;
+    uint64_t span = o->max_seq - o->contiguous;
+    if (span > WM_WINDOW) span = WM_WINDOW;
+    for (uint64_t i = 0; i < span && o->contiguous + 1 + i <= upto; i++) {
+        if (!bit_get(o, i)) {
+            bit_set(o, i);
+            n++;
+        }
+    }
+    advance(o);
+    update_gap(t, o, 0);
+    return n;
+}
+
+origin_state_t *wm_slot(watermark_table_t *t, uint32_t i) {
+    return t->slots[i].origin[0] ? &t->slots[i] : NULL;
+}
@@ -0,0 +1,764 @@
+/* gossip_churn – membership behaviour under node churn
+ *
+ *   gossip_churn [options]
+ *
+ *   -n <n>      cluster size (default 50)
+ *   -c <frac>   fraction of nodes that churn; the rest stay up
+ *               (default 0.5)
+ *   -u <dist>   session length of a churning node, seconds (default exp:10)
+ *   -d <dist>   downtime before it rejoins, seconds (default exp:3)
+ *   -T <secs>   churn and publish for this long (default 30)
+ *   -W <ms>     settle time after the last message; also the window a
+ *               node must stay up to count as a receiver (default 2000)
+ *   -r <n>      messages published per second (default 5)
+ *   -f/-t/-l    fanout, TTL, peer limit (default 3, 5, 20)
+ *   -i <secs>   ping interval (default 1)
+ *   -X <secs>   peer timeout (default 3)
+ *   -q <secs>   pull interval, 0 = push only (default 0)
+ *   -s <seed>   schedule seed (default 42)
+ *   -F <spec>   fault spec for every node (see fault.h)
+ *   -p <port>   first UDP port (default 21000)
+ *   -o <path>   append one JSON object (default results/churn.jsonl,
+ *               "-" = none)
+ *   -v          print a membership line every second
+ *
+ * Distributions: fixed:V, uniform:LO-HI, exp:MEAN, pareto:MEAN[:ALPHA]
+ * (alpha defaults to 1.5; heavy-tailed sessions as seen in real P2P).
+ *
+ * All nodes live in this process.  They start with peer_limit random
+ * peers already known.  A churning node then alternates between up and
+ * down.  Going down is a crash: node_stop() silences it at once and
+ * nothing is said to its peers (the protocol has no goodbye message).
+ * Coming back up starts a fresh node, with a new node id and empty
+ * state, on the same port.  It bootstraps off a random live node.
+ *
+ * Reported:
+ *   delivery     share of (message, node) pairs delivered, counting a
+ *                node only if one incarnation of it stayed up from
+ *                publish until publish + W.  Split by stable and
+ *                churning nodes.
+ *   removal_ms   crash until no live node lists the dead address
+ *                (failure detection across the cluster)
+ *   half_ms      crash until at most half as many live nodes list it as
+ *                did at the crash (peer lists keep re-advertising dead
+ *                addresses, so full removal may never happen)
+ *   unpurged     crashed nodes that rejoined before that happened
+ *   join_ms      restart until the node's own view is full and at least
+ *                `fanout` live nodes list it
+ *   false_rm     peer removals of a node that was up, and had been up
+ *                for a whole peer timeout, when it was dropped
+ *   stale        mean share of view entries naming a node that is down */
+#define _GNU_SOURCE
+#include "node.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#define CHURN_TOPIC   "churn"
+#define THREAD_STACK  (256 * 1024)
+#define SAMPLE_US     50000           /* membership scan period */
+#define MAX_CELLS     (64u << 20)     /* delivered[] bytes */
+
+/* Per-node resources, as in gossip_experiment */
+#define CHURN_QUEUE_DEPTH 32
+#define CHURN_STORE       64
+
+/* =========================================================
+ * Distributions
+ * ========================================================= */
+
+typedef enum { D_FIXED, D_UNIFORM, D_EXP, D_PARETO } dist_kind_t;
+
+typedef struct {
+    dist_kind_t kind;
+    double a, b;      /* fixed: a; uniform: [a, b]; exp: mean a;
+                         pareto: mean a, alpha b */
+    char   text[48];
+} dist_t;
+
+static int parse_dist(const char *s, dist_t *d) {
+    memset(d, 0, sizeof(*d));
+    snprintf(d->text, sizeof(d->text), "%s", s);
+    if (sscanf(s, "fixed:%lf", &d->a) == 1) {
+        d->kind = D_FIXED;
+    } else if (sscanf(s, "uniform:%lf-%lf", &d->a, &d->b) == 2) {
+        d->kind = D_UNIFORM;
+        if (d->b < d->a) return -1;
+    } else if (sscanf(s, "exp:%lf", &d->a) == 1) {
+        d->kind = D_EXP;
+    } else if (strncmp(s, "pareto:", 7) == 0) {
+        d->kind = D_PARETO;
+        d->b = 1.5;
+        if (sscanf(s + 7, "%lf:%lf", &d->a, &d->b) < 1 || d->b <= 1)
+            return -1;
+    } else {
+        return -1;
+    }
+    return d->a >= 0 ? 0 : -1;
+}
+
+static double uniform01(unsigned *rs) {
+    return ((double)rand_r(rs) + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+/* Seconds */
+static double dist_draw(const dist_t *d, unsigned *rs) {
+    switch (d->kind) {
+    case D_FIXED:   return d->a;
+    case D_UNIFORM: return d->a + (d->b - d->a) * uniform01(rs);
+    case D_EXP:     return -d->a * log(uniform01(rs));
+    case D_PARETO: {
+        double xm = d->a * (d->b - 1) / d->b;
+        return xm / pow(uniform01(rs), 1.0 / d->b);
+    }
+    }
+    return d->a;
+}
+
+/* =========================================================
+ * Node slots
+ * ========================================================= */
+
+typedef enum { SLOT_UP, SLOT_STOPPING, SLOT_DOWN, SLOT_STARTING } slot_state_t;
+
+typedef struct {
+    uint64_t up_us, down_us;     /* down_us 0 while up */
+} session_t;
+
+typedef struct slot slot_t;
+
+typedef struct {
+    slot_t   *slots;
+    int       n;
+    pthread_mutex_t lock;        /* slot states, sessions, join/removal
+                                    bookkeeping; the sampler holds it while
+                                    it reads memberships */
+    int       msgs;
+    uint64_t *published_us;
+    uint8_t  *delivered;         /* [msg * n + slot] */
+
+    int      *known_by;          /* live views listing each slot, as of
+                                    the last sample */
+    /* Samples, in us */
+    uint64_t *removal, *half, *join;
+    int       nremoval, nhalf, njoin, cap_removal, cap_half, cap_join;
+    int       unpurged, unjoined;
+    uint64_t  removals, false_removals;   /* atomic */
+    double    stale_sum;
+    uint64_t  stale_samples;
+} churn_t;
+
+struct slot {
+    churn_t     *c;
+    int          index;
+    int          churns;         /* 0 = stable */
+    int          state;          /* slot_state_t, atomic */
+    uint64_t     since_us;       /* entered current state, atomic */
+    node_t       node;
+    session_t   *sessions;
+    int          nsessions, cap_sessions;
+    uint64_t     next_event_us;  /* next crash or restart, 0 = none */
+    /* Pending measurements for the current down/up period */
+    int          removal_pending, half_pending, join_pending;
+    int          known_at_crash;
+    uint64_t     event_us;
+};
+
+static int  base_port = 21000, fanout = 3, ttl = 5, peer_limit = 20;
+static int  ping_interval = 1, peer_timeout = 3, pull_interval;
+static const char *fault_spec;
+
+static int slot_of(const churn_t *c, const struct sockaddr_in *a) {
+    int i = ntohs(a->sin_port) - base_port;
+    return (i >= 0 && i < c->n) ? i : -1;
+}
+
+static void slot_addr(struct sockaddr_in *a, int i) {
+    memset(a, 0, sizeof(*a));
+    a->sin_family      = AF_INET;
+    a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a->sin_port        = htons((uint16_t)(base_port + i));
+}
+
+static void push_sample(uint64_t **v, int *n, int *cap, uint64_t x) {
+    if (*n == *cap) {
+        int nc = *cap ? *cap * 2 : 64;
+        uint64_t *nv = realloc(*v, (size_t)nc * sizeof(uint64_t));
+        if (!nv) return;
+        *v = nv;
+        *cap = nc;
+    }
+    (*v)[(*n)++] = x;
+}
+
+static void session_begin(slot_t *s, uint64_t now) {
+    if (s->nsessions == s->cap_sessions) {
+        int nc = s->cap_sessions ? s->cap_sessions * 2 : 8;
+        session_t *ns = realloc(s->sessions, (size_t)nc * sizeof(*ns));
+        if (!ns) return;
+        s->sessions = ns;
+        s->cap_sessions = nc;
+    }
+    s->sessions[s->nsessions++] = (session_t){ now, 0 };
+}
+
+/* =========================================================
+ * Node callbacks
+ * ========================================================= */
+
+/* Payload data is the message number */
+static void on_deliver(node_t *node, const gossip_msg_t *msg,
+                       const char *payload, void *ctx) {
+    (void)node; (void)msg;
+    slot_t *s = ctx;
+    const char *d = strstr(payload, "\"data\": \"");
+    int k;
+    if (!d || sscanf(d + 9, "%d", &k) != 1 || k < 0 || k >= s->c->msgs)
+        return;
+    s->c->delivered[(size_t)k * s->c->n + s->index] = 1;
+}
+
+/* Runs on the node's ping thread; only atomics here, so it never waits
+ * for churn_t.lock while sample() holds it. */
+static void on_event(node_t *node, node_event_t event, const char *detail,
+                     void *ctx) {
+    (void)node;
+    slot_t *s = ctx;
+    churn_t *c = s->c;
+    if (event != NODE_EVENT_PEER_REMOVED) return;
+
+    char ip[64];
+    int port;
+    if (sscanf(detail, "%63[^:]:%d", ip, &port) != 2) return;
+    __atomic_add_fetch(&c->removals, 1, __ATOMIC_RELAXED);
+    int j = port - base_port;
+    if (j < 0 || j >= c->n) return;
+    slot_t *peer = &c->slots[j];
+    int state = __atomic_load_n(&peer->state, __ATOMIC_ACQUIRE);
+    uint64_t since = __atomic_load_n(&peer->since_us, __ATOMIC_RELAXED);
+    if (state == SLOT_UP &&
+        current_time_us() - since > (uint64_t)peer_timeout * 1000000ull)
+        __atomic_add_fetch(&c->false_removals, 1, __ATOMIC_RELAXED);
+}
+
+/* =========================================================
+ * Start / crash
+ * ========================================================= */
+
+static void set_state(slot_t *s, slot_state_t st, uint64_t now) {
+    __atomic_store_n(&s->since_us, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->state, (int)st, __ATOMIC_RELEASE);
+}
+
+static int slot_start(slot_t *s, unsigned seed) {
+    node_config_t cfg;
+    node_config_defaults(&cfg);
+    cfg.port           = base_port + s->index;
+    cfg.fanout         = fanout;
+    cfg.ttl            = ttl;
+    cfg.peer_limit     = peer_limit;
+    cfg.ping_interval  = ping_interval;
+    cfg.peer_timeout   = peer_timeout;
+    cfg.seed           = seed;
+    cfg.pull_interval  = pull_interval;
+    cfg.log_path       = "";
+    cfg.rx_queue_depth = CHURN_QUEUE_DEPTH;
+    cfg.tx_queue_depth = CHURN_QUEUE_DEPTH;
+    cfg.store_capacity = CHURN_STORE;
+    cfg.fault_spec     = fault_spec;
+
+    memset(&s->node, 0, sizeof(s->node));
+    if (node_init_config(&s->node, &cfg) != 0) {
+        fprintf(stderr, "node %d (port %d) failed to start\n",
+                s->index, cfg.port);
+        return -1;
+    }
+    node_set_event_handler(&s->node, on_event, s);
+    node_subscribe(&s->node, CHURN_TOPIC, on_deliver, s);
+    return 0;
+}
+
+/* node_cleanup() waits out the ping thread's sleep, so crashed nodes
+ * are reaped off the schedule thread. */
+static void *reaper(void *arg) {
+    slot_t *s = arg;
+    node_cleanup(&s->node);
+    pthread_mutex_lock(&s->c->lock);
+    set_state(s, SLOT_DOWN, current_time_us());
+    pthread_mutex_unlock(&s->c->lock);
+    return NULL;
+}
+
+static void slot_crash(slot_t *s, uint64_t now) {
+    churn_t *c = s->c;
+    pthread_mutex_lock(&c->lock);
+    node_stop(&s->node);
+    set_state(s, SLOT_STOPPING, now);
+    if (s->nsessions > 0) s->sessions[s->nsessions - 1].down_us = now;
+    if (s->join_pending) { c->unjoined++; s->join_pending = 0; }
+    s->removal_pending = 1;
+    s->half_pending    = 1;
+    s->known_at_crash  = c->known_by[s->index];
+    s->event_us = now;
+    pthread_mutex_unlock(&c->lock);
+
+    pthread_t t;
+    if (pthread_create(&t, NULL, reaper, s) == 0)
+        pthread_detach(t);
+    else
+        reaper(s);
+}
+
+/* 0 on success, 1 if the slot is still being reaped, -1 on failure */
+static int slot_restart(slot_t *s, uint64_t now, unsigned seed,
+                        unsigned *rs) {
+    churn_t *c = s->c;
+    pthread_mutex_lock(&c->lock);
+    if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SLOT_DOWN) {
+        pthread_mutex_unlock(&c->lock);
+        return 1;
+    }
+    set_state(s, SLOT_STARTING, now);
+    /* Bootstrap off a random live node */
+    int boot = -1;
+    for (int tries = 0; tries < 4 * c->n && boot < 0; tries++) {
+        int j = (int)(rand_r(rs) % (unsigned)c->n);
+        if (j != s->index && c->slots[j].state == SLOT_UP) boot = j;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (slot_start(s, seed) != 0) return -1;
+    node_run(&s->node);
+    if (boot >= 0) node_bootstrap(&s->node, "127.0.0.1", base_port + boot);
+
+    pthread_mutex_lock(&c->lock);
+    now = current_time_us();
+    if (s->removal_pending) { c->unpurged++; s->removal_pending = 0; }
+    s->half_pending = 0;
+    s->join_pending = 1;
+    s->event_us = now;
+    session_begin(s, now);
+    set_state(s, SLOT_UP, now);
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+/* =========================================================
+ * Membership sampler
+ * ========================================================= */
+
+typedef struct {
+    churn_t *c;
+    int      verbose;
+    int      stop;               /* atomic */
+    uint64_t start_us;
+} sampler_t;
+
+static void sample(churn_t *c, uint64_t now, uint64_t start_us, int print) {
+    int n = c->n, up = 0;
+    long entries = 0, stale = 0;
+    int *known_by = c->known_by;
+
+    pthread_mutex_lock(&c->lock);
+    memset(known_by, 0, (size_t)n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        slot_t *s = &c->slots[i];
+        if (s->state != SLOT_UP) continue;
+        up++;
+        membership_t *m = &s->node.membership;
+        pthread_mutex_lock(&m->lock);
+        for (int e = 0; e < m->count; e++) {
+            int j = slot_of(c, &m->list[e].addr);
+            if (j < 0) continue;
+            known_by[j]++;
+            entries++;
+            stale += (c->slots[j].state != SLOT_UP);
+        }
+        pthread_mutex_unlock(&m->lock);
+    }
+
+    int target = (peer_limit < up - 1) ? peer_limit : up - 1;
+    int need   = (fanout < up - 1) ? fanout : up - 1;
+    for (int i = 0; i < n; i++) {
+        slot_t *s = &c->slots[i];
+        if (s->removal_pending && s->state != SLOT_UP && known_by[i] == 0) {
+            push_sample(&c->removal, &c->nremoval, &c->cap_removal,
+                        now - s->event_us);
+            s->removal_pending = 0;
+        }
+        if (s->half_pending && s->state != SLOT_UP &&
+            known_by[i] * 2 <= s->known_at_crash) {
+            push_sample(&c->half, &c->nhalf, &c->cap_half,
+                        now - s->event_us);
+            s->half_pending = 0;
+        }
+        if (s->join_pending && s->state == SLOT_UP &&
+            known_by[i] >= need) {
+            membership_t *m = &s->node.membership;
+            pthread_mutex_lock(&m->lock);
+            int view = m->count;
+            pthread_mutex_unlock(&m->lock);
+            if (view >= target) {
+                push_sample(&c->join, &c->njoin, &c->cap_join,
+                            now - s->event_us);
+                s->join_pending = 0;
+            }
+        }
+    }
+    if (entries > 0) {
+        c->stale_sum += (double)stale / (double)entries;
+        c->stale_samples++;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    if (print)
+        printf("t=%6.1fs up=%4d view=%5.1f stale=%5.1f%% removals=%llu "
+               "false=%llu\n",
+               (double)(now - start_us) / 1e6, up,
+               up ? (double)entries / up : 0.0,
+               entries ? 100.0 * (double)stale / (double)entries : 0.0,
+               (unsigned long long)__atomic_load_n(&c->removals,
+                                                   __ATOMIC_RELAXED),
+               (unsigned long long)__atomic_load_n(&c->false_removals,
+                                                   __ATOMIC_RELAXED));
+}
+
+static void *sampler_thread(void *arg) {
+    sampler_t *sm = arg;
+    uint64_t next_print = sm->start_us + 1000000;
+    while (!__atomic_load_n(&sm->stop, __ATOMIC_RELAXED)) {
+        sleep_us(SAMPLE_US);
+        uint64_t now = current_time_us();
+        int print = sm->verbose && now >= next_print;
+        if (print) next_print += 1000000;
+        sample(sm->c, now, sm->start_us, print);
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Report
+ * ========================================================= */
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* q-quantile of v in ms (sorts v); -1 if empty */
+static double quantile_ms(uint64_t *v, int n, double q) {
+    if (n == 0) return -1;
+    qsort(v, (size_t)n, sizeof(v[0]), cmp_u64);
+    int i = (int)(q * (n - 1) + 0.5);
+    return (double)v[i] / 1000.0;
+}
+
+/* Was one session of s up throughout [from, to]? */
+static int up_throughout(const slot_t *s, uint64_t from, uint64_t to) {
+    for (int i = 0; i < s->nsessions; i++) {
+        const session_t *x = &s->sessions[i];
+        if (x->up_us <= from && (x->down_us == 0 || x->down_us >= to))
+            return 1;
+    }
+    return 0;
+}
+
+/* =========================================================
+ * Main
+ * ========================================================= */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-n nodes] [-c churn_frac] [-u dist] [-d dist] "
+            "[-T secs] [-W ms]\n"
+            "          [-r rate] [-f fanout] [-t ttl] [-l peer_limit] "
+            "[-i ping] [-X timeout]\n"
+            "          [-q pull] [-s seed] [-F fault_spec] [-p port] "
+            "[-o path] [-v]\n"
+            "dist: fixed:V | uniform:LO-HI | exp:MEAN | pareto:MEAN[:ALPHA]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int n = 50, secs = 30, settle_ms = 2000, rate = 5, verbose = 0;
+    unsigned seed = 42;
+    double churn_frac = 0.5;
+    dist_t up_dist, down_dist;
+    parse_dist("exp:10", &up_dist);
+    parse_dist("exp:3", &down_dist);
+    const char *out_path = "results/churn.jsonl";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:u:d:T:W:r:f:t:l:i:X:q:s:F:p:o:vh"))
+           != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg); break;
+        case 'c': churn_frac = atof(optarg); break;
+        case 'u':
+            if (parse_dist(optarg, &up_dist) != 0) { usage(argv[0]); return 1; }
+            break;
+        case 'd':
+            if (parse_dist(optarg, &down_dist) != 0) { usage(argv[0]); return 1; }
+            break;
+        case 'T': secs          = atoi(optarg); break;
+        case 'W': settle_ms     = atoi(optarg); break;
+        case 'r': rate          = atoi(optarg); break;
+        case 'f': fanout        = atoi(optarg); break;
+        case 't': ttl           = atoi(optarg); break;
+        case 'l': peer_limit    = atoi(optarg); break;
+        case 'i': ping_interval = atoi(optarg); break;
+        case 'X': peer_timeout  = atoi(optarg); break;
+        case 'q': pull_interval = atoi(optarg); break;
+        case 's': seed          = (unsigned)atoi(optarg); break;
+        case 'F': fault_spec    = optarg; break;
+        case 'p': base_port     = atoi(optarg); break;
+        case 'o': out_path      = optarg; break;
+        case 'v': verbose       = 1; break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (n < 2 || secs < 1 || rate < 1 || ping_interval < 1 ||
+        churn_frac < 0 || churn_frac > 1 || peer_limit > MAX_PEERS) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (fault_spec) {
+        fault_t *f = fault_open(fault_spec, 0, 0);   /* validate once */
+        if (!f) return 1;
+        fault_close(f);
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    pthread_setattr_default_np(&attr);
+    pthread_attr_destroy(&attr);
+    mallopt(M_MMAP_THRESHOLD, 64 * 1024);
+
+    churn_t c;
+    memset(&c, 0, sizeof(c));
+    c.n    = n;
+    c.msgs = rate * secs;
+    if ((uint64_t)c.msgs * (uint64_t)n > MAX_CELLS) {
+        fprintf(stderr, "rate * secs * n too large\n");
+        return 1;
+    }
+    pthread_mutex_init(&c.lock, NULL);
+    c.slots        = calloc((size_t)n, sizeof(slot_t));
+    c.published_us = calloc((size_t)c.msgs, sizeof(uint64_t));
+    c.delivered    = calloc((size_t)c.msgs * (size_t)n, 1);
+    c.known_by     = calloc((size_t)n, sizeof(int));
+    if (!c.slots || !c.published_us || !c.delivered || !c.known_by) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* ---- Start everyone with a random overlay ---- */
+    unsigned rs = seed;
+    int nchurn = (int)(churn_frac * n + 0.5);
+    for (int i = 0; i < n; i++) {
+        slot_t *s = &c.slots[i];
+        s->c      = &c;
+        s->index  = i;
+        s->churns = i < nchurn;   /* slots are interchangeable */
+        if (slot_start(s, seed + (unsigned)i) != 0) return 1;
+    }
+    int k = (peer_limit < n - 1) ? peer_limit : n - 1;
+    for (int i = 0; i < n; i++) {
+        int added = 0;
+        while (added < k) {
+            int j = (int)(rand_r(&rs) % (unsigned)n);
+            if (j == i) continue;
+            struct sockaddr_in a;
+            slot_addr(&a, j);
+            added += membership_add(&c.slots[i].node.membership, a);
+        }
+    }
+    uint64_t start = current_time_us();
+    for (int i = 0; i < n; i++) {
+        slot_t *s = &c.slots[i];
+        node_run(&s->node);
+        session_begin(s, start);
+        set_state(s, SLOT_UP, start);
+        if (s->churns)
+            s->next_event_us = start +
+                (uint64_t)(dist_draw(&up_dist, &rs) * 1e6);
+    }
+
+    sampler_t sm = { &c, verbose, 0, start };
+    pthread_t sampler;
+    pthread_create(&sampler, NULL, sampler_thread, &sm);
+
+    /* ---- Churn and publish ---- */
+    uint64_t end = start + (uint64_t)secs * 1000000ull;
+    int crashes = 0, restarts = 0, next_msg = 0;
+    unsigned incarnation = (unsigned)n;
+    for (;;) {
+        uint64_t now = current_time_us();
+        if (now >= end) break;
+
+        while (next_msg < c.msgs &&
+               start + (uint64_t)next_msg * 1000000ull / (uint64_t)rate <= now) {
+            int o = -1;
+            for (int tries = 0; tries < 4 * n && o < 0; tries++) {
+                int j = (int)(rand_r(&rs) % (unsigned)n);
+                if (__atomic_load_n(&c.slots[j].state, __ATOMIC_ACQUIRE)
+                    == SLOT_UP)
+                    o = j;
+            }
+            if (o >= 0) {
+                char data[16];
+                snprintf(data, sizeof(data), "%d", next_msg);
+                c.published_us[next_msg] = current_time_us();
+                c.delivered[(size_t)next_msg * n + o] = 1;   /* origin */
+                node_publish(&c.slots[o].node, CHURN_TOPIC, data, NULL);
+            }
+            next_msg++;
+        }
+
+        for (int i = 0; i < n; i++) {
+            slot_t *s = &c.slots[i];
+            if (!s->next_event_us || s->next_event_us > now) continue;
+            int state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+            if (state == SLOT_UP) {
+                slot_crash(s, now);
+                crashes++;
+                s->next_event_us = now +
+                    (uint64_t)(dist_draw(&down_dist, &rs) * 1e6);
+            } else {
+                int rc = slot_restart(s, now, seed + incarnation, &rs);
+                if (rc == 1) continue;   /* still reaping: retry */
+                if (rc < 0) { s->next_event_us = 0; continue; }
+                incarnation++;
+                restarts++;
+                s->next_event_us = current_time_us() +
+                    (uint64_t)(dist_draw(&up_dist, &rs) * 1e6);
+            }
+        }
+        sleep_us(2000);
+    }
+
+    /* ---- Settle, then take the final picture ---- */
+    sleep_us((uint64_t)settle_ms * 1000);
+    uint64_t stop = current_time_us();
+    __atomic_store_n(&sm.stop, 1, __ATOMIC_RELAXED);
+    pthread_join(sampler, NULL);
+
+    for (int i = 0; i < n; i++)
+        if (c.slots[i].state == SLOT_UP) node_stop(&c.slots[i].node);
+    for (int i = 0; i < n; i++) {
+        slot_t *s = &c.slots[i];
+        if (s->state == SLOT_UP) node_cleanup(&s->node);
+        while (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) == SLOT_STOPPING)
+            sleep_us(10000);
+    }
+
+    /* Delivery to nodes that stayed up through each message's window */
+    uint64_t win = (uint64_t)settle_ms * 1000;
+    uint64_t got[2] = { 0, 0 }, want[2] = { 0, 0 };
+    for (int m = 0; m < next_msg; m++) {
+        uint64_t t = c.published_us[m];
+        if (!t || t + win > stop) continue;
+        for (int i = 0; i < n; i++) {
+            slot_t *s = &c.slots[i];
+            if (!up_throughout(s, t, t + win)) continue;
+            want[s->churns]++;
+            got[s->churns] += c.delivered[(size_t)m * n + i];
+        }
+    }
+    double d_all    = (want[0] + want[1])
+                      ? (double)(got[0] + got[1]) / (double)(want[0] + want[1])
+                      : -1;
+    double d_stable = want[0] ? (double)got[0] / (double)want[0] : -1;
+    double d_churn  = want[1] ? (double)got[1] / (double)want[1] : -1;
+
+    uint64_t removals = c.removals, false_rm = c.false_removals;
+    double false_rate = removals ? (double)false_rm / (double)removals : 0;
+    double stale = c.stale_samples ? c.stale_sum / (double)c.stale_samples : 0;
+    int pending_rm = 0, pending_join = 0;
+    for (int i = 0; i < n; i++) {
+        pending_rm   += c.slots[i].removal_pending;
+        pending_join += c.slots[i].join_pending;
+    }
+    double rm50  = quantile_ms(c.removal, c.nremoval, 0.5);
+    double rm90  = quantile_ms(c.removal, c.nremoval, 0.9);
+    double rmmax = quantile_ms(c.removal, c.nremoval, 1.0);
+    double hf50  = quantile_ms(c.half, c.nhalf, 0.5);
+    double hf90  = quantile_ms(c.half, c.nhalf, 0.9);
+    double jn50  = quantile_ms(c.join, c.njoin, 0.5);
+    double jn90  = quantile_ms(c.join, c.njoin, 0.9);
+    double jnmax = quantile_ms(c.join, c.njoin, 1.0);
+
+    printf("nodes %d (%d churning)  up %s  down %s  ping %ds  timeout %ds\n",
+           n, nchurn, up_dist.text, down_dist.text, ping_interval,
+           peer_timeout);
+    printf("crashes %d  restarts %d  messages %d\n",
+           crashes, restarts, next_msg);
+    printf("delivery     %.4f  (stable %.4f, churning %.4f)\n",
+           d_all, d_stable, d_churn);
+    printf("removal_ms   p50 %.0f  p90 %.0f  max %.0f  (%d measured, "
+           "%d unpurged, %d pending)\n",
+           rm50, rm90, rmmax, c.nremoval, c.unpurged, pending_rm);
+    printf("half_ms      p50 %.0f  p90 %.0f  (%d measured)\n",
+           hf50, hf90, c.nhalf);
+    printf("join_ms      p50 %.0f  p90 %.0f  max %.0f  (%d measured, "
+           "%d unjoined, %d pending)\n",
+           jn50, jn90, jnmax, c.njoin, c.unjoined, pending_join);
+    printf("false_rm     %llu / %llu removals (%.1f%%)\n",
+           (unsigned long long)false_rm, (unsigned long long)removals,
+           100.0 * false_rate);
+    printf("stale        %.1f%% of view entries\n", 100.0 * stale);
+
+    if (strcmp(out_path, "-") != 0) {
+        if (strncmp(out_path, "results/", 8) == 0) mkdir("results", 0755);
+        FILE *out = fopen(out_path, "a");
+        if (!out) {
+            perror(out_path);
+        } else {
+            fprintf(out,
+                    "{\"n\":%d,\"churning\":%d,\"up\":\"%s\",\"down\":\"%s\","
+                    "\"secs\":%d,\"settle_ms\":%d,\"rate\":%d,\"fanout\":%d,"
+                    "\"ttl\":%d,\"peer_limit\":%d,\"ping_interval\":%d,"
+                    "\"peer_timeout\":%d,\"pull_interval\":%d,\"seed\":%u,"
+                    "\"fault\":\"%s\",\"crashes\":%d,\"restarts\":%d,"
+                    "\"msgs\":%d,\"delivery\":%.6f,\"delivery_stable\":%.6f,"
+                    "\"delivery_churning\":%.6f,\"removal_p50_ms\":%.1f,"
+                    "\"removal_p90_ms\":%.1f,\"removal_max_ms\":%.1f,"
+                    "\"removals_measured\":%d,\"unpurged\":%d,"
+                    "\"half_p50_ms\":%.1f,\"half_p90_ms\":%.1f,"
+                    "\"join_p50_ms\":%.1f,\"join_p90_ms\":%.1f,"
+                    "\"join_max_ms\":%.1f,\"joins_measured\":%d,"
+                    "\"unjoined\":%d,\"removals\":%llu,"
+                    "\"false_removals\":%llu,\"false_removal_rate\":%.6f,"
+                    "\"stale\":%.6f}\n",
+                    n, nchurn, up_dist.text, down_dist.text, secs, settle_ms,
+                    rate, fanout, ttl, peer_limit, ping_interval,
+                    peer_timeout, pull_interval, seed,
+                    fault_spec ? fault_spec : "", crashes, restarts, next_msg,
+                    d_all, d_stable, d_churn, rm50, rm90, rmmax, c.nremoval,
+                    c.unpurged, hf50, hf90, jn50, jn90, jnmax, c.njoin, c.unjoined,
+                    (unsigned long long)removals,
+                    (unsigned long long)false_rm, false_rate, stale);
+            fclose(out);
+        }
+    }
+
+    for (int i = 0; i < n; i++) free(c.slots[i].sessions);
+    free(c.slots);
+    free(c.published_us);
+    free(c.delivered);
+    free(c.known_by);
+    free(c.removal);
+    free(c.half);
+    free(c.join);
+    pthread_mutex_destroy(&c.lock);
+    return 0;
+}
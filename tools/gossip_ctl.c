@@ -0,0 +1,196 @@
+/* gossip_ctl – client for a node's local control socket (see control.h)
+ *
+ *   gossip_ctl <socket> pub <topic> <text>    publish one message
+ *   gossip_ctl <socket> batch <topic>         publish each stdin line,
+ *                                             CTL_MAX_BATCH per frame
+ *   gossip_ctl <socket> sub <topic>...        stream deliveries to stdout
+ *   gossip_ctl <socket> metrics               print the metrics dump
+ *   gossip_ctl <socket> set <key> <value>     write replicated state
+ *   gossip_ctl <socket> get <key>             print a key's value
+ *   gossip_ctl <socket> del <key>             delete a key
+ */
+#include "control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static unsigned char frame[CTL_MAX_FRAME];
+
+static int ctl_connect(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        exit(1);
+    }
+    return fd;
+}
+
+/* Wait for the OK/ERROR reply to a request, skipping deliveries.
+ * Returns the OK count, or -1 on error. */
+static int wait_reply(int fd, int print_ids) {
+    for (;;) {
+        ssize_t len = recv(fd, frame, sizeof(frame), 0);
+        if (len <= 0) { fprintf(stderr, "connection closed\n"); return -1; }
+
+        const char *s;
+        int slen;
+        if (frame[0] == CTL_OP_ERROR) {
+            if (ctl_get_str(frame, 1, (int)len, &s, &slen) > 0)
+                fprintf(stderr, "error: %.*s\n", slen, s);
+            return -1;
+        }
+        if (frame[0] != CTL_OP_OK) continue;
+
+        uint16_t n;
+        int off = ctl_get_u16(frame, 1, (int)len, &n);
+        for (int i = 0; print_ids && i < n && off > 0; i++) {
+            off = ctl_get_str(frame, off, (int)len, &s, &slen);
+            if (off > 0) printf("%.*s\n", slen, s);
+        }
+        return n;
+    }
+}
+
+static int cmd_pub(int fd, const char *topic, const char *text) {
+    frame[0] = CTL_OP_PUBLISH;
+    int off = ctl_put_str(frame, 1, sizeof(frame), topic, (int)strlen(topic));
+    off = ctl_put_str(frame, off, sizeof(frame), text, (int)strlen(text));
+    if (off < 0) { fprintf(stderr, "message too long\n"); return 1; }
+    send(fd, frame, (size_t)off, 0);
+    return wait_reply(fd, 1) == 1 ? 0 : 1;
+}
+
+static int flush_batch(int fd, int off, int n, long *total) {
+    if (n == 0) return 0;
+    ctl_put_u16(frame, 1, sizeof(frame), (uint16_t)n);
+    send(fd, frame, (size_t)off, 0);
+    int done = wait_reply(fd, 0);
+    if (done < 0) return -1;
+    *total += done;
+    return done == n ? 0 : -1;
+}
+
+static int cmd_batch(int fd, const char *topic) {
+    char line[MSG_BUF_SIZE];
+    long total = 0;
+    int n = 0, off = 3;
+    frame[0] = CTL_OP_BATCH;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\n")] = '\0';
+        int tlen = (int)strlen(topic), dlen = (int)strlen(line);
+        /* Start a new frame when this item would not fit */
+        if (n == CTL_MAX_BATCH || off + 4 + tlen + dlen > CTL_MAX_FRAME) {
+            if (flush_batch(fd, off, n, &total) != 0) break;
+            frame[0] = CTL_OP_BATCH;   /* the reply reused the buffer */
+            n = 0;
+            off = 3;
+        }
+        off = ctl_put_str(frame, off, sizeof(frame), topic, tlen);
+        off = ctl_put_str(frame, off, sizeof(frame), line, dlen);
+        n++;
+    }
+    int rc = flush_batch(fd, off, n, &total);
+    fprintf(stderr, "published %ld\n", total);
+    return rc == 0 ? 0 : 1;
+}
+
+static int cmd_sub(int fd, char **topics, int count) {
+    for (int i = 0; i < count; i++) {
+        frame[0] = CTL_OP_SUBSCRIBE;
+        int off = ctl_put_str(frame, 1, sizeof(frame),
+                              topics[i], (int)strlen(topics[i]));
+        send(fd, frame, (size_t)off, 0);
+        if (wait_reply(fd, 0) < 0) return 1;
+    }
+    for (;;) {
+        ssize_t len = recv(fd, frame, sizeof(frame), 0);
+        if (len <= 0) return 0;
+        if (frame[0] != CTL_OP_DELIVER) continue;
+
+        const char *f[4];
+        int flen[4];
+        int off = 1;
+        for (int i = 0; i < 4 && off > 0; i++)
+            off = ctl_get_str(frame, off, (int)len, &f[i], &flen[i]);
+        if (off < 0) continue;
+        printf("[%.*s] %.*s (%.*s from %.*s)\n", flen[1], f[1],
+               flen[3], f[3], flen[0], f[0], flen[2], f[2]);
+        fflush(stdout);
+    }
+}
+
+static int cmd_metrics(int fd) {
+    frame[0] = CTL_OP_METRICS;
+    send(fd, frame, 1, 0);
+    for (;;) {
+        ssize_t len = recv(fd, frame, sizeof(frame), 0);
+        if (len <= 0) return 1;
+        if (frame[0] == CTL_OP_ERROR) return 1;
+        if (frame[0] != CTL_OP_OK) continue;
+
+        const char *s;
+        int slen;
+        if (ctl_get_str(frame, 3, (int)len, &s, &slen) < 0) return 1;
+        printf("%.*s", slen, s);
+        return 0;
+    }
+}
+
+/* SET / DELETE / GET; a GET reply's one string is the value */
+static int cmd_state(int fd, int op, const char *key, const char *value) {
+    frame[0] = (unsigned char)op;
+    int off = ctl_put_str(frame, 1, sizeof(frame), key, (int)strlen(key));
+    if (value)
+        off = ctl_put_str(frame, off, sizeof(frame), value, (int)strlen(value));
+    if (off < 0) { fprintf(stderr, "value too long\n"); return 1; }
+    send(fd, frame, (size_t)off, 0);
+    return wait_reply(fd, op == CTL_OP_GET) < 0 ? 1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: gossip_ctl <socket> pub <topic> <text>\n"
+        "       gossip_ctl <socket> batch <topic>   (one message per stdin line)\n"
+        "       gossip_ctl <socket> sub <topic>...\n"
+        "       gossip_ctl <socket> metrics\n"
+        "       gossip_ctl <socket> set <key> <value>\n"
+        "       gossip_ctl <socket> get <key>\n"
+        "       gossip_ctl <socket> del <key>\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) usage();
+    int fd = ctl_connect(argv[1]);
+    int rc;
+
+    if (strcmp(argv[2], "pub") == 0 && argc == 5)
+        rc = cmd_pub(fd, argv[3], argv[4]);
+    else if (strcmp(argv[2], "batch") == 0 && argc == 4)
+        rc = cmd_batch(fd, argv[3]);
+    else if (strcmp(argv[2], "metrics") == 0 && argc == 3)
+        rc = cmd_metrics(fd);
+    else if (strcmp(argv[2], "set") == 0 && argc == 5)
+        rc = cmd_state(fd, CTL_OP_SET, argv[3], argv[4]);
+    else if (strcmp(argv[2], "get") == 0 && argc == 4)
+        rc = cmd_state(fd, CTL_OP_GET, argv[3], NULL);
+    else if (strcmp(argv[2], "del") == 0 && argc == 4)
+        rc = cmd_state(fd, CTL_OP_DELETE, argv[3], NULL);
+    else if (strcmp(argv[2], "sub") == 0 && argc > 3)
+        rc = cmd_sub(fd, argv + 3, argc - 3);
+    else
+        usage();
+
+    close(fd);
+    return rc;
+}
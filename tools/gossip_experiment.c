@@ -0,0 +1,546 @@
+/* gossip_experiment – in-process cluster experiments
+ *
+ *   gossip_experiment [options]
+ *
+ *   -n <list>   cluster sizes (default 10,20,50)
+ *   -f <list>   fanouts (default 3)
+ *   -t <list>   TTLs (default 5)
+ *   -s <list>   seeds (default 42,9999)
+ *   -M <list>   modes: push, hybrid (version-vector digests), ihave
+ *               (hybrid pulling with IHAVE id lists); default push,hybrid
+ *   -L <list>   loss probabilities injected on every datagram (default 0)
+ *   -m <n>      messages injected per run (default 10)
+ *   -r <n>      injections per second (default 10)
+ *   -D <secs>   sustained load: inject at -r for this long instead of
+ *               -m messages (messages = rate * secs)
+ *   -K <n>      publishers: messages come round-robin from n fixed random
+ *               nodes (default 0: a random node per message)
+ *   -l <n>      peer limit (default 20)
+ *   -w <ms>     a run ends once no delivery happened for this long
+ *               (default 3000; hybrid runs need > the 1 s pull interval)
+ *   -T <secs>   hard limit on the wait after the last injection
+ *               (default 60)
+ *   -O <mode>   delivery order on every node: arrival, fifo, causal
+ *               (default arrival); per-origin inversions seen by the
+ *               subscribers are reported either way
+ *   -F <spec>   fault spec for every node (see fault.h); node i listens
+ *               on port+i and partition times count from node start,
+ *               e.g. -F 'delay=5,jitter=5;partition=20000-20009,at=1,heal=4'
+ *   -p <port>   first UDP port (default 20000)
+ *   -o <path>   append one JSON object per run (default
+ *               results/experiment.jsonl, "-" = none)
+ *
+ * Every list is comma-separated and the sweep runs their cross product.
+ * All nodes of a run live in this process and talk over loopback UDP.
+ * Each node starts with peer_limit random peers already in its
+ * membership (so no bootstrap phase), subscribes to the experiment topic
+ * and counts first deliveries.  A run finishes as soon as every message
+ * reached every node, or when deliveries stall.
+ *
+ * Reported per run: delivery ratio (coverage), messages that reached
+ * everyone, median time for a message to reach 50% / 90% / 100% of the
+ * nodes, the slowest full convergence, per-delivery latency percentiles,
+ * GOSSIP datagrams sent per message (N-1 is the floor for push) and
+ * bandwidth per node. */
+#define _GNU_SOURCE
+#include "node.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#define MAX_LIST      16
+#define MAX_EXP_MSGS  1000000
+#define EXP_TOPIC     "experiment"
+#define THREAD_STACK  (256 * 1024)   /* thousands of node threads */
+#define ORDER_SLOTS   64             /* origins tracked per node for inversions */
+
+/* Per-node resources, trimmed so N=1000+ fits in a few GB */
+#define EXP_QUEUE_DEPTH 32
+#define EXP_STORE       64
+
+typedef struct {
+    int n, fanout, ttl, peer_limit, pull_interval, pull_ids;
+    unsigned seed;
+    double loss;
+    const char *mode;
+} run_params_t;
+
+typedef struct {
+    int       run;                 /* tags payloads of this run */
+    int       n;
+    int       msgs;
+    uint64_t *published_us;        /* per message */
+    int      *reached;             /* nodes holding it (atomic) */
+    uint64_t *t50_us;              /* time to reach 50/90/100% */
+    uint64_t *t90_us;
+    uint64_t *t100_us;
+    uint64_t  last_delivery_us;
+    metrics_t lat;                 /* H_E2E_US: publish -> each delivery */
+    node_t   *nodes;
+    uint32_t *order_key;           /* per node: ORDER_SLOTS origin hashes */
+    uint64_t *order_last;          /*   and the last seq delivered from each */
+    uint64_t  inversions;          /* deliveries below that seq (atomic) */
+} run_state_t;
+
+static int  msgs_per_run = 10, inject_rate = 10, stall_ms = 3000;
+static int  run_limit_s = 60, base_port = 20000;
+static int  publish_secs, num_publishers;
+static const char *fault_spec = "";
+static int  delivery_order = ORDER_ARRIVAL;
+static const char *order_names[] = { "arrival", "fifo", "causal" };
+
+static run_state_t *run_state_new(int run, int n, int msgs) {
+    run_state_t *st = calloc(1, sizeof(*st));
+    if (!st) return NULL;
+    st->run  = run;
+    st->n    = n;
+    st->msgs = msgs;
+    st->published_us = calloc((size_t)msgs, sizeof(uint64_t));
+    st->reached      = calloc((size_t)msgs, sizeof(int));
+    st->t50_us       = calloc((size_t)msgs, sizeof(uint64_t));
+    st->t90_us       = calloc((size_t)msgs, sizeof(uint64_t));
+    st->t100_us      = calloc((size_t)msgs, sizeof(uint64_t));
+    st->order_key    = calloc((size_t)n * ORDER_SLOTS, sizeof(uint32_t));
+    st->order_last   = calloc((size_t)n * ORDER_SLOTS, sizeof(uint64_t));
+    if (metrics_init(&st->lat) != 0 || !st->published_us || !st->reached ||
+        !st->t50_us || !st->t90_us || !st->t100_us || !st->order_key ||
+        !st->order_last) {
+        free(st->published_us); free(st->reached);
+        free(st->t50_us); free(st->t90_us); free(st->t100_us);
+        free(st->order_key); free(st->order_last);
+        metrics_free(&st->lat);
+        free(st);
+        return NULL;
+    }
+    return st;
+}
+
+static void run_state_free(run_state_t *st) {
+    if (!st) return;
+    free(st->published_us); free(st->reached);
+    free(st->t50_us); free(st->t90_us); free(st->t100_us);
+    free(st->order_key); free(st->order_last);
+    metrics_free(&st->lat);
+    free(st);
+}
+
+/* =========================================================
+ * Delivery accounting
+ * ========================================================= */
+
+static void note_reached(run_state_t *st, int k) {
+    uint64_t now = current_time_us();
+    int c = __atomic_add_fetch(&st->reached[k], 1, __ATOMIC_RELAXED);
+    uint64_t dt = now - st->published_us[k];
+    if (c > 1) metrics_observe(&st->lat, H_E2E_US, dt);   /* not the origin */
+    if (c == (st->n + 1) / 2)       st->t50_us[k]  = dt;
+    if (c == (st->n * 9 + 9) / 10)  st->t90_us[k]  = dt;
+    if (c == st->n)                 st->t100_us[k] = dt;
+    __atomic_store_n(&st->last_delivery_us, now, __ATOMIC_RELAXED);
+}
+
+/* Count a delivery whose seq is below one already delivered from the
+ * same origin on this node.  Runs on that node's dispatcher only. */
+static void note_order(run_state_t *st, node_t *node, const char *msg_id) {
+    char origin[NODE_ID_LEN];
+    uint64_t seq;
+    if (wm_parse_id(msg_id, origin, sizeof(origin), &seq) != 0) return;
+    size_t base = (size_t)(node - st->nodes) * ORDER_SLOTS;
+    uint32_t key = seen_hash(origin) | 1;
+    for (int i = 0; i < ORDER_SLOTS; i++) {
+        size_t s = base + ((key + (uint32_t)i) % ORDER_SLOTS);
+        if (st->order_key[s] && st->order_key[s] != key) continue;
+        st->order_key[s] = key;
+        if (seq < st->order_last[s])
+            __atomic_add_fetch(&st->inversions, 1, __ATOMIC_RELAXED);
+        else
+            st->order_last[s] = seq;
+        return;
+    }
+}
+
+/* Payload data is "<run>:<k>"; anything else is a straggler */
+static void on_deliver(node_t *node, const gossip_msg_t *msg,
+                       const char *payload, void *ctx) {
+    run_state_t *st = ctx;
+    const char *d = strstr(payload, "\"data\": \"");
+    int run, k;
+    if (!d || sscanf(d + 9, "%d:%d", &run, &k) != 2) return;
+    if (run != st->run || k < 0 || k >= st->msgs) return;
+    note_reached(st, k);
+    note_order(st, node, msg->msg_id);
+}
+
+/* =========================================================
+ * One run
+ * ========================================================= */
+
+static void peer_addr(struct sockaddr_in *a, int i) {
+    memset(a, 0, sizeof(*a));
+    a->sin_family      = AF_INET;
+    a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    a->sin_port        = htons((uint16_t)(base_port + i));
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Median of the nonzero entries, in ms; -1 if there are none */
+static double median_ms(const uint64_t *v, int n) {
+    uint64_t *tmp = malloc((size_t)n * sizeof(uint64_t));
+    if (!tmp) return -1;
+    int m = 0;
+    for (int i = 0; i < n; i++) if (v[i]) tmp[m++] = v[i];
+    double med = -1;
+    if (m > 0) {
+        qsort(tmp, (size_t)m, sizeof(tmp[0]), cmp_u64);
+        med = (double)tmp[m / 2] / 1000.0;
+    }
+    free(tmp);
+    return med;
+}
+
+static int run_one(const run_params_t *p, int run_id, FILE *out) {
+    int msgs = publish_secs > 0 ? inject_rate * publish_secs : msgs_per_run;
+    node_t      *nodes = calloc((size_t)p->n, sizeof(node_t));
+    run_state_t *st    = run_state_new(run_id, p->n, msgs);
+    if (!nodes || !st) {
+        fprintf(stderr, "out of memory for N=%d\n", p->n);
+        free(nodes);
+        run_state_free(st);
+        return -1;
+    }
+    st->nodes = nodes;
+
+    char fault[512];
+    snprintf(fault, sizeof(fault), "%s", fault_spec);
+    if (p->loss > 0)
+        snprintf(fault + strlen(fault), sizeof(fault) - strlen(fault),
+                 "%sloss=%g", *fault ? ";" : "", p->loss);
+
+    uint64_t t0 = current_time_us();
+    int started = 0;
+    for (int i = 0; i < p->n; i++) {
+        node_config_t cfg;
+        node_config_defaults(&cfg);
+        cfg.port           = base_port + i;
+        cfg.fanout         = p->fanout;
+        cfg.ttl            = p->ttl;
+        cfg.peer_limit     = p->peer_limit;
+        cfg.seed           = p->seed + (unsigned)i;
+        cfg.pull_interval  = p->pull_interval;
+        cfg.pull_ids       = p->pull_ids;
+        cfg.delivery_order = delivery_order;
+        cfg.log_path       = "";
+        cfg.rx_queue_depth = EXP_QUEUE_DEPTH;
+        cfg.tx_queue_depth = EXP_QUEUE_DEPTH;
+        cfg.store_capacity = EXP_STORE;
+        cfg.fault_spec     = fault;
+        if (node_init_config(&nodes[i], &cfg) != 0) {
+            fprintf(stderr, "node %d (port %d) failed to start\n",
+                    i, cfg.port);
+            break;
+        }
+        node_subscribe(&nodes[i], EXP_TOPIC, on_deliver, st);
+        started++;
+    }
+
+    int ok = (started == p->n);
+    if (ok) {
+        /* Random overlay: peer_limit distinct peers per node, from the
+         * run's seed so sweeps are repeatable */
+        unsigned rs = p->seed * 7919u + (unsigned)p->n;
+        int k = (p->peer_limit < p->n - 1) ? p->peer_limit : p->n - 1;
+        for (int i = 0; i < p->n; i++) {
+            int added = 0;
+            while (added < k) {
+                int j = (int)(rand_r(&rs) % (unsigned)p->n);
+                if (j == i) continue;
+                struct sockaddr_in a;
+                peer_addr(&a, j);
+                added += membership_add(&nodes[i].membership, a);
+            }
+        }
+        for (int i = 0; i < p->n; i++) node_run(&nodes[i]);
+    }
+    uint64_t setup_us = current_time_us() - t0;
+
+    /* ---- Inject ---- */
+    unsigned rs = p->seed * 104729u + (unsigned)run_id;
+    int npub = (num_publishers > 0 && num_publishers < p->n)
+               ? num_publishers : 0;
+    int *publishers = calloc((size_t)(npub > 0 ? npub : 1), sizeof(int));
+    for (int i = 0; i < npub && publishers; i++)
+        publishers[i] = (int)(rand_r(&rs) % (unsigned)p->n);
+    uint64_t inject_start = current_time_us();
+    for (int k = 0; ok && k < st->msgs; k++) {
+        uint64_t due = inject_start + (uint64_t)k * 1000000ull
+                                      / (uint64_t)inject_rate;
+        uint64_t now = current_time_us();
+        if (due > now) sleep_us(due - now);
+
+        int o = (npub > 0 && publishers) ? publishers[k % npub]
+                                         : (int)(rand_r(&rs) % (unsigned)p->n);
+        node_t *origin = &nodes[o];
+        char data[32];
+        snprintf(data, sizeof(data), "%d:%d", run_id, k);
+        st->published_us[k] = current_time_us();
+        note_reached(st, k);   /* the origin holds it */
+        node_publish(origin, EXP_TOPIC, data, NULL);
+    }
+
+    /* ---- Wait for convergence or a stall ---- */
+    uint64_t deadline = current_time_us() + (uint64_t)run_limit_s * 1000000ull;
+    int complete = 0;
+    while (ok) {
+        sleep_us(10000);
+        complete = 0;
+        for (int k = 0; k < st->msgs; k++)
+            complete += (__atomic_load_n(&st->reached[k], __ATOMIC_RELAXED)
+                         >= p->n);
+        uint64_t now  = current_time_us();
+        uint64_t last = __atomic_load_n(&st->last_delivery_us,
+                                        __ATOMIC_RELAXED);
+        if (complete == st->msgs) break;
+        if (now - last > (uint64_t)stall_ms * 1000) break;
+        if (now > deadline) break;
+    }
+    uint64_t run_us = current_time_us() - inject_start;
+    free(publishers);
+
+    /* ---- Traffic ---- */
+    uint64_t gossip_sent = 0, all_sent = 0, dups = 0, bytes = 0;
+    uint64_t pull_bytes = 0;
+    for (int i = 0; i < started; i++) {
+        metrics_t *m = &nodes[i].metrics;
+        gossip_sent += metrics_counter(m, M_SENT, MSG_GOSSIP);
+        all_sent    += metrics_counter_total(m, M_SENT);
+        dups        += metrics_counter(m, M_DUPLICATE, MSG_GOSSIP);
+        bytes       += metrics_counter_total(m, M_SENT_BYTES);
+        pull_bytes  += metrics_counter(m, M_SENT_BYTES, MSG_IHAVE) +
+                       metrics_counter(m, M_SENT_BYTES, MSG_IWANT) +
+                       metrics_counter(m, M_SENT_BYTES, MSG_DIGEST);
+    }
+
+    if (!ok) {
+        /* Nothing was run: no threads to stop or join */
+        for (int i = 0; i < started; i++) node_destroy(&nodes[i]);
+        free(nodes);
+        run_state_free(st);
+        return -1;
+    }
+
+    /* Everything first, so threads wind down in parallel */
+    for (int i = 0; i < started; i++) node_stop(&nodes[i]);
+
+    uint64_t f_lost = 0, f_cut = 0;
+    for (int i = 0; i < started; i++) {
+        if (!nodes[i].fault) continue;
+        f_lost += nodes[i].fault->stats.lost;
+        f_cut  += nodes[i].fault->stats.partitioned;
+    }
+    for (int i = 0; i < started; i++) node_cleanup(&nodes[i]);
+
+    uint64_t held = 0, worst = 0;
+    for (int k = 0; k < st->msgs; k++) {
+        held += (uint64_t)(st->reached[k] < p->n ? st->reached[k] : p->n);
+        if (st->t100_us[k] > worst) worst = st->t100_us[k];
+    }
+    double coverage = (double)held / ((double)st->msgs * p->n);
+    double t50  = median_ms(st->t50_us,  st->msgs);
+    double t90  = median_ms(st->t90_us,  st->msgs);
+    double t100 = median_ms(st->t100_us, st->msgs);
+    double per_msg = (double)gossip_sent / st->msgs;
+    double secs    = (double)run_us / 1e6;
+    double node_kbps = (double)bytes / p->n / secs / 1024.0;
+    double node_pps  = (double)all_sent / p->n / secs;
+    hist_summary_t lat;
+    metrics_hist_summary(&st->lat, H_E2E_US, &lat);
+
+    printf("%-6s %5d %3d %3d %6u %5.2f %8.4f %6d/%-6d %8.1f %8.1f %8.1f %9.1f %9.1f %6llu\n",
+           p->mode, p->n, p->fanout, p->ttl, p->seed, p->loss, coverage,
+           complete,
+           st->msgs, t100, lat.p50 / 1000.0, lat.p99 / 1000.0, node_kbps,
+           per_msg, (unsigned long long)st->inversions);
+    fflush(stdout);
+
+    if (out) {
+        fprintf(out,
+                "{\"mode\":\"%s\",\"n\":%d,\"fanout\":%d,\"ttl\":%d,"
+                "\"peer_limit\":%d,\"seed\":%u,\"msgs\":%d,\"rate\":%d,"
+                "\"publishers\":%d,\"loss\":%.4f,\"fault\":\"%s\","
+                "\"fault_lost\":%llu,\"fault_partitioned\":%llu,"
+                "\"coverage\":%.6f,\"complete\":%d,"
+                "\"t50_ms\":%.3f,\"t90_ms\":%.3f,\"t100_ms\":%.3f,"
+                "\"t100_max_ms\":%.3f,\"gossip_sent\":%llu,"
+                "\"gossip_per_msg\":%.2f,\"all_sent\":%llu,"
+                "\"duplicates\":%llu,\"lat_p50_ms\":%.3f,"
+                "\"lat_p90_ms\":%.3f,\"lat_p99_ms\":%.3f,"
+                "\"lat_p999_ms\":%.3f,\"lat_max_ms\":%.3f,"
+                "\"sent_bytes\":%llu,\"pull_bytes\":%llu,\"node_kbytes_s\":%.2f,"
+                "\"node_pkts_s\":%.2f,\"order\":\"%s\",\"inversions\":%llu,"
+                "\"setup_ms\":%.1f,\"run_ms\":%.1f}\n",
+                p->mode, p->n, p->fanout, p->ttl, p->peer_limit, p->seed,
+                st->msgs, inject_rate, npub, p->loss, fault,
+                (unsigned long long)f_lost, (unsigned long long)f_cut, coverage, complete, t50, t90,
+                t100, (double)worst / 1000.0, (unsigned long long)gossip_sent,
+                per_msg, (unsigned long long)all_sent,
+                (unsigned long long)dups, lat.p50 / 1000.0, lat.p90 / 1000.0,
+                lat.p99 / 1000.0, lat.p999 / 1000.0, lat.max / 1000.0,
+                (unsigned long long)bytes, (unsigned long long)pull_bytes,
+                node_kbps, node_pps, order_names[delivery_order],
+                (unsigned long long)st->inversions,
+                (double)setup_us / 1000.0, (double)run_us / 1000.0);
+        fflush(out);
+    }
+
+    free(nodes);
+    run_state_free(st);
+    return 0;
+}
+
+/* =========================================================
+ * Main
+ * ========================================================= */
+
+static int parse_ints(const char *s, int *out) {
+    int n = 0;
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", s);
+    for (char *tok = strtok(copy, ","); tok && n < MAX_LIST;
+         tok = strtok(NULL, ","))
+        out[n++] = atoi(tok);
+    return n;
+}
+
+static int parse_doubles(const char *s, double *out) {
+    int n = 0;
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", s);
+    for (char *tok = strtok(copy, ","); tok && n < MAX_LIST;
+         tok = strtok(NULL, ","))
+        out[n++] = atof(tok);
+    return n;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-n sizes] [-f fanouts] [-t ttls] [-s seeds] "
+            "[-M push,hybrid,ihave] [-L losses]\n"
+            "          [-m msgs | -D secs] [-r rate] [-K publishers] "
+            "[-l peer_limit]\n"
+            "          [-w stall_ms] [-T secs] [-p port] [-o path] "
+            "[-F fault_spec]\n"
+            "          [-O arrival|fifo|causal]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int sizes[MAX_LIST]   = { 10, 20, 50 }, nsizes   = 3;
+    int fanouts[MAX_LIST] = { 3 },          nfanouts = 1;
+    int ttls[MAX_LIST]    = { 5 },          nttls    = 1;
+    int seeds[MAX_LIST]   = { 42, 9999 },   nseeds   = 2;
+    double losses[MAX_LIST] = { 0 };
+    int nlosses = 1;
+    int push = 1, hybrid = 1, ihave = 0, peer_limit = 20;
+    const char *out_path = "results/experiment.jsonl";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:t:s:M:L:m:r:D:K:l:w:T:p:o:F:O:h")) != -1) {
+        switch (opt) {
+        case 'n': nsizes   = parse_ints(optarg, sizes);   break;
+        case 'f': nfanouts = parse_ints(optarg, fanouts); break;
+        case 't': nttls    = parse_ints(optarg, ttls);    break;
+        case 's': nseeds   = parse_ints(optarg, seeds);   break;
+        case 'M':
+            push   = strstr(optarg, "push")   != NULL;
+            hybrid = strstr(optarg, "hybrid") != NULL;
+            ihave  = strstr(optarg, "ihave")  != NULL;
+            break;
+        case 'm': msgs_per_run = atoi(optarg); break;
+        case 'r': inject_rate  = atoi(optarg); break;
+        case 'D': publish_secs = atoi(optarg); break;
+        case 'K': num_publishers = atoi(optarg); break;
+        case 'l': peer_limit   = atoi(optarg); break;
+        case 'w': stall_ms     = atoi(optarg); break;
+        case 'T': run_limit_s  = atoi(optarg); break;
+        case 'p': base_port    = atoi(optarg); break;
+        case 'o': out_path     = optarg;       break;
+        case 'F': fault_spec   = optarg;       break;
+        case 'O':
+            delivery_order = order_mode_from_name(optarg);
+            if (delivery_order < 0) { usage(argv[0]); return 1; }
+            break;
+        case 'L': nlosses  = parse_doubles(optarg, losses); break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    long total = publish_secs > 0 ? (long)inject_rate * publish_secs
+                                  : msgs_per_run;
+    if (total < 1 || total > MAX_EXP_MSGS || inject_rate < 1 ||
+        (!push && !hybrid && !ihave)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (*fault_spec) {
+        fault_t *f = fault_open(fault_spec, 0, 0);   /* validate once */
+        if (!f) return 1;
+        fault_close(f);
+    }
+
+    /* Node threads need far less than the default 8 MB of stack */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    pthread_setattr_default_np(&attr);
+    pthread_attr_destroy(&attr);
+
+    /* Keep the per-node rings mmap()ed so each run's memory goes back
+     * to the OS at cleanup; glibc would otherwise raise the threshold
+     * after the first free and recycle them through fragmented heaps. */
+    mallopt(M_MMAP_THRESHOLD, 64 * 1024);
+
+    FILE *out = NULL;
+    if (strcmp(out_path, "-") != 0) {
+        if (strncmp(out_path, "results/", 8) == 0) mkdir("results", 0755);
+        out = fopen(out_path, "a");
+        if (!out) { perror(out_path); return 1; }
+    }
+
+    printf("%-6s %5s %3s %3s %6s %5s %8s %13s %8s %8s %8s %9s %9s %6s\n",
+           "mode", "n", "f", "ttl", "seed", "loss", "delivery", "complete",
+           "t100_ms", "lat_p50", "lat_p99", "KB/s/node", "gossip/msg", "inv");
+
+    int run_id = 0;
+    static const char *mode_names[] = { "push", "hybrid", "ihave" };
+    for (int mi = 0; mi < 3; mi++) {
+        if ((mi == 0 && !push) || (mi == 1 && !hybrid) ||
+            (mi == 2 && !ihave)) continue;
+        for (int a = 0; a < nsizes; a++)
+        for (int b = 0; b < nfanouts; b++)
+        for (int c = 0; c < nttls; c++)
+        for (int d = 0; d < nseeds; d++)
+        for (int e = 0; e < nlosses; e++) {
+            run_params_t p = {
+                .n = sizes[a], .fanout = fanouts[b], .ttl = ttls[c],
+                .peer_limit = peer_limit, .seed = (unsigned)seeds[d],
+                .loss = losses[e],
+                .pull_interval = (mi > 0) ? 1 : 0,
+                .pull_ids = (mi == 2),
+                .mode = mode_names[mi],
+            };
+            run_one(&p, ++run_id, out);
+        }
+    }
+
+    if (out) fclose(out);
+    return 0;
+}
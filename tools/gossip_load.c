@@ -0,0 +1,488 @@
+/* gossip_load – single-node load generator
+ *
+ *   gossip_load [options] <ip:port>
+ *
+ *   -s <n>      virtual peers, one UDP socket each (default 8, max 64)
+ *   -r <n>      offered load in datagrams/s, 0 = as fast as possible
+ *               (default 10000)
+ *   -d <secs>   how long to send (default 5)
+ *   -w <ms>     how long to keep listening afterwards (default 500)
+ *   -m <mix>    traffic mix as weights (default
+ *               "gossip=80,dup=10,ping=5,ihave=3,iwant=2")
+ *   -z <bytes>  GOSSIP payload size (default 256)
+ *   -t <n>      GOSSIP ttl, must be >= 1 for the node to relay (default 4)
+ *   -T <topic>  GOSSIP topic (default none: plain random fanout)
+ *   -k <n>      PoW difficulty the node expects in HELLO (default 0)
+ *
+ * Each virtual peer says HELLO so the node under test adds it to its
+ * membership, answers the node's PINGs to stay there, and then takes its
+ * turn sending the mix.  Every relayed copy of a new GOSSIP comes back
+ * to one of the other virtual peers, which gives
+ *
+ *   relay throughput   new GOSSIP relayed at least once, per second
+ *   drop rate          new GOSSIP never relayed (shed, queue overflow, ...)
+ *   forward latency    send -> first relayed copy received
+ *
+ * The node should have no other peers, or some relays go elsewhere and
+ * count as drops.  Start it with -b omitted and -o larger than -d. */
+#include "message.h"
+#include "serialization.h"
+#include "metrics.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#define MAX_LOAD_PEERS 64
+#define SENT_RING      (1 << 20)   /* new GOSSIP tracked for relays */
+#define DUP_WINDOW     1024        /* duplicates resend one of these */
+
+enum { MIX_GOSSIP, MIX_DUP, MIX_PING, MIX_IHAVE, MIX_IWANT, NUM_MIX };
+static const char *mix_names[NUM_MIX] = {
+    "gossip", "dup", "ping", "ihave", "iwant"
+};
+
+typedef struct {
+    uint64_t seq;       /* which message owns the slot */
+    uint64_t sent_us;
+    int      relayed;   /* set on the first relayed copy */
+} sent_rec_t;
+
+typedef struct {
+    int                fd;
+    struct sockaddr_in addr;
+    char               node_id[NODE_ID_LEN];
+    char               self_addr[ADDR_STR_LEN];
+} vpeer_t;
+
+static vpeer_t            peers[MAX_LOAD_PEERS];
+static int                num_peers = 8;
+static struct sockaddr_in target;
+static sent_rec_t        *sent;
+static unsigned           run_tag;
+static metrics_t          stats;
+static volatile int       listening = 1;
+
+static uint64_t first_relays;   /* receiver thread only */
+static uint64_t relay_copies;
+static uint64_t last_relay_us;
+
+/* =========================================================
+ * Wire helpers
+ * ========================================================= */
+
+static void init_msg(gossip_msg_t *m, const vpeer_t *p, const char *type,
+                     const char *id) {
+    memset(m, 0, sizeof(*m));
+    m->version = 1;
+    snprintf(m->msg_id, ID_LEN, "%s", id);
+    snprintf(m->msg_type, MSG_TYPE_LEN, "%s", type);
+    snprintf(m->sender_id, NODE_ID_LEN, "%s", p->node_id);
+    snprintf(m->sender_addr, ADDR_STR_LEN, "%s", p->self_addr);
+    m->timestamp_ms = current_time_ms();
+    m->ttl = 1;
+}
+
+static void send_to(const vpeer_t *p, const gossip_msg_t *m,
+                    const struct sockaddr_in *to) {
+    char buf[MAX_SERIALIZED_LEN];
+    int len = serialize_message(m, buf, sizeof(buf));
+    if (len <= 0) return;
+    if (sendto(p->fd, buf, (size_t)len, 0, (const struct sockaddr *)to,
+               sizeof(*to)) == len)
+        metrics_count(&stats, M_SENT, msg_type_lookup(m->msg_type));
+    else
+        metrics_count(&stats, M_TX_DROPPED, msg_type_lookup(m->msg_type));
+}
+
+static void gossip_id(char *out, uint64_t seq) {
+    snprintf(out, ID_LEN, "load-%u-%llu", run_tag, (unsigned long long)seq);
+}
+
+/* seq of one of our GOSSIP IDs, or -1 */
+static int64_t parse_gossip_id(const char *id) {
+    char prefix[32];
+    int n = snprintf(prefix, sizeof(prefix), "load-%u-", run_tag);
+    if (strncmp(id, prefix, (size_t)n) != 0) return -1;
+    return (int64_t)strtoull(id + n, NULL, 10);
+}
+
+/* =========================================================
+ * Receiver
+ * ========================================================= */
+
+static void on_gossip(const char *id) {
+    relay_copies++;
+    int64_t seq = parse_gossip_id(id);
+    if (seq < 0) return;
+    sent_rec_t *r = &sent[(uint64_t)seq % SENT_RING];
+    uint64_t sent_us = __atomic_load_n(&r->sent_us, __ATOMIC_ACQUIRE);
+    if (r->seq != (uint64_t)seq || sent_us == 0 || r->relayed) return;
+    r->relayed = 1;
+
+    uint64_t now = current_time_us();
+    metrics_observe(&stats, H_RELAY_US, now - sent_us);
+    first_relays++;
+    last_relay_us = now;
+}
+
+static void on_pong(const char *wire) {
+    static const char key[] = "\"reply_to\": \"PING_";
+    const char *r = strstr(wire, key);
+    if (!r) return;
+    uint64_t sent_us = strtoull(r + sizeof(key) - 1, NULL, 10);
+    uint64_t now = current_time_us();
+    if (sent_us > 0 && sent_us <= now)
+        metrics_observe(&stats, H_PING_RTT_US, now - sent_us);
+}
+
+/* Keep the virtual peer in the node's membership */
+static void on_ping(const vpeer_t *p, const char *id) {
+    gossip_msg_t pong;
+    char pong_id[ID_LEN];
+    snprintf(pong_id, sizeof(pong_id), "PONG_%llu",
+             (unsigned long long)current_time_ms());
+    init_msg(&pong, p, "PONG", pong_id);
+    snprintf(pong.payload, MSG_BUF_SIZE, "{ \"reply_to\": \"%s\" }", id);
+    send_to(p, &pong, &target);
+}
+
+static void *receiver_func(void *arg) {
+    (void)arg;
+    struct pollfd pfds[MAX_LOAD_PEERS];
+    for (int i = 0; i < num_peers; i++) {
+        pfds[i].fd     = peers[i].fd;
+        pfds[i].events = POLLIN;
+    }
+
+    char buf[MAX_SERIALIZED_LEN + 1];
+    while (listening) {
+        if (poll(pfds, (nfds_t)num_peers, 100) <= 0) continue;
+        for (int i = 0; i < num_peers; i++) {
+            if (!(pfds[i].revents & POLLIN)) continue;
+            /* Drain the socket before polling again */
+            for (;;) {
+                ssize_t len = recv(peers[i].fd, buf, sizeof(buf) - 1,
+                                   MSG_DONTWAIT);
+                if (len <= 0) break;
+                buf[len] = '\0';
+
+                char id[ID_LEN], type[MSG_TYPE_LEN];
+                if (wire_peek_header(buf, id, sizeof(id),
+                                     type, sizeof(type)) != 0 &&
+                    (wire_peek_field(buf, "msg_id", id, sizeof(id)) != 0 ||
+                     wire_peek_field(buf, "msg_type", type, sizeof(type)) != 0))
+                    continue;
+
+                int t = msg_type_lookup(type);
+                metrics_count(&stats, M_RECEIVED, t);
+                switch (t) {
+                case MSG_GOSSIP: on_gossip(id);            break;
+                case MSG_PONG:   on_pong(buf);             break;
+                case MSG_PING:   on_ping(&peers[i], id);   break;
+                default:                                   break;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* =========================================================
+ * Sender
+ * ========================================================= */
+
+static void say_hello(vpeer_t *p, int difficulty) {
+    gossip_msg_t hello;
+    char id[ID_LEN];
+    snprintf(id, sizeof(id), "HELLO_%llu", (unsigned long long)current_time_ms());
+    init_msg(&hello, p, "HELLO", id);
+
+    if (difficulty > 0) {
+        unsigned long nonce;
+        char digest[65];
+        pow_mine(p->node_id, difficulty, &nonce, digest);
+        snprintf(hello.payload, MSG_BUF_SIZE,
+                 "{ \"capabilities\": [\"udp\", \"json\"], "
+                 "\"pow\": { \"hash_alg\": \"sha256\", \"difficulty_k\": %d, "
+                 "\"nonce\": %lu, \"digest_hex\": \"%s\" } }",
+                 difficulty, nonce, digest);
+    } else {
+        snprintf(hello.payload, MSG_BUF_SIZE,
+                 "{ \"capabilities\": [\"udp\", \"json\"] }");
+    }
+    send_to(p, &hello, &target);
+}
+
+/* "gossip=80,dup=10" -> weights[] */
+static int parse_mix(const char *spec, int weights[NUM_MIX]) {
+    memset(weights, 0, NUM_MIX * sizeof(int));
+    char copy[256];
+    snprintf(copy, sizeof(copy), "%s", spec);
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (!eq) return -1;
+        *eq = '\0';
+        int k;
+        for (k = 0; k < NUM_MIX && strcmp(tok, mix_names[k]) != 0; k++)
+            ;
+        if (k == NUM_MIX) return -1;
+        weights[k] = atoi(eq + 1);
+    }
+    int total = 0;
+    for (int k = 0; k < NUM_MIX; k++) total += weights[k];
+    return (total > 0) ? 0 : -1;
+}
+
+static int pick(const int weights[NUM_MIX], int total) {
+    int r = rand() % total;
+    for (int k = 0; k < NUM_MIX; k++) {
+        if (r < weights[k]) return k;
+        r -= weights[k];
+    }
+    return MIX_GOSSIP;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-s peers] [-r rate] [-d secs] [-w ms] [-m mix]\n"
+            "          [-z bytes] [-t ttl] [-T topic] [-k pow] <ip:port>\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    int rate = 10000, duration = 5, drain_ms = 500, payload_len = 256;
+    int ttl = 4, difficulty = 0;
+    const char *mix_spec = "gossip=80,dup=10,ping=5,ihave=3,iwant=2";
+    const char *topic = "";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:r:d:w:m:z:t:T:k:h")) != -1) {
+        switch (opt) {
+        case 's': num_peers   = atoi(optarg); break;
+        case 'r': rate        = atoi(optarg); break;
+        case 'd': duration    = atoi(optarg); break;
+        case 'w': drain_ms    = atoi(optarg); break;
+        case 'm': mix_spec    = optarg;       break;
+        case 'z': payload_len = atoi(optarg); break;
+        case 't': ttl         = atoi(optarg); break;
+        case 'T': topic       = optarg;       break;
+        case 'k': difficulty  = atoi(optarg); break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) { usage(argv[0]); return 1; }
+
+    int weights[NUM_MIX];
+    if (parse_mix(mix_spec, weights) != 0) {
+        fprintf(stderr, "bad mix: %s\n", mix_spec);
+        return 1;
+    }
+    int weight_total = 0;
+    for (int k = 0; k < NUM_MIX; k++) weight_total += weights[k];
+
+    if (num_peers < 2 || num_peers > MAX_LOAD_PEERS) {
+        fprintf(stderr, "peers must be 2..%d (relays skip the sender)\n",
+                MAX_LOAD_PEERS);
+        return 1;
+    }
+    if (payload_len < 0 || payload_len >= MSG_BUF_SIZE - 1)
+        payload_len = MSG_BUF_SIZE - 2;
+
+    char ip[64] = "127.0.0.1";
+    int  port;
+    if (sscanf(argv[optind], "%63[^:]:%d", ip, &port) != 2 &&
+        sscanf(argv[optind], "%d", &port) != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port   = htons((uint16_t)port);
+    if (inet_pton(AF_INET, ip, &target.sin_addr) != 1) {
+        fprintf(stderr, "bad address: %s\n", ip);
+        return 1;
+    }
+
+    sent = calloc(SENT_RING, sizeof(sent_rec_t));
+    if (!sent || metrics_init(&stats) != 0) {
+        fprintf(stderr, "allocation failed\n");
+        return 1;
+    }
+    run_tag = (unsigned)getpid();
+    srand(run_tag);
+
+    for (int i = 0; i < num_peers; i++) {
+        vpeer_t *p = &peers[i];
+        p->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        int bufsz = 4 << 20;
+        setsockopt(p->fd, SOL_SOCKET, SO_RCVBUF, &bufsz, sizeof(bufsz));
+        setsockopt(p->fd, SOL_SOCKET, SO_SNDBUF, &bufsz, sizeof(bufsz));
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family      = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t alen = sizeof(p->addr);
+        if (p->fd < 0 ||
+            bind(p->fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+            getsockname(p->fd, (struct sockaddr *)&p->addr, &alen) < 0) {
+            perror("socket");
+            return 1;
+        }
+        snprintf(p->node_id, NODE_ID_LEN, "load-peer-%u-%d", run_tag, i);
+        snprintf(p->self_addr, ADDR_STR_LEN, "127.0.0.1:%d",
+                 ntohs(p->addr.sin_port));
+    }
+
+    pthread_t receiver;
+    pthread_create(&receiver, NULL, receiver_func, NULL);
+
+    for (int i = 0; i < num_peers; i++) say_hello(&peers[i], difficulty);
+    sleep_us(200000);   /* let the node admit everyone */
+
+    /* Template GOSSIP; only the ID changes per message */
+    gossip_msg_t gossip;
+    init_msg(&gossip, &peers[0], "GOSSIP", "");
+    gossip.ttl = ttl;
+    snprintf(gossip.topic, TOPIC_LEN, "%s", topic);
+    for (int i = 0; i < payload_len; i++)
+        gossip.payload[i] = (char)('a' + i % 26);
+
+    uint64_t counts[NUM_MIX] = {0};
+    uint64_t seq = 0, ihave_seq = 0, ops = 0;
+    uint64_t start = current_time_us();
+    uint64_t end   = start + (uint64_t)duration * 1000000ull;
+    uint64_t now   = start;
+
+    while (now < end) {
+        if (rate > 0) {
+            /* Pace against the schedule, not the previous send */
+            uint64_t due = start + ops * 1000000ull / (uint64_t)rate;
+            if (due > now) sleep_us(due - now);
+        }
+        vpeer_t *p = &peers[ops % (uint64_t)num_peers];
+        int kind = pick(weights, weight_total);
+        /* Duplicates and IWANT need something to refer back to */
+        if ((kind == MIX_DUP || kind == MIX_IWANT) && seq == 0)
+            kind = MIX_GOSSIP;
+
+        gossip_msg_t m;
+        char id[ID_LEN];
+        switch (kind) {
+        case MIX_GOSSIP: {
+            gossip_id(gossip.msg_id, seq);
+            snprintf(gossip.sender_id, NODE_ID_LEN, "%s", p->node_id);
+            snprintf(gossip.sender_addr, ADDR_STR_LEN, "%s", p->self_addr);
+            gossip.timestamp_ms = current_time_ms();
+            sent_rec_t *r = &sent[seq % SENT_RING];
+            r->seq     = seq;
+            r->relayed = 0;
+            __atomic_store_n(&r->sent_us, current_time_us(), __ATOMIC_RELEASE);
+            send_to(p, &gossip, &target);
+            seq++;
+            break;
+        }
+        case MIX_DUP: {
+            uint64_t back = (uint64_t)rand() % (seq < DUP_WINDOW ? seq : DUP_WINDOW);
+            gossip_id(id, seq - 1 - back);
+            m = gossip;
+            snprintf(m.msg_id, ID_LEN, "%s", id);
+            snprintf(m.sender_id, NODE_ID_LEN, "%s", p->node_id);
+            snprintf(m.sender_addr, ADDR_STR_LEN, "%s", p->self_addr);
+            send_to(p, &m, &target);
+            break;
+        }
+        case MIX_PING:
+            snprintf(id, sizeof(id), "PING_%llu",
+                     (unsigned long long)current_time_us());
+            init_msg(&m, p, "PING", id);
+            snprintf(m.payload, MSG_BUF_SIZE,
+                     "{ \"capabilities\": [\"udp\", \"json\"] }");
+            send_to(p, &m, &target);
+            break;
+        case MIX_IHAVE: {
+            /* An ID the node has never seen, so it should ask for it */
+            snprintf(id, sizeof(id), "IHAVE_%llu",
+                     (unsigned long long)current_time_ms());
+            init_msg(&m, p, "IHAVE", id);
+            snprintf(m.payload, MSG_BUF_SIZE,
+                     "{ \"ids\": [\"load-%u-ihave-%llu\"], \"topics\": [\"%s\"] }",
+                     run_tag, (unsigned long long)ihave_seq++, topic);
+            send_to(p, &m, &target);
+            break;
+        }
+        case MIX_IWANT: {
+            /* A recent message the node should still hold */
+            uint64_t back = (uint64_t)rand() % (seq < DUP_WINDOW ? seq : DUP_WINDOW);
+            char want[ID_LEN];
+            gossip_id(want, seq - 1 - back);
+            snprintf(id, sizeof(id), "IWANT_%llu",
+                     (unsigned long long)current_time_ms());
+            init_msg(&m, p, "IWANT", id);
+            snprintf(m.payload, MSG_BUF_SIZE, "{ \"ids\": [\"%s\"] }", want);
+            send_to(p, &m, &target);
+            break;
+        }
+        }
+        counts[kind]++;
+        ops++;
+        now = current_time_us();
+    }
+    uint64_t send_us = now - start;
+
+    sleep_us((uint64_t)drain_ms * 1000);
+    listening = 0;
+    pthread_join(receiver, NULL);
+
+    /* ---- Report ---- */
+    double secs = (double)send_us / 1e6;
+    printf("offered   %llu datagrams in %.2f s (%.0f/s):",
+           (unsigned long long)ops, secs, (double)ops / secs);
+    for (int k = 0; k < NUM_MIX; k++)
+        printf(" %s=%llu", mix_names[k], (unsigned long long)counts[k]);
+    printf("\n");
+
+    uint64_t send_fail = metrics_counter_total(&stats, M_TX_DROPPED);
+    if (send_fail)
+        printf("          %llu sends failed locally\n",
+               (unsigned long long)send_fail);
+
+    printf("received ");
+    for (int t = 0; t < METRICS_TYPE_SLOTS; t++) {
+        uint64_t n = metrics_counter(&stats, M_RECEIVED, t);
+        if (n) printf(" %s=%llu", metrics_type_name(t), (unsigned long long)n);
+    }
+    printf("\n");
+
+    uint64_t new_sent = counts[MIX_GOSSIP];
+    double relay_secs = (last_relay_us > start)
+                        ? (double)(last_relay_us - start) / 1e6 : secs;
+    printf("relay     %llu of %llu new GOSSIP relayed (drop %.2f%%), "
+           "%.0f msg/s, %.2f copies/msg\n",
+           (unsigned long long)first_relays, (unsigned long long)new_sent,
+           new_sent ? 100.0 * (double)(new_sent - first_relays) / (double)new_sent : 0.0,
+           (double)first_relays / relay_secs,
+           first_relays ? (double)relay_copies / (double)first_relays : 0.0);
+
+    for (int h = 0; h < 2; h++) {
+        metric_hist_t which = h ? H_PING_RTT_US : H_RELAY_US;
+        hist_summary_t s;
+        metrics_hist_summary(&stats, which, &s);
+        if (s.count == 0) continue;
+        printf("%-9s us  p50 %llu  p90 %llu  p99 %llu  p999 %llu  max %llu  (n=%llu)\n",
+               h ? "ping rtt" : "forward",
+               (unsigned long long)s.p50, (unsigned long long)s.p90,
+               (unsigned long long)s.p99, (unsigned long long)s.p999,
+               (unsigned long long)s.max, (unsigned long long)s.count);
+    }
+
+    for (int i = 0; i < num_peers; i++) close(peers[i].fd);
+    metrics_free(&stats);
+    free(sent);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* gossip_state_check – replicated state convergence check
+ *
+ *   gossip_state_check [options]
+ *
+ *   -n <n>      nodes (default 3)
+ *   -k <n>      keys written by node 0 (default 5000)
+ *   -j <n>      nodes that join only after every write was made
+ *               (default 1)
+ *   -y <ms>     digest exchange period (default 200)
+ *   -T <secs>   give up after this long (default 30)
+ *   -p <port>   first UDP port (default 22000)
+ *
+ * All nodes live in this process and know each other from the start,
+ * except the late joiners, which are created once node 0 holds every
+ * key.  The check passes when every node holds all keys with the same
+ * per-bucket digest; the exit status is 0 then and 1 otherwise.
+ *
+ * More keys than a few digest replies carry are needed to exercise the
+ * repair path: anti-entropy must get past the first slots instead of
+ * sending the same prefix every round. */
+#include "node.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#define MAX_NODES 16
+
+static node_t nodes[MAX_NODES];
+
+static void peer_addr(struct sockaddr_in *a, int port) {
+    memset(a, 0, sizeof(*a));
+    a->sin_family      = AF_INET;
+    a->sin_port        = htons((uint16_t)port);
+    a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static int start_node(int i, int port, int sync_ms) {
+    node_config_t cfg;
+    node_config_defaults(&cfg);
+    cfg.port          = port;
+    cfg.seed          = 42u + (unsigned)i;
+    cfg.log_path      = "";
+    cfg.state_sync_ms = sync_ms;
+    if (node_init_config(&nodes[i], &cfg) != 0) {
+        fprintf(stderr, "node %d (port %d) failed to start\n", i, port);
+        return -1;
+    }
+    return 0;
+}
+
+/* Keys held by node i and its bucket digest */
+static int snapshot(int i, char *digest, size_t size) {
+    node_t *node = &nodes[i];
+    pthread_mutex_lock(&node->lock);
+    int count = node->state.count;
+    crdt_digest_hex(&node->state, digest, size);
+    pthread_mutex_unlock(&node->lock);
+    return count;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-n nodes] [-k keys] [-j late] [-y sync_ms] "
+            "[-T secs] [-p port]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int n = 3, keys = 5000, late = 1, sync_ms = 200, limit_s = 30;
+    int base_port = 22000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:k:j:y:T:p:h")) != -1) {
+        switch (opt) {
+        case 'n': n         = atoi(optarg); break;
+        case 'k': keys      = atoi(optarg); break;
+        case 'j': late      = atoi(optarg); break;
+        case 'y': sync_ms   = atoi(optarg); break;
+        case 'T': limit_s   = atoi(optarg); break;
+        case 'p': base_port = atoi(optarg); break;
+        default:  usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (n < 2 || n > MAX_NODES || late < 0 || late >= n || keys < 1 ||
+        keys > CRDT_MAX_KEYS || sync_ms < 1 || limit_s < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* ---- Early nodes: a full mesh ---- */
+    int early = n - late, started = 0;
+    for (; started < early; started++)
+        if (start_node(started, base_port + started, sync_ms) != 0) break;
+    if (started < early) {
+        for (int i = 0; i < started; i++) node_destroy(&nodes[i]);
+        return 1;
+    }
+    for (int i = 0; i < early; i++) {
+        for (int j = 0; j < early; j++) {
+            if (j == i) continue;
+            struct sockaddr_in a;
+            peer_addr(&a, base_port + j);
+            membership_add(&nodes[i].membership, a);
+        }
+        node_run(&nodes[i]);
+    }
+
+    uint64_t t0 = current_time_us();
+    char key[CRDT_KEY_LEN], value[32];
+    for (int k = 0; k < keys; k++) {
+        snprintf(key, sizeof(key), "key-%05d", k);
+        snprintf(value, sizeof(value), "v%d", k);
+        if (node_state_set(&nodes[0], key, value) != 0) {
+            fprintf(stderr, "set %s failed\n", key);
+            break;
+        }
+    }
+
+    /* ---- Late joiners: know node 0 only, everyone learns them ---- */
+    for (int i = early; i < n; i++) {
+        if (start_node(i, base_port + i, sync_ms) != 0) break;
+        started++;
+        struct sockaddr_in a;
+        peer_addr(&a, base_port);
+        membership_add(&nodes[i].membership, a);
+        for (int j = 0; j < i; j++) {
+            peer_addr(&a, base_port + i);
+            membership_add(&nodes[j].membership, a);
+        }
+        node_run(&nodes[i]);
+    }
+
+    /* ---- Wait for every node to match node 0 ---- */
+    char want[CRDT_BUCKETS * 17 + 1], got[sizeof(want)];
+    int ok = (started == n), counts[MAX_NODES] = { 0 };
+    uint64_t deadline = t0 + (uint64_t)limit_s * 1000000u;
+    while (ok) {
+        int total = snapshot(0, want, sizeof(want)), same = 1;
+        for (int i = 0; i < n; i++) {
+            counts[i] = snapshot(i, got, sizeof(got));
+            if (counts[i] != keys || strcmp(got, want) != 0) same = 0;
+        }
+        if (same && total == keys) break;
+        if (current_time_us() >= deadline) { ok = 0; break; }
+        usleep(100 * 1000);
+    }
+    double secs = (double)(current_time_us() - t0) / 1e6;
+
+    for (int i = 0; i < n; i++)
+        printf("node %d%s: %d / %d keys\n", i, i >= early ? " (late)" : "",
+               counts[i], keys);
+    printf("%s after %.1f s\n", ok ? "converged" : "NOT converged", secs);
+
+    for (int i = 0; i < started; i++) node_stop(&nodes[i]);
+    for (int i = 0; i < started; i++) node_cleanup(&nodes[i]);
+    return ok ? 0 : 1;
+}